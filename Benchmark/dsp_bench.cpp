@@ -0,0 +1,1707 @@
+#include <stdio.h>
+#include <chrono>
+#include <algorithm>
+#include <climits>
+#include "dsp_engine.h"
+#include "dsp_design.h"
+
+#define BENCH_MIN_MILLIS      100                 // Minimum measuring time per configuration
+#define BENCH_WARMUP_BLOCKS   64                  // Blocks run before measuring
+#define BENCH_REPEATS         5                   // Timed runs per configuration, the median is reported
+#define BENCH_PEAK_BASE_FREQ  25.0                // Lowest synthetic peak filter frequency
+#define BENCH_NOISE_SECONDS   2                   // Length of the noise floor measurement
+#define BENCH_NOISE_SETTLE    (DSP_SAMPLE_RATE/2) // Samples ignored while the filters settle
+#define BENCH_SWITCH_FLOOR_DB -120.0              // Output difference always allowed after a precision switch
+#define BENCH_SWITCH_MARGIN_DB 6.0                // Allowed step after a precision switch above the structure noise
+#define BENCH_Q15_MAX_DIFF_DB -30.0              // Largest Q15 difference to Q31 at any level (a wrap is near full scale)
+#define BENCH_FIR_CHECK       (4*DSP_FIR_MAX_TAPS) // Samples compared with the direct form FIR
+#define BENCH_DELAY_CHECK     DSP_SAMPLE_RATE     // Samples used to measure the fractional delay
+#define BENCH_DELAY_SETTLE    1000                // Samples ignored while the all-pass settles
+#define BENCH_SHARE_BLOCKS    40                  // Blocks per step of the shared processing check
+#define BENCH_SHARE_STEPS     4                   // Same filters, different filters, same again, edited filter
+#define BENCH_LIMIT_CHECK     DSP_SAMPLE_RATE     // Samples of the limiter check
+#define BENCH_LIMIT_BURST     4410                // Length of the loud and quiet parts of the limiter check
+#define BENCH_DITHER_FREQ     4000.0              // Upper edge of the band where the dither noise is measured
+
+static const int      bench_block_sizes[] = { 16, 32, 48, 64, 96 };
+static const int      bench_precisions[]  = { PRC_FLT, PRC_DBL, PRC_TDF2, PRC_DF1_EF, PRC_Q31, PRC_Q15 };
+static const char*    bench_precision_name[] = { "FLT", "DBL", "TDF2", "DF1EF", "Q31", "Q15" };
+static const int      bench_kernels[]     = { DSP_KERNEL_FILTER, DSP_KERNEL_CASCADE, DSP_KERNEL_PAIRED };
+static const char*    bench_kernel_name[] = { "filter", "cascade", "paired" };
+static const int      bench_transitions[] = { DSP_TRANSITION_NONE, DSP_TRANSITION_CROSSFADE, DSP_TRANSITION_INTERPOLATE };
+static const char*    bench_transition_name[] = { "none", "crossfade", "interp" };
+static const int      bench_transition_filters[] = { 5, 10, 20 };
+static const int      bench_block_presets[] = { 16, 32, 64, 96 };
+static const int      bench_decimations[] = { 1, 4, 8, 16 };
+static const int      bench_fir_taps[]    = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+static const float    bench_xo_freqs[]    = { 2000, 500, 120 };
+static const int      bench_xo_slopes[]   = { 24, 48 };
+static const float    bench_fractions[]   = { 0.25, 0.5, 0.75 };
+static const float    bench_delay_freqs[] = { 1000, 5000, 10000, 16000 };
+static const int      bench_share_decimations[] = { 1, 16, 1, 1 };
+static const float    bench_share_xo_freqs[] = { 0, 0, 2000, 0 };
+static const int      bench_share_fir_taps[] = { 0, 0, 0, 512 };
+
+static sample_t       bench_input[DSP_MAX_SAMPLES*DSP_NUM_CHANNELS];
+static sample_t       bench_output[DSP_MAX_SAMPLES*DSP_NUM_CHANNELS];
+static filter_def_t   bench_filters[DSP_MAX_FILTERS*DSP_NUM_CHANNELS];
+static float          bench_fir[DSP_FIR_MAX_TAPS];
+static float          bench_fir_hist[2*DSP_FIR_MAX_TAPS];
+static float          bench_fir_in[DSP_MAX_SAMPLES];
+static float          bench_fir_out[DSP_MAX_SAMPLES];
+static float          bench_fir_ref[BENCH_FIR_CHECK];
+static float          bench_delay_buff[BENCH_DELAY_CHECK];
+static sample_t       bench_share_out[2][BENCH_SHARE_STEPS*BENCH_SHARE_BLOCKS*DSP_MAX_SAMPLES*DSP_NUM_CHANNELS];
+static filter_def_t   bench_share_filters[DSP_MAX_FILTERS*DSP_NUM_CHANNELS];
+static float          bench_limit_in[BENCH_LIMIT_CHECK];
+static float          bench_limit_out[BENCH_LIMIT_CHECK];
+static limiter_def_t  bench_limiters[] = {  // Channel, Ceiling in dBFS, Attack (look-ahead) in ms, Release in ms
+  {0, -0.1, 0.0, 50 },
+  {0, -0.1, 1.0, 50 },
+  {0, -0.1, 5.0, 50 },
+  {0, -6.0, 1.0, 200 }
+};
+
+static filter_def_t   bench_noise_filters[] = {  // Channel, Filter type, Center frequency, Q value, Gain
+  {0, DSP_FILTER_PEAK_EQ, 25, 5.0, 6.0 },
+  {0, DSP_FILTER_LOW_PASS, 40, 0.7, 0.0 },
+  {0, DSP_FILTER_LOW_PASS, 120, 0.7, 0.0 },
+  {0, DSP_FILTER_PEAK_EQ, 1000, 2.0, -3.0 },
+  {0, DSP_FILTER_HIGH_PASS, 3000, 0.7, 0.0 },
+  {0, DSP_FILTER_HIGH_SHELF, 11000, 0.7, 3.0 }
+};
+
+static constexpr filter_def_t bench_design_filters[] = {  // Every filter type at low, mid and high frequencies
+  {0, DSP_FILTER_LOW_PASS, 20, 0.7, 0.0 },      {0, DSP_FILTER_LOW_PASS, 1000, 0.5, 0.0 },      {0, DSP_FILTER_LOW_PASS, 20000, 2.0, 0.0 },
+  {0, DSP_FILTER_HIGH_PASS, 20, 0.7, 0.0 },     {0, DSP_FILTER_HIGH_PASS, 1000, 0.5, 0.0 },     {0, DSP_FILTER_HIGH_PASS, 20000, 2.0, 0.0 },
+  {0, DSP_FILTER_BAND_PASS, 20, 0.7, 0.0 },     {0, DSP_FILTER_BAND_PASS, 1000, 5.0, 0.0 },     {0, DSP_FILTER_BAND_PASS, 20000, 2.0, 0.0 },
+  {0, DSP_FILTER_NOTCH, 20, 10.0, 0.0 },        {0, DSP_FILTER_NOTCH, 1000, 5.0, 0.0 },         {0, DSP_FILTER_NOTCH, 20000, 2.0, 0.0 },
+  {0, DSP_FILTER_APF, 20, 0.7, 0.0 },           {0, DSP_FILTER_APF, 1000, 0.5, 0.0 },           {0, DSP_FILTER_APF, 20000, 2.0, 0.0 },
+  {0, DSP_FILTER_PEAK_EQ, 20, 5.0, 12.0 },      {0, DSP_FILTER_PEAK_EQ, 1000, 2.0, -3.0 },      {0, DSP_FILTER_PEAK_EQ, 20000, 1.0, -24.0 },
+  {0, DSP_FILTER_LOW_SHELF, 20, 0.7, 6.0 },     {0, DSP_FILTER_LOW_SHELF, 1000, 0.5, -12.0 },   {0, DSP_FILTER_LOW_SHELF, 20000, 1.0, 30.0 },
+  {0, DSP_FILTER_HIGH_SHELF, 20, 0.7, -6.0 },   {0, DSP_FILTER_HIGH_SHELF, 1000, 0.5, 12.0 },   {0, DSP_FILTER_HIGH_SHELF, 20000, 1.0, -30.0 }
+};
+
+static_assert( dsp_design_check_filters( bench_design_filters, DSP_COUNT( bench_design_filters ) ), "Invalid bench_design_filters" );
+
+static constexpr dsp_design_table<DSP_COUNT( bench_design_filters )> bench_design_biquads =
+  dsp_design_filters( bench_design_filters, dsp_design_make_index<DSP_COUNT( bench_design_filters )>() );
+
+dsp_channel_t DSP_Channels[DSP_NUM_CHANNELS] = {
+  {
+    "Bench Left",       // Channel name
+    {1,0},              // Input channel(s) - Left/Right
+    0,                  // Gain in dB
+    0                   // Delay in milliseconds
+  },
+  {
+    "Bench Right",
+    {0,1},
+    0,
+    0
+  }
+};
+
+
+//------------------------------------------------------------------------------------
+// Host implementation of the engine output function
+//------------------------------------------------------------------------------------
+void dsp_printf( const char* format, ... ) {
+
+  va_list   args;
+
+  va_start( args, format );
+  vprintf( format, args );
+  va_end( args );
+}
+
+
+//------------------------------------------------------------------------------------
+// Host implementation of the engine cycle counter (nanoseconds, see DSP_CPU_MHZ)
+//------------------------------------------------------------------------------------
+uint32_t dsp_get_cycles() {
+
+  return( (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+
+//------------------------------------------------------------------------------------
+// Host implementation of the engine large buffer allocation
+//------------------------------------------------------------------------------------
+void* dsp_malloc_large( size_t size ) {
+
+  return( malloc( size ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Fill the interleaved input block with a two-tone test signal at -6 dBFS
+//------------------------------------------------------------------------------------
+static void bench_fill_input( int sample_count ) {
+
+  for( int i = 0; i < sample_count; ++ i ) {
+    double t = (double) i/DSP_SAMPLE_RATE;
+    double value = 0.25*sin( 2*M_PI*40.0*t ) + 0.25*sin( 2*M_PI*1000.0*t );
+
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      bench_input[i*DSP_NUM_CHANNELS + channel_id] = ((sample_t) ( value*DSP_MAX_LEVEL )) << SAMPLE_NULL_BITS;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Load a set of synthetic peak filters spread logarithmically over the audio band
+//------------------------------------------------------------------------------------
+static esp_err_t bench_load_filters( int filter_count, int precision ) {
+
+  int       num_defs;
+
+  num_defs = 0;
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    for( int i = 0; i < filter_count; ++ i ) {
+      bench_filters[num_defs].channel = channel_id;
+      bench_filters[num_defs].filter_type = DSP_FILTER_PEAK_EQ;
+      bench_filters[num_defs].frequency = BENCH_PEAK_BASE_FREQ*pow( 2.0, i*0.45 );
+      bench_filters[num_defs].Q = 2.0;
+      bench_filters[num_defs].gain = ( i & 1 ) ? -3.0 : 3.0;
+      ++ num_defs;
+    }
+  }
+
+  if( dsp_update_filters( bench_filters, num_defs ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
+
+  // Force the precision of every loaded filter
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_bank_t* bank = dsp_get_bank( DSP_Channels[channel_id].data );
+
+    for( int i = 0; i < bank->num_filters; ++ i ) {
+      bank->filter[i].precision = precision;
+      dsp_biquad_quantize( &bank->filter[i] );
+      dsp_biquad_reset( &bank->filter[i] );
+    }
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Time dsp_filter() for the loaded filters and return the median nanoseconds per
+// sample of BENCH_REPEATS runs sharing the measuring time
+//------------------------------------------------------------------------------------
+static double bench_run( int sample_count, int min_millis ) {
+
+  bool      clip_flag;
+  int       buffer_len;
+  long      blocks;
+  double    elapsed_ns;
+  double    runs[BENCH_REPEATS];
+
+  buffer_len = sample_count*DSP_NUM_CHANNELS*sizeof( sample_t );
+
+  for( int i = 0; i < BENCH_WARMUP_BLOCKS; ++ i ) {
+    dsp_filter( DSP_Channels, bench_input, bench_output, buffer_len, true, &clip_flag );
+  }
+
+  for( double& run : runs ) {
+    auto start = std::chrono::steady_clock::now();
+    blocks = 0;
+    elapsed_ns = 0;
+
+    while( elapsed_ns < min_millis*1e6/BENCH_REPEATS ) {
+      // Check the clock every 256 blocks to keep timer overhead out of the result
+      for( int i = 0; i < 256; ++ i ) {
+        dsp_filter( DSP_Channels, bench_input, bench_output, buffer_len, true, &clip_flag );
+      }
+      blocks += 256;
+      elapsed_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    run = elapsed_ns/( (double) blocks*sample_count );
+  }
+
+  // The median is not moved by a run disturbed by other processes
+  std::sort( runs, runs + BENCH_REPEATS );
+
+  return( runs[BENCH_REPEATS/2] );
+}
+
+
+//------------------------------------------------------------------------------------
+// Measure the output noise floor of each filter structure against a long double
+// DF-I reference, driving the filter with the reference signal of the noise estimate.
+// The automatic selection must meet the noise target as measured, and no cheaper
+// kernel may meet it too.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_noise( void ) {
+
+  static float  buffer[DSP_MAX_SAMPLES];
+  static double reference[DSP_MAX_SAMPLES];
+  static const int cost_order[] = DSP_PRECISION_COST;
+  dsp_filter_t  filter;
+  long double   x1, x2, y1, y2, y0;
+  double        err_sum;
+  long          err_count;
+  long          n;
+  double        noise_dB[DSP_COUNT( bench_precisions )];
+  int           wrong_count;
+
+  wrong_count = 0;
+
+  printf( "%-12s %8s %6s %6s", "filter", "freq", "Q", "gain" );
+  for( const char* name : bench_precision_name ) {
+    printf( " %9s", name );
+  }
+  printf( " %14s   (noise floor in dBFS)\n", "auto (est)" );
+
+  for( filter_def_t& filter_def : bench_noise_filters ) {
+    printf( "%-12s %8.1f %6.2f %6.1f", filter_def.filter_type == DSP_FILTER_PEAK_EQ ? "Peak EQ" :
+      filter_def.filter_type == DSP_FILTER_LOW_PASS ? "Low Pass" :
+      filter_def.filter_type == DSP_FILTER_HIGH_PASS ? "High Pass" : "High Shelf", filter_def.frequency, filter_def.Q, filter_def.gain );
+
+    for( int precision : bench_precisions ) {
+      memset( &filter, 0, sizeof( filter ) );
+      dsp_get_biquad( &filter_def, filter.coeffs_d );
+      filter.precision = precision;
+      dsp_biquad_quantize( &filter );
+      dsp_biquad_reset( &filter );
+
+      x1 = x2 = y1 = y2 = 0;
+      err_sum = 0;
+      err_count = 0;
+
+      for( n = 0; n < BENCH_NOISE_SECONDS*DSP_SAMPLE_RATE; n += DSP_MAX_SAMPLES ) {
+
+        // Build the input block and the reference output
+        for( int i = 0; i < DSP_MAX_SAMPLES; ++ i ) {
+          double t = (double) ( n + i )/DSP_SAMPLE_RATE;
+          buffer[i] = (float) ( DSP_NOISE_REF_LEVEL*DSP_MAX_LEVEL*( sin( 2*M_PI*DSP_NOISE_REF_LOW_HZ*t ) + sin( 2*M_PI*DSP_NOISE_REF_HIGH_HZ*t ) ) );
+
+          long double x0 = buffer[i];
+          y0 = filter.coeffs_d[0]*x0 + filter.coeffs_d[1]*x1 + filter.coeffs_d[2]*x2 + filter.coeffs_d[3]*y1 + filter.coeffs_d[4]*y2;
+          x2 = x1;
+          x1 = x0;
+          y2 = y1;
+          y1 = y0;
+          reference[i] = (double) y0;
+        }
+
+        dsp_biquad_filter( buffer, DSP_MAX_SAMPLES, &filter );
+
+        for( int i = 0; i < DSP_MAX_SAMPLES; ++ i ) {
+          if( n + i >= BENCH_NOISE_SETTLE ) {
+            err_sum += ( buffer[i] - reference[i] )*( buffer[i] - reference[i] );
+            ++ err_count;
+          }
+        }
+      }
+
+      noise_dB[ precision ] = 10*log10( err_sum/err_count + 1e-30 ) - 20*log10( DSP_MAX_LEVEL );
+      printf( " %9.1f", noise_dB[ precision ] );
+    }
+
+    // Show the automatic selection and its estimated noise
+    int precision = dsp_select_precision( filter.coeffs_d, DSP_SAMPLE_RATE );
+    printf( " %6s %7.1f\n", bench_precision_name[ precision ], dsp_get_biquad_noise( filter.coeffs_d, precision, DSP_SAMPLE_RATE ) );
+
+    // Compare with the cheapest kernel that meets the target as measured
+    for( int cheapest : cost_order ) {
+      if( noise_dB[ cheapest ] <= DSP_NOISE_TARGET_DB || cheapest == PRC_TDF2 ) {
+        if( cheapest != precision ) {
+          printf( "E-BENCH: Selected %s, but %s is the cheapest kernel below %.1f dBFS\n", bench_precision_name[ precision ],
+            bench_precision_name[ cheapest ], (double) DSP_NOISE_TARGET_DB );
+          ++ wrong_count;
+        }
+        break;
+      }
+    }
+  }
+  printf( "\n" );
+
+  return( wrong_count == 0 ? ESP_OK : ESP_FAIL );
+}
+
+
+//------------------------------------------------------------------------------------
+// Switch each noise test filter between every pair of structures while it runs and
+// compare the output with the new structure running from the start. The converted
+// state must continue the output without a step: the difference after the switch
+// may not be larger than the difference of the two structures before it (their own
+// noise) by more than BENCH_SWITCH_MARGIN_DB.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_precision_switch( void ) {
+
+  static float  buffer[2][DSP_MAX_SAMPLES];
+  dsp_filter_t  filter[2];
+  double        diff;
+  double        diff_before;
+  double        diff_after;
+  double        excess_dB;
+  double        worst_dB;
+  double        worst_before_dB;
+  double        worst_after_dB;
+  int           fail_count;
+
+  fail_count = 0;
+
+  printf( "%-12s %8s %6s %6s %9s %9s   (largest difference to the new structure in dBFS)\n", "filter", "freq", "Q", "gain", "before", "switched" );
+
+  for( filter_def_t& filter_def : bench_noise_filters ) {
+    worst_dB = -1000;
+    worst_before_dB = worst_after_dB = 0;
+
+    for( int from : bench_precisions ) {
+      for( int to : bench_precisions ) {
+        if( from == to ) {
+          continue;
+        }
+
+        for( int k = 0; k < 2; ++ k ) {
+          memset( &filter[k], 0, sizeof( dsp_filter_t ) );
+          dsp_get_biquad( &filter_def, filter[k].coeffs_d );
+          filter[k].precision = ( k == 0 ) ? from : to;
+          dsp_biquad_quantize( &filter[k] );
+          dsp_biquad_reset( &filter[k] );
+        }
+
+        diff_before = diff_after = 0;
+
+        for( long n = 0; n < 2*BENCH_NOISE_SETTLE; n += DSP_MAX_SAMPLES ) {
+          if( n < BENCH_NOISE_SETTLE && n + DSP_MAX_SAMPLES >= BENCH_NOISE_SETTLE ) {
+            dsp_biquad_set_precision( &filter[0], to );
+          }
+
+          for( int i = 0; i < DSP_MAX_SAMPLES; ++ i ) {
+            double t = (double) ( n + i )/DSP_SAMPLE_RATE;
+            buffer[0][i] = (float) ( DSP_NOISE_REF_LEVEL*DSP_MAX_LEVEL*( sin( 2*M_PI*DSP_NOISE_REF_LOW_HZ*t ) + sin( 2*M_PI*DSP_NOISE_REF_HIGH_HZ*t ) ) );
+            buffer[1][i] = buffer[0][i];
+          }
+
+          dsp_biquad_filter( buffer[0], DSP_MAX_SAMPLES, &filter[0] );
+          dsp_biquad_filter( buffer[1], DSP_MAX_SAMPLES, &filter[1] );
+
+          for( int i = 0; n >= BENCH_NOISE_SETTLE/2 && i < DSP_MAX_SAMPLES; ++ i ) {
+            diff = fabs( buffer[0][i] - buffer[1][i] );
+            if( n + DSP_MAX_SAMPLES < BENCH_NOISE_SETTLE ) {
+              diff_before = std::max( diff_before, diff );
+            } else {
+              diff_after = std::max( diff_after, diff );
+            }
+          }
+        }
+
+        // Keep the pair with the largest step above the noise of the structures
+        diff_before = std::max( diff_before, DSP_MAX_LEVEL*pow( 10.0, BENCH_SWITCH_FLOOR_DB/20 ) );
+        excess_dB = 20*log10( ( diff_after + 1e-30 )/diff_before );
+        if( excess_dB > worst_dB ) {
+          worst_dB = excess_dB;
+          worst_before_dB = 20*log10( diff_before/DSP_MAX_LEVEL );
+          worst_after_dB = 20*log10( diff_after/DSP_MAX_LEVEL + 1e-30 );
+        }
+      }
+    }
+
+    printf( "%-12s %8.1f %6.2f %6.1f %9.1f %9.1f\n", filter_def.filter_type == DSP_FILTER_PEAK_EQ ? "Peak EQ" :
+      filter_def.filter_type == DSP_FILTER_LOW_PASS ? "Low Pass" :
+      filter_def.filter_type == DSP_FILTER_HIGH_PASS ? "High Pass" : "High Shelf", filter_def.frequency, filter_def.Q, filter_def.gain,
+      worst_before_dB, worst_after_dB );
+
+    if( worst_dB > BENCH_SWITCH_MARGIN_DB ) {
+      printf( "E-BENCH: Precision switch step %.1f dB above the structure noise\n", worst_dB );
+      ++ fail_count;
+    }
+  }
+  printf( "\n" );
+
+  return( fail_count == 0 ? ESP_OK : ESP_FAIL );
+}
+
+
+//------------------------------------------------------------------------------------
+// Run a +12 dB peak filter with the Q15 and Q31 kernels on a 1 kHz tone rising from
+// -60 to 0 dBFS, so the output goes 12 dB over full scale. The Q15 kernel switches
+// from its 32-bit to its 64-bit sum on the way up and may not wrap: apart from its
+// coarser coefficients it has to follow the Q31 output.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_q15_range( void ) {
+
+  static float  buffer[2][DSP_MAX_SAMPLES];
+  filter_def_t  filter_def = {0, DSP_FILTER_PEAK_EQ, 1000, 1.0, 12.0 };
+  dsp_filter_t  filter[2];
+  double        level;
+  double        diff;
+  double        output_max;
+
+  for( int k = 0; k < 2; ++ k ) {
+    memset( &filter[k], 0, sizeof( dsp_filter_t ) );
+    dsp_get_biquad( &filter_def, filter[k].coeffs_d );
+    filter[k].precision = ( k == 0 ) ? PRC_Q15 : PRC_Q31;
+    dsp_biquad_quantize( &filter[k] );
+    dsp_biquad_reset( &filter[k] );
+  }
+
+  diff = output_max = 0;
+
+  for( long n = 0; n < BENCH_NOISE_SECONDS*DSP_SAMPLE_RATE; n += DSP_MAX_SAMPLES ) {
+    for( int i = 0; i < DSP_MAX_SAMPLES; ++ i ) {
+      level = DSP_MAX_LEVEL*pow( 10.0, -3.0*( 1.0 - (double) ( n + i )/( BENCH_NOISE_SECONDS*DSP_SAMPLE_RATE ) ) );
+      buffer[0][i] = buffer[1][i] = (float) ( level*sin( 2*M_PI*1000.0*( n + i )/DSP_SAMPLE_RATE ) );
+    }
+
+    dsp_biquad_filter( buffer[0], DSP_MAX_SAMPLES, &filter[0] );
+    dsp_biquad_filter( buffer[1], DSP_MAX_SAMPLES, &filter[1] );
+
+    for( int i = 0; i < DSP_MAX_SAMPLES; ++ i ) {
+      diff = std::max( diff, (double) fabs( buffer[0][i] - buffer[1][i] ) );
+      output_max = std::max( output_max, (double) fabs( buffer[1][i] ) );
+    }
+  }
+
+  printf( "I-BENCH: Q15 up to %.1f dBFS output, largest difference to Q31 = %.1f dBFS\n\n", 20*log10( output_max/DSP_MAX_LEVEL ),
+    20*log10( diff/DSP_MAX_LEVEL + 1e-30 ) );
+
+  if( diff > DSP_MAX_LEVEL*pow( 10.0, BENCH_Q15_MAX_DIFF_DB/20 ) ) {
+    printf( "E-BENCH: Q15 output differs from Q31 by more than %.0f dBFS\n", BENCH_Q15_MAX_DIFF_DB );
+    return( ESP_FAIL );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Measure the cost of each filter transition mode while a transition is running.
+// The transition length is set so it does not finish during the measurement.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_transition( int block_size, int min_millis ) {
+
+  bool      clip_flag;
+  double    ns_per_sample;
+  double    ns_none;
+
+  printf( "%6s %8s %10s %12s %12s %14s\n", "block", "filters", "transition", "ns/sample", "ns/block", "extra/block" );
+
+  bench_fill_input( block_size );
+  dsp_set_kernel( DSP_KERNEL_DEFAULT );
+
+  for( int filter_count : bench_transition_filters ) {
+    ns_none = 0;
+
+    for( int transition : bench_transitions ) {
+      dsp_set_transition( transition, INT_MAX );
+
+      if( bench_load_filters( filter_count, PRC_FLT ) != ESP_OK ) {
+        printf( "E-BENCH: Unable to load %d filters\n", filter_count );
+        return( ESP_FAIL );
+      }
+
+      ns_per_sample = bench_run( block_size, min_millis );
+      if( transition == DSP_TRANSITION_NONE ) {
+        ns_none = ns_per_sample;
+      }
+
+      printf( "%6d %8d %10s %12.2f %12.0f %14.0f\n", block_size, filter_count, bench_transition_name[ transition ],
+        ns_per_sample, ns_per_sample*block_size, ( ns_per_sample - ns_none )*block_size );
+
+      // A block with the filters bypassed ends the transition
+      dsp_filter( DSP_Channels, bench_input, bench_output, block_size*DSP_NUM_CHANNELS*sizeof( sample_t ), false, &clip_flag );
+    }
+  }
+  printf( "\n" );
+
+  dsp_set_transition( DSP_TRANSITION_DEFAULT, DSP_TRANSITION_BLOCKS );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Check which block size presets the engine accepts for each filter count
+//------------------------------------------------------------------------------------
+static esp_err_t bench_block_size( void ) {
+
+  for( int filter_count : bench_transition_filters ) {
+    if( bench_load_filters( filter_count, PRC_FLT ) != ESP_OK ) {
+      printf( "E-BENCH: Unable to load %d filters\n", filter_count );
+      return( ESP_FAIL );
+    }
+
+    printf( "I-BENCH: %d filters per channel\n", filter_count );
+    for( int block_samples : bench_block_presets ) {
+      dsp_set_block_size( DSP_Channels, block_samples );
+    }
+  }
+  printf( "\n" );
+
+  dsp_set_block_size( DSP_Channels, DSP_BLOCK_SAMPLES );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Compare full rate and decimated processing of a subwoofer channel: a 120 Hz
+// -24 dB/octave low pass followed by peak filters between 20 and 200 Hz
+//------------------------------------------------------------------------------------
+static esp_err_t bench_multirate( int block_size, int min_millis ) {
+
+  int       num_defs;
+  int       latency;
+  double    ns_per_sample;
+  double    ns_full;
+
+  printf( "%6s %8s %10s %12s %12s %10s %12s\n", "block", "filters", "decimation", "ns/sample", "speedup", "latency", "latency ms" );
+
+  bench_fill_input( block_size );
+  dsp_set_kernel( DSP_KERNEL_DEFAULT );
+
+  for( int filter_count : bench_transition_filters ) {
+    num_defs = 0;
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      for( int i = 0; i < filter_count; ++ i ) {
+        bench_filters[num_defs].channel = channel_id;
+        if( i < 2 ) {
+          bench_filters[num_defs].filter_type = DSP_FILTER_LOW_PASS;
+          bench_filters[num_defs].frequency = 120.0;
+          bench_filters[num_defs].Q = 0.7;
+          bench_filters[num_defs].gain = 0.0;
+        } else {
+          bench_filters[num_defs].filter_type = DSP_FILTER_PEAK_EQ;
+          bench_filters[num_defs].frequency = 20.0*pow( 10.0, ( i - 2 )/(double) ( filter_count - 2 ) );
+          bench_filters[num_defs].Q = 4.0;
+          bench_filters[num_defs].gain = ( i & 1 ) ? -3.0 : 3.0;
+        }
+        ++ num_defs;
+      }
+    }
+
+    ns_full = 0;
+
+    for( int decimation : bench_decimations ) {
+      for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+        dsp_set_decimation( &DSP_Channels[channel_id], decimation );
+      }
+
+      if( dsp_update_filters( bench_filters, num_defs ) != ESP_OK ) {
+        printf( "E-BENCH: Unable to load %d filters\n", filter_count );
+        return( ESP_FAIL );
+      }
+
+      ns_per_sample = bench_run( block_size, min_millis );
+      if( decimation == 1 ) {
+        ns_full = ns_per_sample;
+      }
+
+      latency = dsp_multirate_latency( &DSP_Channels[0].data->multirate );
+      printf( "%6d %8d %10d %12.2f %11.1fx %10d %12.2f\n", block_size, filter_count, decimation, ns_per_sample,
+        ns_full/ns_per_sample, latency, latency*1000.0/DSP_SAMPLE_RATE );
+    }
+  }
+  printf( "\n" );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_set_decimation( &DSP_Channels[channel_id], 1 );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Send an impulse through dsp_filter at each decimation factor and compare where it
+// peaks on the output with the processing latency reported for the channel plus
+// its delay
+//------------------------------------------------------------------------------------
+static esp_err_t bench_latency( int block_size ) {
+
+  bool      clip_flag;
+  int       buffer_len;
+  int       latency;
+  int       expected;
+  int       peak;
+  double    peak_level;
+  double    level;
+
+  printf( "%10s %10s %10s %10s\n", "decimation", "reported", "expected", "measured" );
+
+  buffer_len = block_size*DSP_NUM_CHANNELS*sizeof( sample_t );
+
+  for( int decimation : bench_decimations ) {
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      dsp_set_decimation( &DSP_Channels[channel_id], decimation );
+    }
+    if( bench_load_filters( 0, PRC_FLT ) != ESP_OK ) {
+      return( ESP_FAIL );
+    }
+
+    // Swap in the filters and finish any transition
+    memset( bench_input, 0, buffer_len );
+    for( int n = 0; n < DSP_SAMPLE_RATE; n += block_size ) {
+      dsp_filter( DSP_Channels, bench_input, bench_output, buffer_len, true, &clip_flag );
+    }
+    dsp_resync( DSP_Channels );
+
+    latency = dsp_graph_latency( DSP_Channels[0].data, block_size, NULL );
+    expected = latency + (int) lround( dsp_delay_samples( DSP_Channels[0].data ) );
+    peak = -1;
+    peak_level = 0;
+
+    for( int n = 0; n < 4*( expected + block_size ); n += block_size ) {
+      memset( bench_input, 0, buffer_len );
+      if( n == 0 ) {
+        bench_input[0] = ( (sample_t) ( DSP_MAX_LEVEL/4 ) ) << SAMPLE_NULL_BITS;
+      }
+      dsp_filter( DSP_Channels, bench_input, bench_output, buffer_len, true, &clip_flag );
+
+      for( int i = 0; i < block_size; ++ i ) {
+        level = fabs( (double) ( bench_output[i*DSP_NUM_CHANNELS] >> SAMPLE_NULL_BITS ) );
+        if( level > peak_level ) {
+          peak_level = level;
+          peak = n + i;
+        }
+      }
+    }
+
+    printf( "%10d %10d %10d %10d\n", decimation, latency, expected, peak );
+
+    // The decimated impulse response can peak a sample off its centre
+    if( abs( peak - expected ) > ( ( decimation > 1 ) ? 1 : 0 ) ) {
+      printf( "E-BENCH: Impulse peaks at sample %d, the reported latency is %d samples\n", peak, expected );
+      return( ESP_FAIL );
+    }
+  }
+  printf( "\n" );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_set_decimation( &DSP_Channels[channel_id], 1 );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Direct form FIR of one block for comparison with the partitioned convolution
+//------------------------------------------------------------------------------------
+static void bench_fir_direct( float* taps, int tap_count, int* offset, float* input, float* output, int sample_count ) {
+
+  float     sum;
+
+  for( int i = 0; i < sample_count; ++ i ) {
+    // Store each sample twice, so the newest taps are always contiguous
+    *offset = ( *offset == 0 ) ? tap_count - 1 : *offset - 1;
+    bench_fir_hist[*offset] = input[i];
+    bench_fir_hist[*offset + tap_count] = input[i];
+
+    sum = 0;
+    for( int k = 0; k < tap_count; ++ k ) {
+      sum += taps[k]*bench_fir_hist[*offset + k];
+    }
+    output[i] = sum;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Compare the partitioned FFT convolution with a direct form FIR for one channel
+//------------------------------------------------------------------------------------
+static esp_err_t bench_fir_convolution( int block_size, int min_millis ) {
+
+  dsp_fir_t*  fir;
+  int         offset;
+  int         latency;
+  int         check_blocks;
+  int         crossover;
+  long        blocks;
+  double      ns_direct;
+  double      ns_fft;
+  double      max_error;
+
+  printf( "%6s %8s %12s %12s %10s %12s\n", "block", "taps", "direct ns", "fft ns", "speedup", "max error" );
+
+  crossover = 0;
+
+  for( int tap_count : bench_fir_taps ) {
+    // Decaying noise as a room correction like impulse response
+    srand( tap_count );
+    for( int i = 0; i < tap_count; ++ i ) {
+      bench_fir[i] = ( (double) rand()/RAND_MAX - 0.5 )*exp( -4.0*i/tap_count );
+    }
+
+    fir = dsp_fir_create( bench_fir, tap_count );
+    if( fir == NULL ) {
+      return( ESP_FAIL );
+    }
+
+    // Check the result against the direct form, allowing for the FIR latency
+    offset = 0;
+    memset( bench_fir_hist, 0, sizeof( bench_fir_hist ) );
+    latency = dsp_fir_latency( block_size );
+    check_blocks = ( 2*tap_count + latency )/block_size + 8;
+    max_error = 0;
+
+    for( int block = 0; block < check_blocks; ++ block ) {
+      for( int i = 0; i < block_size; ++ i ) {
+        bench_fir_in[i] = (double) rand()/RAND_MAX - 0.5;
+        bench_fir_out[i] = bench_fir_in[i];
+      }
+
+      bench_fir_direct( bench_fir, tap_count, &offset, bench_fir_in, &bench_fir_ref[block*block_size], block_size );
+      dsp_fir_process( fir, bench_fir_out, block_size );
+
+      for( int i = 0; i < block_size; ++ i ) {
+        if( block*block_size + i >= latency ) {
+          max_error = fmax( max_error, fabs( bench_fir_out[i] - bench_fir_ref[block*block_size + i - latency] ) );
+        }
+      }
+    }
+
+    // Time both, one channel per sample period
+    for( int i = 0; i < BENCH_WARMUP_BLOCKS; ++ i ) {
+      bench_fir_direct( bench_fir, tap_count, &offset, bench_fir_in, bench_fir_ref, block_size );
+      dsp_fir_process( fir, bench_fir_out, block_size );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    blocks = 0;
+    do {
+      bench_fir_direct( bench_fir, tap_count, &offset, bench_fir_in, bench_fir_ref, block_size );
+      ++ blocks;
+      ns_direct = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+    } while( ns_direct < min_millis*1e6 );
+    ns_direct /= (double) blocks*block_size;
+
+    start = std::chrono::steady_clock::now();
+    blocks = 0;
+    do {
+      // Filter fresh input each block, repeated filtering in place decays to denormals
+      memcpy( bench_fir_out, bench_fir_in, block_size*sizeof( float ) );
+      dsp_fir_process( fir, bench_fir_out, block_size );
+      ++ blocks;
+      ns_fft = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+    } while( ns_fft < min_millis*1e6 );
+    ns_fft /= (double) blocks*block_size;
+
+    if( crossover == 0 && ns_fft < ns_direct ) {
+      crossover = tap_count;
+    }
+
+    printf( "%6d %8d %12.2f %12.2f %9.1fx %12.2e\n", block_size, tap_count, ns_direct, ns_fft, ns_direct/ns_fft, max_error );
+
+    dsp_fir_free( fir );
+  }
+
+  if( crossover > 0 ) {
+    printf( "I-BENCH: Partitioned convolution is faster from %d taps\n\n", crossover );
+  } else {
+    printf( "I-BENCH: Direct form is faster for all tap counts\n\n" );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Time the symmetric crossover kernel against the direct form FIR and the
+// partitioned convolution, and check that low and high pass sum to a pure delay
+//------------------------------------------------------------------------------------
+static esp_err_t bench_crossover( int block_size, int min_millis ) {
+
+  crossover_def_t   defs[2];
+  dsp_crossover_t*  low;
+  dsp_crossover_t*  high;
+  dsp_fir_t*        fir;
+  int               taps;
+  int               offset;
+  long              blocks;
+  double            ns_sym;
+  double            ns_direct;
+  double            ns_fft;
+  double            sum;
+  double            max_error;
+
+  printf( "%6s %8s %6s %6s %10s %10s %10s %10s %12s\n", "block", "freq", "slope", "taps", "latency ms", "sym ns", "direct ns", "fft ns", "sum error" );
+
+  for( float frequency : bench_xo_freqs ) {
+    for( int slope : bench_xo_slopes ) {
+      defs[0] = { 0, DSP_CROSSOVER_LOW_PASS, frequency, 0, slope };
+      defs[1] = { 1, DSP_CROSSOVER_HIGH_PASS, frequency, 0, slope };
+
+      taps = dsp_crossover_taps( frequency, slope );
+      if( taps > DSP_XO_MAX_TAPS ) {
+        printf( "%6d %8.0f %6d %6d %10s\n", block_size, frequency, slope, taps, "too long" );
+        continue;
+      }
+
+      low = dsp_crossover_create( &defs[0] );
+      high = dsp_crossover_create( &defs[1] );
+      if( low == NULL || high == NULL ) {
+        return( ESP_FAIL );
+      }
+
+      // Impulse responses of both sections must add up to an impulse at the centre
+      max_error = 0;
+      for( int i = 0; i < taps; ++ i ) {
+        sum = low->coeffs[ ( i <= taps/2 ) ? i : taps - 1 - i ] + high->coeffs[ ( i <= taps/2 ) ? i : taps - 1 - i ];
+        max_error = fmax( max_error, fabs( sum - ( ( i == taps/2 ) ? 1.0 : 0.0 ) ) );
+      }
+
+      // The same filter as a full coefficient set for the other kernels
+      for( int i = 0; i < taps; ++ i ) {
+        bench_fir[i] = low->coeffs[ ( i <= taps/2 ) ? i : taps - 1 - i ];
+      }
+      fir = dsp_fir_create( bench_fir, taps );
+      if( fir == NULL ) {
+        return( ESP_FAIL );
+      }
+
+      for( int i = 0; i < block_size; ++ i ) {
+        bench_fir_in[i] = (double) rand()/RAND_MAX - 0.5;
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      blocks = 0;
+      do {
+        memcpy( bench_fir_out, bench_fir_in, block_size*sizeof( float ) );
+        dsp_crossover_process( low, bench_fir_out, block_size );
+        ++ blocks;
+        ns_sym = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+      } while( ns_sym < min_millis*1e6 );
+      ns_sym /= (double) blocks*block_size;
+
+      offset = 0;
+      start = std::chrono::steady_clock::now();
+      blocks = 0;
+      do {
+        bench_fir_direct( bench_fir, taps, &offset, bench_fir_in, bench_fir_out, block_size );
+        ++ blocks;
+        ns_direct = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+      } while( ns_direct < min_millis*1e6 );
+      ns_direct /= (double) blocks*block_size;
+
+      start = std::chrono::steady_clock::now();
+      blocks = 0;
+      do {
+        memcpy( bench_fir_out, bench_fir_in, block_size*sizeof( float ) );
+        dsp_fir_process( fir, bench_fir_out, block_size );
+        ++ blocks;
+        ns_fft = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+      } while( ns_fft < min_millis*1e6 );
+      ns_fft /= (double) blocks*block_size;
+
+      printf( "%6d %8.0f %6d %6d %10.2f %10.2f %10.2f %10.2f %12.2e\n", block_size, frequency, slope, taps,
+        dsp_crossover_latency( low )*1000.0/DSP_SAMPLE_RATE, ns_sym, ns_direct, ns_fft, max_error );
+
+      dsp_crossover_free( low );
+      dsp_crossover_free( high );
+      dsp_fir_free( fir );
+    }
+  }
+  printf( "\n" );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Measure the gain and delay error of the fractional delay for a set of sine
+// frequencies, and the cost of a fractional delay in the input stage
+//------------------------------------------------------------------------------------
+static esp_err_t bench_delay( int block_size, int min_millis ) {
+
+  dsp_fraction_t    fraction;
+  dsp_data_t*       dsp_data;
+  double            w;
+  double            a;
+  double            b;
+  double            y;
+  double            delay;
+  double            gain_dB;
+  double            error_us;
+  double            ns_whole;
+  double            ns_fraction;
+
+  dsp_data = DSP_Channels[0].data;
+
+  printf( "%8s %8s %10s %12s\n", "fraction", "freq", "gain dB", "error us" );
+
+  for( float frac : bench_fractions ) {
+    if( dsp_set_delay( &DSP_Channels[0], 1000.0*( 1 + frac )/DSP_SAMPLE_RATE ) != ESP_OK ) {
+      return( ESP_FAIL );
+    }
+    fraction = dsp_data->fraction;
+
+    for( float frequency : bench_delay_freqs ) {
+      w = 2*M_PI*frequency/DSP_SAMPLE_RATE;
+      fraction.x1 = 0;
+      fraction.y1 = 0;
+
+      for( int n = 0; n < BENCH_DELAY_CHECK; ++ n ) {
+        bench_delay_buff[n] = sin( w*n );
+      }
+      dsp_fraction_process( &fraction, bench_delay_buff, BENCH_DELAY_CHECK );
+
+      // Correlate the output with a sine and cosine to find its gain and phase
+      a = b = 0;
+      for( int n = 0; n < BENCH_DELAY_CHECK; ++ n ) {
+        y = bench_delay_buff[n];
+        if( n >= BENCH_DELAY_SETTLE ) {
+          a += y*sin( w*n );
+          b += y*cos( w*n );
+        }
+      }
+
+      // The all-pass delays by the fraction, plus one sample below one half
+      delay = ( frac < 0.5 ) ? 1 + frac : frac;
+      gain_dB = 20*log10( 2*sqrt( a*a + b*b )/( BENCH_DELAY_CHECK - BENCH_DELAY_SETTLE ) );
+      error_us = remainder( atan2( -b, a ) - w*delay, 2*M_PI )/w*1e6/DSP_SAMPLE_RATE;
+
+      printf( "%8.2f %8.0f %10.3f %12.2f\n", frac, frequency, gain_dB, error_us );
+    }
+  }
+  printf( "\n" );
+
+  // After a resync the delay line outputs silence for the delay, then the new input,
+  // and nothing stored before the resync
+  if( dsp_set_delay( &DSP_Channels[0], 1000.0*100/DSP_SAMPLE_RATE ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
+
+  for( int n = 0; n < BENCH_DELAY_CHECK; n += block_size ) {
+    std::fill( bench_delay_buff, bench_delay_buff + block_size, 1.0f );
+    dsp_delay_process( dsp_data, bench_delay_buff, block_size );
+  }
+  dsp_delay_resync( dsp_data );
+
+  for( int n = 0; n + block_size <= BENCH_DELAY_CHECK; n += block_size ) {
+    for( int i = 0; i < block_size; ++ i ) {
+      bench_delay_buff[i] = n + i + 2;
+    }
+    dsp_delay_process( dsp_data, bench_delay_buff, block_size );
+
+    for( int i = 0; i < block_size; ++ i ) {
+      if( bench_delay_buff[i] != ( ( n + i >= dsp_data->delay_samples ) ? n + i + 2 - dsp_data->delay_samples : 0 ) ) {
+        printf( "E-BENCH: Delay line output %.0f at sample %d after a resync\n", bench_delay_buff[i], n + i );
+        return( ESP_FAIL );
+      }
+    }
+  }
+  printf( "I-BENCH: Delay line restarts from silence after a resync (%d samples)\n\n", dsp_data->delay_samples );
+
+  // Cost of the fraction in the input stage, no filters loaded
+  if( bench_load_filters( 0, PRC_FLT ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
+  bench_fill_input( block_size );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_set_delay( &DSP_Channels[channel_id], 2.0 );
+  }
+  ns_whole = bench_run( block_size, min_millis );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_set_delay( &DSP_Channels[channel_id], 2.01 );
+  }
+  ns_fraction = bench_run( block_size, min_millis );
+
+  printf( "I-BENCH: Delay of 2.00 ms = %.2f ns/sample, 2.01 ms = %.2f ns/sample (block %d, all channels)\n\n", ns_whole, ns_fraction, block_size );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_set_delay( &DSP_Channels[channel_id], DSP_Channels[channel_id].delay_millis );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Run the shared processing check: the channels start with the same filters, then
+// the last channel gets different filters, then the same filters again, and then a
+// filter of the first channel is edited. Records the output of every block.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_share_run( int block_size, int filter_count, sample_t* output ) {
+
+  filter_def_t  edit_def;
+  bool          clip_flag;
+  int           buffer_len;
+  int           num_defs;
+
+  buffer_len = block_size*DSP_NUM_CHANNELS*sizeof( sample_t );
+  num_defs = filter_count*DSP_NUM_CHANNELS;
+
+  if( bench_load_filters( filter_count, PRC_FLT ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
+
+  // Let the bank take over before the run starts from silence
+  for( int i = 0; i < BENCH_WARMUP_BLOCKS; ++ i ) {
+    dsp_filter( DSP_Channels, bench_input, output, buffer_len, true, &clip_flag );
+  }
+  dsp_resync( DSP_Channels );
+
+  memcpy( bench_share_filters, bench_filters, num_defs*sizeof( filter_def_t ) );
+  for( int i = 0; i < num_defs; ++ i ) {
+    if( bench_share_filters[i].channel == DSP_NUM_CHANNELS - 1 ) {
+      bench_share_filters[i].gain = -bench_share_filters[i].gain;
+    }
+  }
+  edit_def = bench_filters[0];
+  edit_def.gain += 2.0;
+
+  for( int step = 0; step < BENCH_SHARE_STEPS; ++ step ) {
+    if( ( step == 1 && dsp_update_filters( bench_share_filters, num_defs ) != ESP_OK ) ||
+        ( step == 2 && dsp_update_filters( bench_filters, num_defs ) != ESP_OK ) ||
+        ( step == 3 && dsp_edit_filter( 0, 0, &edit_def ) != ESP_OK ) ) {
+      printf( "E-BENCH: Unable to change the filters in step %d\n", step );
+      return( ESP_FAIL );
+    }
+
+    for( int i = 0; i < BENCH_SHARE_BLOCKS; ++ i ) {
+      dsp_filter( DSP_Channels, bench_input, output, buffer_len, true, &clip_flag );
+      output += block_size*DSP_NUM_CHANNELS;
+    }
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Compare a mono subwoofer setup (all channels mixing the same input through the
+// same filters) processed once and copied with every channel processed separately,
+// plain, decimated, with a crossover and with a FIR. The output has to be the same
+// while the filters of one channel change and return.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_share( int block_size, int min_millis ) {
+
+  static crossover_def_t  xo_def = { DSP_ALL_CHANNELS, DSP_CROSSOVER_LOW_PASS, 0, 0, 24 };
+  float             mix_gain[DSP_NUM_CHANNELS][DSP_NUM_CHANNELS];
+  dsp_data_t*       dsp_data;
+  int               decimation;
+  int               tap_count;
+  int               differences;
+  double            ns_separate;
+  double            ns_shared;
+
+  printf( "%6s %8s %10s %8s %8s %12s %12s %10s %12s\n", "block", "filters", "decimation", "xo Hz", "fir taps",
+    "separate ns", "shared ns", "speedup", "differences" );
+
+  bench_fill_input( block_size );
+  dsp_set_kernel( DSP_KERNEL_DEFAULT );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    memcpy( mix_gain[channel_id], DSP_Channels[channel_id].data->mix_gain, sizeof( mix_gain[channel_id] ) );
+    for( int i = 0; i < DSP_NUM_CHANNELS; ++ i ) {
+      DSP_Channels[channel_id].data->mix_gain[i] = 1.0f/DSP_NUM_CHANNELS;
+    }
+  }
+
+  for( int config = 0; config < (int) ( sizeof( bench_share_decimations )/sizeof( int ) ); ++ config ) {
+    decimation = bench_share_decimations[config];
+    xo_def.frequency = bench_share_xo_freqs[config];
+    tap_count = bench_share_fir_taps[config];
+
+    srand( tap_count );
+    for( int i = 0; i < tap_count; ++ i ) {
+      bench_fir[i] = ( (double) rand()/RAND_MAX - 0.5 )*exp( -4.0*i/tap_count );
+    }
+
+    // The first channel creates the coefficients, the others share them
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      dsp_data = DSP_Channels[channel_id].data;
+      dsp_set_decimation( &DSP_Channels[channel_id], decimation );
+
+      if( xo_def.frequency > 0 ) {
+        dsp_data->crossover = ( channel_id == 0 ) ? dsp_crossover_create( &xo_def ) : dsp_crossover_share( DSP_Channels[0].data->crossover );
+      }
+      if( tap_count > 0 ) {
+        dsp_data->fir = ( channel_id == 0 ) ? dsp_fir_create( bench_fir, tap_count ) : dsp_fir_share( DSP_Channels[0].data->fir );
+      }
+    }
+
+    for( int filter_count : bench_transition_filters ) {
+      // Keep the peak filters inside the band of the decimated channels
+      if( BENCH_PEAK_BASE_FREQ*pow( 2.0, ( filter_count - 1 )*0.45 ) > DSP_SAMPLE_RATE/4/decimation ) {
+        continue;
+      }
+
+      // Reference with the sharing switched off
+      dsp_share_channels( DSP_Channels );
+      for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+        DSP_Channels[channel_id].data->share_input = -1;
+      }
+
+      if( bench_share_run( block_size, filter_count, bench_share_out[0] ) != ESP_OK ) {
+        return( ESP_FAIL );
+      }
+      bench_load_filters( filter_count, PRC_FLT );
+      ns_separate = bench_run( block_size, min_millis );
+
+      dsp_share_channels( DSP_Channels );
+      if( bench_share_run( block_size, filter_count, bench_share_out[1] ) != ESP_OK ) {
+        return( ESP_FAIL );
+      }
+      bench_load_filters( filter_count, PRC_FLT );
+      ns_shared = bench_run( block_size, min_millis );
+
+      differences = 0;
+      for( int i = 0; i < BENCH_SHARE_STEPS*BENCH_SHARE_BLOCKS*block_size*DSP_NUM_CHANNELS; ++ i ) {
+        differences += ( bench_share_out[0][i] != bench_share_out[1][i] );
+      }
+
+      printf( "%6d %8d %10d %8.0f %8d %12.2f %12.2f %9.2fx %12d\n", block_size, filter_count, decimation, xo_def.frequency, tap_count,
+        ns_separate, ns_shared, ns_separate/ns_shared, differences );
+
+      if( differences != 0 ) {
+        printf( "E-BENCH: Shared processing differs in %d samples\n", differences );
+        return( ESP_FAIL );
+      }
+    }
+
+    for( int channel_id = DSP_NUM_CHANNELS - 1; channel_id >= 0; -- channel_id ) {
+      dsp_data = DSP_Channels[channel_id].data;
+      dsp_crossover_free( dsp_data->crossover );
+      dsp_fir_free( dsp_data->fir );
+      dsp_data->crossover = NULL;
+      dsp_data->fir = NULL;
+    }
+  }
+  printf( "\n" );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    memcpy( DSP_Channels[channel_id].data->mix_gain, mix_gain[channel_id], sizeof( mix_gain[channel_id] ) );
+    dsp_set_decimation( &DSP_Channels[channel_id], 1 );
+  }
+  dsp_share_channels( DSP_Channels );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Check that processing a block in place gives the same output as separate input
+// and output buffers, as the firmware reads, processes and writes one buffer. Both
+// are run with the channels taking their own inputs, which are deinterleaved straight
+// into the channel buffers, and with the first channel mixing all inputs. Reports
+// the passes over the block and the bytes they move outside the steps, plus the copy
+// of the input the firmware gets from i2s_read().
+//------------------------------------------------------------------------------------
+static esp_err_t bench_in_place( int block_size, int min_millis ) {
+
+  static sample_t   in_place[DSP_MAX_SAMPLES*DSP_NUM_CHANNELS];
+  float             mix_gain[DSP_NUM_CHANNELS];
+  bool              clip_flag;
+  int               buffer_len;
+  int               mismatches;
+  int               passes;
+  int               bytes_moved;
+  long              blocks;
+  double            elapsed_ns;
+  double            runs[2][BENCH_REPEATS];
+
+  if( bench_load_filters( 10, PRC_FLT ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
+  bench_fill_input( block_size );
+  buffer_len = block_size*DSP_NUM_CHANNELS*sizeof( sample_t );
+  memcpy( mix_gain, DSP_Channels[0].data->mix_gain, sizeof( mix_gain ) );
+
+  // Let the new filter bank take over before the runs start from the same state
+  for( int i = 0; i < BENCH_WARMUP_BLOCKS; ++ i ) {
+    dsp_filter( DSP_Channels, bench_input, bench_output, buffer_len, true, &clip_flag );
+  }
+
+  for( int mixed = 0; mixed < 2; ++ mixed ) {
+    for( int i = 0; i < DSP_NUM_CHANNELS; ++ i ) {
+      DSP_Channels[0].data->mix_gain[i] = mixed ? 1.0f/DSP_NUM_CHANNELS : mix_gain[i];
+    }
+    dsp_share_channels( DSP_Channels );
+    passes = dsp_block_passes( DSP_Channels, block_size, &bytes_moved );
+
+    dsp_resync( DSP_Channels );
+    dsp_filter( DSP_Channels, bench_input, bench_output, buffer_len, true, &clip_flag );
+
+    dsp_resync( DSP_Channels );
+    memcpy( in_place, bench_input, buffer_len );
+    dsp_filter( DSP_Channels, in_place, in_place, buffer_len, true, &clip_flag );
+
+    mismatches = 0;
+    for( int i = 0; i < block_size*DSP_NUM_CHANNELS; ++ i ) {
+      mismatches += ( in_place[i] != bench_output[i] );
+    }
+
+    if( mismatches != 0 ) {
+      printf( "E-BENCH: In place processing differs in %d samples\n", mismatches );
+      return( ESP_FAIL );
+    }
+
+    // Time both with a fresh copy of the input, as the firmware gets it from i2s_read().
+    // The two modes take turns, so neither gets all of a slow period of the host.
+    for( int run = 0; run < BENCH_REPEATS; ++ run ) {
+      for( int pass = 0; pass < 2; ++ pass ) {
+        auto start = std::chrono::steady_clock::now();
+        blocks = 0;
+        elapsed_ns = 0;
+
+        while( elapsed_ns < min_millis*1e6/( 4*BENCH_REPEATS ) ) {
+          for( int i = 0; i < 256; ++ i ) {
+            memcpy( in_place, bench_input, buffer_len );
+            dsp_filter( DSP_Channels, in_place, ( pass == 0 ) ? bench_output : in_place, buffer_len, true, &clip_flag );
+          }
+          blocks += 256;
+          elapsed_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+        }
+        runs[pass][run] = elapsed_ns/( (double) blocks*block_size );
+      }
+    }
+
+    std::sort( runs[0], runs[0] + BENCH_REPEATS );
+    std::sort( runs[1], runs[1] + BENCH_REPEATS );
+
+    printf( "I-BENCH: Block %d %s input: %d passes moving %d bytes + input copy %d bytes, in place = %.2f ns/sample, separate buffers = %.2f ns/sample, block buffers %d -> %d bytes\n",
+      block_size, mixed ? "mixed" : "direct", passes, bytes_moved, 2*buffer_len, runs[1][BENCH_REPEATS/2], runs[0][BENCH_REPEATS/2], 2*buffer_len, buffer_len );
+  }
+  printf( "\n" );
+
+  memcpy( DSP_Channels[0].data->mix_gain, mix_gain, sizeof( mix_gain ) );
+  dsp_share_channels( DSP_Channels );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Check the look-ahead limiter on 1 kHz bursts 12 dB above its ceiling: no output
+// sample may exceed the ceiling, and a signal below the ceiling has to pass
+// unchanged apart from the look-ahead delay. Also measures the cost per sample.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_limiter( int block_size, int min_millis ) {
+
+  dsp_limiter_t*    limiter;
+  double            ceiling;
+  double            amplitude;
+  float             max_level;
+  float             min_gain;
+  float             output_max;
+  int               lookahead;
+  int               mismatches;
+  long              blocks;
+  double            elapsed_ns;
+
+  limiter = &DSP_Channels[0].data->limiter;
+
+  printf( "%8s %8s %10s %12s %14s %12s %12s\n", "ceiling", "attack", "release", "output dBFS", "reduction dB", "differences", "ns/sample" );
+
+  for( const limiter_def_t& limiter_def : bench_limiters ) {
+    if( dsp_limiter_set( &DSP_Channels[0], &limiter_def ) != ESP_OK ) {
+      return( ESP_FAIL );
+    }
+    ceiling = DSP_MAX_LEVEL*exp10( limiter_def.ceiling_dB/20.0 );
+    lookahead = dsp_limiter_latency( limiter );
+
+    // Loud and quiet bursts
+    for( int n = 0; n < BENCH_LIMIT_CHECK; ++ n ) {
+      amplitude = ( ( n/BENCH_LIMIT_BURST ) & 1 ) ? 0.1 : 4.0;
+      bench_limit_in[n] = amplitude*ceiling*sin( 2*M_PI*1000.0*n/DSP_SAMPLE_RATE );
+    }
+
+    memcpy( bench_limit_out, bench_limit_in, sizeof( bench_limit_out ) );
+    output_max = 0;
+    min_gain = 1.0f;
+    for( int n = 0; n < BENCH_LIMIT_CHECK; n += block_size ) {
+      min_gain = fminf( min_gain, dsp_limiter_process( limiter, &bench_limit_out[n], ( n + block_size <= BENCH_LIMIT_CHECK ) ? block_size : BENCH_LIMIT_CHECK - n, 1.0f, &max_level ) );
+      output_max = fmaxf( output_max, max_level );
+    }
+
+    if( output_max > ceiling ) {
+      printf( "E-BENCH: Limiter output %.1f exceeds the ceiling %.1f\n", output_max, ceiling );
+      return( ESP_FAIL );
+    }
+
+    // A signal below the ceiling
+    dsp_limiter_reset( limiter );
+    for( int n = 0; n < BENCH_LIMIT_CHECK; ++ n ) {
+      bench_limit_in[n] = 0.99*ceiling*sin( 2*M_PI*1000.0*n/DSP_SAMPLE_RATE );
+    }
+    memcpy( bench_limit_out, bench_limit_in, sizeof( bench_limit_out ) );
+    for( int n = 0; n < BENCH_LIMIT_CHECK; n += block_size ) {
+      dsp_limiter_process( limiter, &bench_limit_out[n], ( n + block_size <= BENCH_LIMIT_CHECK ) ? block_size : BENCH_LIMIT_CHECK - n, 1.0f, &max_level );
+    }
+
+    mismatches = 0;
+    for( int n = lookahead; n < BENCH_LIMIT_CHECK; ++ n ) {
+      mismatches += ( bench_limit_out[n] != bench_limit_in[n - lookahead] );
+    }
+
+    // Cost, limiting the bursts
+    auto start = std::chrono::steady_clock::now();
+    blocks = 0;
+    elapsed_ns = 0;
+    while( elapsed_ns < min_millis*1e6 ) {
+      for( int i = 0; i < 256; ++ i ) {
+        dsp_limiter_process( limiter, &bench_limit_out[( i*block_size ) % ( BENCH_LIMIT_CHECK - block_size )], block_size, 4.0f, &max_level );
+      }
+      blocks += 256;
+      elapsed_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    printf( "%8.1f %8.1f %10.0f %12.2f %14.2f %12d %12.2f\n", limiter_def.ceiling_dB, limiter_def.attack_millis, limiter_def.release_millis,
+      20*log10( output_max/DSP_MAX_LEVEL ), -20*log10( min_gain ), mismatches, elapsed_ns/( (double) blocks*block_size ) );
+
+    if( mismatches != 0 ) {
+      printf( "E-BENCH: Limiter changes a signal below its ceiling in %d samples\n", mismatches );
+      return( ESP_FAIL );
+    }
+  }
+  printf( "\n" );
+
+  if( dsp_limiter_set( &DSP_Channels[0], NULL ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Dither a -60 dBFS sine and measure the cost and the added noise, in total and below
+// BENCH_DITHER_FREQ where noise shaping lowers it. Every output must be on the grid
+// of the DITHER_RANGE_DB steps.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_dither( int block_size, int min_millis ) {
+
+  dsp_dither_t      dither;
+  dsp_filter_t      band[2];
+  filter_def_t      band_def = { 0, DSP_FILTER_LOW_PASS, BENCH_DITHER_FREQ, 0.707, 0.0 };
+  double            noise_sum;
+  double            band_sum;
+  double            error;
+  double            step;
+  int               off_grid;
+  long              blocks;
+  double            elapsed_ns;
+
+  step = 1 << DITHER_BITS;
+
+  for( int n = 0; n < BENCH_LIMIT_CHECK; ++ n ) {
+    bench_limit_in[n] = 0.001*DSP_MAX_LEVEL*sin( 2*M_PI*1000.0*n/DSP_SAMPLE_RATE );
+  }
+
+  dsp_dither_init( &dither, 0 );
+  memcpy( bench_limit_out, bench_limit_in, sizeof( bench_limit_out ) );
+  for( int n = 0; n < BENCH_LIMIT_CHECK; n += block_size ) {
+    dsp_dither_process( &dither, &bench_limit_out[n], ( n + block_size <= BENCH_LIMIT_CHECK ) ? block_size : BENCH_LIMIT_CHECK - n );
+  }
+
+  // Added noise in total and through a 24 dB/octave low pass
+  off_grid = 0;
+  noise_sum = 0;
+  for( int n = 0; n < BENCH_LIMIT_CHECK; ++ n ) {
+    off_grid += ( bench_limit_out[n] != step*floor( bench_limit_out[n]/step ) );
+    error = bench_limit_out[n] - bench_limit_in[n];
+    noise_sum += error*error;
+    bench_limit_out[n] = error;
+  }
+
+  for( dsp_filter_t& filter : band ) {
+    memset( &filter, 0, sizeof( filter ) );
+    dsp_get_biquad( &band_def, filter.coeffs_d );
+    filter.precision = PRC_DBL;
+    dsp_biquad_quantize( &filter );
+    dsp_biquad_filter( bench_limit_out, BENCH_LIMIT_CHECK, &filter );
+  }
+
+  band_sum = 0;
+  for( int n = BENCH_DELAY_SETTLE; n < BENCH_LIMIT_CHECK; ++ n ) {
+    band_sum += bench_limit_out[n]*bench_limit_out[n];
+  }
+
+  // Cost
+  auto start = std::chrono::steady_clock::now();
+  blocks = 0;
+  elapsed_ns = 0;
+  while( elapsed_ns < min_millis*1e6 ) {
+    for( int i = 0; i < 256; ++ i ) {
+      dsp_dither_process( &dither, &bench_limit_in[( i*block_size ) % ( BENCH_LIMIT_CHECK - block_size )], block_size );
+    }
+    blocks += 256;
+    elapsed_ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+  }
+
+  printf( "I-BENCH: Dither TPDF with noise shaping order %d = %.2f ns/sample, noise %.1f dBFS, below %.0f Hz %.1f dBFS, off grid %d\n\n",
+    DITHER_SHAPING, elapsed_ns/( (double) blocks*block_size ), 10*log10( noise_sum/BENCH_LIMIT_CHECK ) - 20*log10( DSP_MAX_LEVEL ),
+    BENCH_DITHER_FREQ, 10*log10( band_sum/( BENCH_LIMIT_CHECK - BENCH_DELAY_SETTLE ) ) - 20*log10( DSP_MAX_LEVEL ), off_grid );
+
+  if( off_grid != 0 ) {
+    printf( "E-BENCH: %d dithered samples are not on the output grid\n", off_grid );
+    return( ESP_FAIL );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Check that gain, limiter and output meter fused into one step give the same output
+// as the separate steps of the default graph, and compare their cost. The gain drives
+// the limiter. A graph with the dither before the end has to be rejected.
+//------------------------------------------------------------------------------------
+static esp_err_t bench_graph( int block_size, int min_millis ) {
+
+  static const node_def_t dither_graph[] = {  // Channel, Node type
+    { DSP_ALL_CHANNELS, DSP_NODE_MIX }, { DSP_ALL_CHANNELS, DSP_NODE_BIQUADS }, { DSP_ALL_CHANNELS, DSP_NODE_DITHER },
+    { DSP_ALL_CHANNELS, DSP_NODE_LIMIT }
+  };
+  static sample_t   separate_output[DSP_MAX_SAMPLES*DSP_NUM_CHANNELS];
+  static sample_t   fused_output[DSP_MAX_SAMPLES*DSP_NUM_CHANNELS];
+  bool              clip_flag;
+  int               buffer_len;
+  int               mismatches;
+  double            ns_fused;
+  double            ns_separate;
+
+  printf( "I-BENCH: A graph with the dither before the limiter has to be rejected:\n" );
+  if( dsp_graph_init( DSP_Channels, dither_graph, DSP_COUNT( dither_graph ) ) == ESP_OK ) {
+    printf( "E-BENCH: Graph with the dither before the limiter accepted\n" );
+    return( ESP_FAIL );
+  }
+  if( dsp_graph_init( DSP_Channels, NULL, 0 ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
+
+  if( bench_load_filters( 10, PRC_FLT ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
+  bench_fill_input( block_size );
+  buffer_len = block_size*DSP_NUM_CHANNELS*sizeof( sample_t );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    DSP_Channels[channel_id].data->scaling_factor = 4.0f;
+    DSP_Channels[channel_id].data->out_reduction_max_dB = 0;
+  }
+
+  dsp_graph_set_fused( DSP_Channels, false );
+  dsp_graph_info( DSP_Channels[0].data );
+  ns_separate = bench_run( block_size, min_millis );
+  dsp_resync( DSP_Channels );
+  dsp_filter( DSP_Channels, bench_input, separate_output, buffer_len, true, &clip_flag );
+
+  dsp_graph_set_fused( DSP_Channels, true );
+  dsp_graph_info( DSP_Channels[0].data );
+  ns_fused = bench_run( block_size, min_millis );
+  dsp_resync( DSP_Channels );
+  dsp_filter( DSP_Channels, bench_input, fused_output, buffer_len, true, &clip_flag );
+
+  mismatches = 0;
+  for( int i = 0; i < block_size*DSP_NUM_CHANNELS; ++ i ) {
+    mismatches += ( fused_output[i] != separate_output[i] );
+  }
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    DSP_Channels[channel_id].data->scaling_factor = exp10( DSP_Channels[channel_id].gain_dB/20.0 );
+  }
+  dsp_graph_set_fused( DSP_Channels, DSP_FUSE_OUTPUT_DEFAULT );
+
+  printf( "I-BENCH: Block %d separate steps = %.2f ns/sample, fused output step = %.2f ns/sample, reduction %.1f dB, differences %d\n\n",
+    block_size, ns_separate, ns_fused, DSP_Channels[0].data->out_reduction_max_dB, mismatches );
+
+  if( mismatches != 0 ) {
+    printf( "E-BENCH: Fused output step differs in %d samples\n", mismatches );
+    return( ESP_FAIL );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Compare the biquads designed at compile time with the ones calculated at startup
+//------------------------------------------------------------------------------------
+static esp_err_t bench_design( void ) {
+
+  double        coeffs[5];
+  double        diff;
+  double        max_diff;
+
+  max_diff = 0;
+  for( int filter_id = 0; filter_id < (int) DSP_COUNT( bench_design_filters ); ++ filter_id ) {
+
+    if( dsp_get_biquad( &bench_design_filters[filter_id], coeffs ) != ESP_OK ) {
+      return( ESP_FAIL );
+    }
+
+    for( int i = 0; i < 5; ++ i ) {
+      diff = fabs( coeffs[i] - bench_design_biquads.biquad[filter_id].coeffs[i] );
+      if( diff > max_diff ) {
+        max_diff = diff;
+      }
+    }
+  }
+
+  printf( "I-BENCH: Compile-time design of %d filters, max coefficient difference = %.3g\n\n", (int) DSP_COUNT( bench_design_filters ), max_diff );
+
+  if( max_diff > 1e-12 ) {
+    printf( "E-BENCH: Compile-time design differs from dsp_get_biquad()\n" );
+    return( ESP_FAIL );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Show the engine's own stage statistics for the firmware block size
+//------------------------------------------------------------------------------------
+static esp_err_t bench_stats( int block_size, int min_millis ) {
+
+  if( bench_load_filters( DSP_MAX_FILTERS, PRC_FLT ) != ESP_OK ) {
+    printf( "E-BENCH: Unable to load %d filters\n", DSP_MAX_FILTERS );
+    return( ESP_FAIL );
+  }
+
+  bench_fill_input( block_size );
+  dsp_stats_reset();
+  bench_run( block_size, min_millis );
+  dsp_stats_info();
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Benchmark every block size, precision, filter count and biquad kernel
+//------------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+
+  int       min_millis;
+  double    cpu_mhz;
+  double    ns_per_sample;
+  double    samples_per_sec;
+
+  // Usage: dsp_bench [min_millis] [cpu_mhz]
+  min_millis = ( argc > 1 ) ? atoi( argv[1] ) : BENCH_MIN_MILLIS;
+  cpu_mhz = ( argc > 2 ) ? atof( argv[2] ) : 0.0;
+
+  if( dsp_filter_init( DSP_Channels, NULL, 0, NULL, 0, NULL ) != ESP_OK ) {
+    printf( "E-BENCH: DSP initialization failed\n" );
+    return( 1 );
+  }
+
+  printf( "I-BENCH: Sample rate = %d, channels = %d, sample bits = %d\n", DSP_SAMPLE_RATE, DSP_NUM_CHANNELS, SAMPLE_BITS );
+  printf( "I-BENCH: Biquad filter = %d bytes, bank of %d filters = %d bytes\n", (int) sizeof( dsp_filter_t ), DSP_MAX_FILTERS, (int) sizeof( dsp_bank_t ) );
+  printf( "I-BENCH: ns/sample and samples/sec are per sample period (all channels)\n" );
+  if( cpu_mhz > 0 ) {
+    printf( "I-BENCH: cyc/sample is derived from a CPU clock of %.0f MHz (second argument)\n\n", cpu_mhz );
+  } else {
+    printf( "I-BENCH: No CPU clock given (second argument), so cyc/sample is left out\n\n" );
+  }
+  if( bench_noise() != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_precision_switch() != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_q15_range() != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_design() != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_transition( DSP_MAX_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_multirate( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_latency( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_fir_convolution( DSP_FIR_PARTITION, min_millis ) != ESP_OK ||
+      bench_fir_convolution( DSP_FIR_PARTITION/3, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_crossover( DSP_FIR_PARTITION, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_delay( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_share( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_in_place( 8, min_millis ) != ESP_OK || bench_in_place( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_limiter( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_dither( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_graph( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_block_size() != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( bench_stats( DSP_BLOCK_SAMPLES/DSP_NUM_CHANNELS, min_millis ) != ESP_OK ) {
+    return( 1 );
+  }
+
+  if( cpu_mhz > 0 ) {
+    printf( "%6s %5s %8s %8s %12s %12s %14s %10s\n", "block", "prec", "kernel", "filters", "ns/sample", "cyc/sample", "samples/sec", "x realtime" );
+  } else {
+    printf( "%6s %5s %8s %8s %12s %14s %10s\n", "block", "prec", "kernel", "filters", "ns/sample", "samples/sec", "x realtime" );
+  }
+
+  for( int block_size : bench_block_sizes ) {
+
+    bench_fill_input( block_size );
+
+    for( int precision : bench_precisions ) {
+      for( int filter_count = 0; filter_count <= DSP_MAX_FILTERS; ++ filter_count ) {
+
+        if( bench_load_filters( filter_count, precision ) != ESP_OK ) {
+          printf( "E-BENCH: Unable to load %d filters\n", filter_count );
+          return( 1 );
+        }
+
+        for( int kernel : bench_kernels ) {
+          dsp_set_kernel( kernel );
+
+          ns_per_sample = bench_run( block_size, min_millis );
+          samples_per_sec = 1e9/ns_per_sample;
+
+          if( cpu_mhz > 0 ) {
+            printf( "%6d %5s %8s %8d %12.2f %12.0f %14.0f %10.1f\n", block_size, bench_precision_name[ precision ],
+              bench_kernel_name[ kernel ], filter_count, ns_per_sample, ns_per_sample*cpu_mhz/1000, samples_per_sec, samples_per_sec/DSP_SAMPLE_RATE );
+          } else {
+            printf( "%6d %5s %8s %8d %12.2f %14.0f %10.1f\n", block_size, bench_precision_name[ precision ],
+              bench_kernel_name[ kernel ], filter_count, ns_per_sample, samples_per_sec, samples_per_sec/DSP_SAMPLE_RATE );
+          }
+        }
+      }
+    }
+  }
+
+  return( 0 );
+}
@@ -71,6 +71,12 @@ static void loopSerialInput() {
       dsp_command( 'p' );         
     } else if( input_text.equals( "u" ) ) { // Override filters
       dsp_command( 'u' );       
+    } else if( input_text.startsWith( "f " ) ) { // Change a single filter
+      dsp_edit_command( input_text.c_str() + 2 );
+    } else if( input_text.equals( "l" ) || input_text.startsWith( "l " ) ) { // Latency mode
+      dsp_latency_command( input_text.c_str() + 1 );
+    } else if( input_text.equals( "stats" ) || input_text.startsWith( "stats " ) ) { // Show/reset profiling statistics
+      dsp_stats_command( input_text.c_str() + 5 );
     } else if( input_text.equals( "restart" ) ) { // Reboot DSP
       ESP.restart();      
     } else if( input_text.equals( "?" ) ) { // Show help
@@ -80,6 +86,9 @@ static void loopSerialInput() {
       SERIAL.println( "s - Stop output" );
       SERIAL.println( "r - Run output" ); 
       SERIAL.println( "u - Update filters" );     
+      SERIAL.println( "f <channel> <filter> <freq|q|gain|type> <value> - Change one filter" );
+      SERIAL.println( "l [16|32|64|96|measure] - Show/set block size or measure loopback latency" );
+      SERIAL.println( "stats [reset] - Show/reset cycle counts, DSP load and stream faults" );
       SERIAL.println( "p - Plot transfer function curve" );
       SERIAL.println( "restart - Reboot DSP" );      
     } else {
@@ -1,4 +1,5 @@
-#include "dsp_process.h"
+#include <complex>
+#include "dsp_engine.h"
 
 #define _PI        3.14159265358979323846   /* pi    */
 #define _LN2       0.69314718055994530942   /* ln(2) */
@@ -6,16 +7,47 @@
 #define _TWO_PI    (_PI * 2)                /* 2*pi */
 #define _FS        DSP_SAMPLE_RATE          /* sampling frequency */
 
+// Rounding noise offsets (dB) of the error terms of the noise estimate, fitted to the
+// dsp_bench measurements of 640 filters
+#define NOISE_OUTPUT_DB      -152.3               // Float output, relative to the output power
+#define NOISE_FLT_STATE_DB   -142.5               // Float DF-II state, relative to the state power
+#define NOISE_DBL_STATE_DB   -151.9               // Float DF-II state of the double kernel
+#define NOISE_EF_SUM_DB      -159.0               // Float sum of the small terms (PRC_DF1_EF)
+#define NOISE_Q31_STEP_DB    ( -6.02*( SAMPLE_BITS - 1 + DSP_Q31_SHIFT ) - 9.7 )  // Q31 truncation step
+#if SAMPLE_BITS == 16
+#define NOISE_Q15_STEP_DB    ( -6.02*( SAMPLE_BITS - 1 + DSP_Q15_SHIFT ) - 9.7 )  // Q15 truncation step
+#define NOISE_Q15_COEFFS     true                 // Q15 coefficients (wider samples run the Q31 kernel)
+#else
+#define NOISE_Q15_STEP_DB    NOISE_Q31_STEP_DB
+#define NOISE_Q15_COEFFS     false
+#endif
+
+static const double   noise_ref_freq[] = { DSP_NOISE_REF_LOW_HZ, DSP_NOISE_REF_HIGH_HZ };
+static const int      precision_cost_order[] = DSP_PRECISION_COST;
 
 //------------------------------------------------------------------------------------
 // Calculate BiQuad values for the passeed filter
 //------------------------------------------------------------------------------------
-esp_err_t dsp_get_biquad( filter_def_t* filter, double* coeffs )
+esp_err_t dsp_get_biquad( const filter_def_t* filter, double* coeffs )
+{
+  return( dsp_get_biquad_rate( filter, _FS, coeffs ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Calculate BiQuad values for the passed filter at the passed sample rate
+//------------------------------------------------------------------------------------
+esp_err_t dsp_get_biquad_rate( const filter_def_t* filter, double sample_rate, double* coeffs )
 {
   double  b0, b1, b2, a0, a1, a2;   // BiQuad coefficients
   double  A, W0, S, C, alpha;       // Intermediate calculation values
 
-  W0 = (_TWO_PI * filter->frequency) / _FS;
+  if( filter->frequency <= 0 || filter->frequency >= sample_rate/2 ) {
+    dsp_printf( "E-DSP: ERROR: Filter frequency %.1f Hz outside the band of %.0f Hz sampling\r\n", filter->frequency, sample_rate );
+    return( ESP_FAIL );
+  }
+
+  W0 = (_TWO_PI * filter->frequency) / sample_rate;
   S  = sin(W0);
   C  = cos(W0);
   alpha = S / (2*filter->Q);
@@ -96,7 +128,7 @@ esp_err_t dsp_get_biquad( filter_def_t* filter, double* coeffs )
       break;      
 
     default:
-      SERIAL.printf( "E-DSP: ERROR: Unknown BiQuad type '%d'\r\n", filter->filter_type );
+      dsp_printf( "E-DSP: ERROR: Unknown BiQuad type '%d'\r\n", filter->filter_type );
       return( ESP_FAIL );    
   };
 
@@ -116,3 +148,345 @@ esp_err_t dsp_get_biquad( filter_def_t* filter, double* coeffs )
 
   return( ESP_OK );
 }
+
+
+//------------------------------------------------------------------------------------
+// Calculate the radius and frequency (Hz) of the dominant pole of the biquad
+//------------------------------------------------------------------------------------
+void dsp_get_biquad_poles( double* coeffs, double* radius, double* frequency )
+{
+  double  a1, a2, disc, root1, root2;
+
+  // Denominator is 1 + a1*z^-1 + a2*z^-2 (stored coefficients are negated)
+  a1 = -coeffs[3];
+  a2 = -coeffs[4];
+  disc = a1*a1 - 4*a2;
+
+  if( disc < 0 ) {
+    // Complex conjugate pair
+    *radius = sqrt( a2 );
+    *frequency = acos( -a1/( 2*sqrt( a2 ) ) )*_FS/_TWO_PI;
+  } else {
+    // Two real poles, report the one closest to the unit circle
+    root1 = ( -a1 + sqrt( disc ) )/2;
+    root2 = ( -a1 - sqrt( disc ) )/2;
+    if( fabs( root1 ) >= fabs( root2 ) ) {
+      *radius = fabs( root1 );
+      *frequency = root1 >= 0 ? 0 : _FS/2;
+    } else {
+      *radius = fabs( root2 );
+      *frequency = root2 >= 0 ? 0 : _FS/2;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Noise power gain of B(z)/A(z) with A(z) = 1 + a1*z^-1 + a2*z^-2 and the power gain
+// of 1/A(z) passed. B/A is split into b0 plus a strictly causal part whose power gain
+// follows from the lag 1 correlation of 1/A, -a1/(1 + a2).
+//------------------------------------------------------------------------------------
+static double dsp_biquad_power_gain( double b0, double b1, double b2, double a1, double a2, double gain )
+{
+  double  g1, g2;
+
+  g1 = b1 - b0*a1;
+  g2 = b2 - b0*a2;
+
+  return( b0*b0 + gain*( g1*g1 + g2*g2 - 2*g1*g2*a1/( 1 + a2 ) ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Response of the biquad at the passed z^-1
+//------------------------------------------------------------------------------------
+static std::complex<double> dsp_biquad_response( const double* coeffs, std::complex<double> z )
+{
+  return( ( coeffs[0] + ( coeffs[1] + coeffs[2]*z )*z )/( 1.0 - ( coeffs[3] + coeffs[4]*z )*z ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Estimate the output noise floor (dBFS) of the biquad when run with the kernel
+// for the passed precision
+//
+// The estimate is the power sum of the errors the kernel makes on the reference
+// signal, two tones of DSP_NOISE_REF_LEVEL at DSP_NOISE_REF_LOW_HZ and
+// DSP_NOISE_REF_HIGH_HZ:
+// - the response error of the rounded coefficients at the two tones
+// - the rounding of the float output, relative to the output power
+// - float DF-II: the rounding of the W values, relative to their power (signal
+//   through 1/A), shaped by B/A (PRC_FLT) or by B/A - b0 (PRC_DBL, where the output
+//   uses the unrounded double W value)
+// - PRC_DF1_EF: the rounding of the small terms, which is not fed back, through 1/A
+// - PRC_Q31, PRC_Q15: the truncation step, shaped by the error feedback zero and 1/A.
+//   The Q15 coefficients are much coarser, which rules it out for low frequencies.
+//------------------------------------------------------------------------------------
+double dsp_get_biquad_noise( double* coeffs, int precision, double sample_rate )
+{
+  std::complex<double>  z;
+  std::complex<double>  inv_a;
+  std::complex<double>  response;
+  double  a1, a2, gain, level;
+  double  power_x, power_w, power_y, power_err;
+  double  coeffs_q[5];
+  int32_t coeffs_fixed[6];
+  double  noise;
+
+  a1 = -coeffs[3];
+  a2 = -coeffs[4];
+
+  // Noise power gain of 1/A(z): sum of the squared impulse response
+  gain = ( 1 + a2 )/( ( 1 - a2 )*( ( 1 + a2 )*( 1 + a2 ) - a1*a1 ) );
+
+  // Unstable or marginal poles have unbounded noise
+  if( !( gain > 0 ) || isinf( gain ) ) {
+    return( 0.0 );
+  }
+
+  // Coefficients as rounded by the kernel
+  switch( precision ) {
+    case PRC_FLT:
+      for( int i = 0; i < 5; ++ i ) {
+        coeffs_q[i] = (float) coeffs[i];
+      }
+      break;
+
+    case PRC_DF1_EF:
+      for( int i = 0; i < 3; ++ i ) {
+        coeffs_q[i] = (float) coeffs[i];
+      }
+      coeffs_q[3] = 2.0 + (float) ( coeffs[3] - 2.0 );
+      coeffs_q[4] = -1.0 + (float) ( coeffs[4] + 1.0 );
+      break;
+
+    case PRC_Q31:
+      dsp_biquad_quantize_q31( coeffs, coeffs_fixed );
+      for( int i = 0; i < 5; ++ i ) {
+        coeffs_q[i] = ldexp( coeffs_fixed[i], coeffs_fixed[5] - 31 );
+      }
+      break;
+
+    case PRC_Q15:
+      // Rounded from Q31 as in the kernel
+      dsp_biquad_quantize_q31( coeffs, coeffs_fixed );
+      for( int i = 0; i < 5; ++ i ) {
+        if( NOISE_Q15_COEFFS ) {
+          coeffs_q[i] = ldexp( ( coeffs_fixed[i] >= 0x7FFF8000 ) ? 0x7FFF : ( ( coeffs_fixed[i] + 0x8000 ) >> 16 ), coeffs_fixed[5] - 15 );
+        } else {
+          coeffs_q[i] = ldexp( coeffs_fixed[i], coeffs_fixed[5] - 31 );
+        }
+      }
+      break;
+
+    default:
+      memcpy( coeffs_q, coeffs, sizeof( coeffs_q ) );
+      break;
+  }
+
+  // Powers of the input, the W values and the output, and the coefficient error
+  level = DSP_NOISE_REF_LEVEL*DSP_NOISE_REF_LEVEL/2;
+  power_x = power_w = power_y = power_err = 0;
+
+  for( double freq : noise_ref_freq ) {
+    if( freq >= sample_rate/2 ) {
+      continue;
+    }
+
+    z = std::polar( 1.0, -_TWO_PI*freq/sample_rate );
+    inv_a = 1.0/( 1.0 - ( coeffs[3] + coeffs[4]*z )*z );
+    response = dsp_biquad_response( coeffs, z );
+
+    power_x += level;
+    power_w += level*std::norm( inv_a );
+    power_y += level*std::norm( response );
+    power_err += level*std::norm( dsp_biquad_response( coeffs_q, z ) - response );
+  }
+
+  noise = power_err + power_y*pow( 10, NOISE_OUTPUT_DB/10 );
+
+  switch( precision ) {
+    case PRC_FLT:
+      noise += power_w*dsp_biquad_power_gain( coeffs[0], coeffs[1], coeffs[2], a1, a2, gain )*pow( 10, NOISE_FLT_STATE_DB/10 );
+      break;
+
+    case PRC_DBL:
+      noise += power_w*( dsp_biquad_power_gain( coeffs[0], coeffs[1], coeffs[2], a1, a2, gain ) - coeffs[0]*coeffs[0] )*pow( 10, NOISE_DBL_STATE_DB/10 );
+      break;
+
+    case PRC_DF1_EF:
+      noise += ( power_x*pow( fabs( coeffs[0] ) + fabs( coeffs[1] ) + fabs( coeffs[2] ), 2 ) +
+        power_y*pow( fabs( coeffs[3] - 2.0 ) + fabs( coeffs[4] + 1.0 ), 2 ) )*gain*pow( 10, NOISE_EF_SUM_DB/10 );
+      break;
+
+    case PRC_Q31:
+      noise += dsp_biquad_power_gain( 1, -1, 0, a1, a2, gain )*pow( 10, NOISE_Q31_STEP_DB/10 );
+      break;
+
+    case PRC_Q15:
+      noise += dsp_biquad_power_gain( 1, -1, 0, a1, a2, gain )*pow( 10, NOISE_Q15_STEP_DB/10 );
+      break;
+  }
+
+  return( 10*log10( noise + 1e-30 ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Select the cheapest kernel whose estimated noise meets DSP_NOISE_TARGET_DB
+//------------------------------------------------------------------------------------
+int dsp_select_precision( double* coeffs, double sample_rate )
+{
+  for( int precision : precision_cost_order ) {
+    if( dsp_get_biquad_noise( coeffs, precision, sample_rate ) <= DSP_NOISE_TARGET_DB ) {
+      return( precision );
+    }
+  }
+
+  return( PRC_TDF2 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Interpolate between two biquads at the passed fraction (0 = from, 1 = to)
+//
+// The denominator is interpolated through its reflection coefficients k1 and k2,
+// which lie inside (-1, 1) for every stable biquad. A straight line between two
+// stable filters therefore stays stable, which is not true for a1/a2 directly.
+// The numerator does not affect stability and is interpolated as is.
+//------------------------------------------------------------------------------------
+void dsp_interpolate_biquad( double* coeffs_from, double* coeffs_to, double fraction, double* coeffs )
+{
+  double  k1_from, k2_from, k1_to, k2_to, k1, k2;
+
+  for( int i = 0; i < 3; ++ i ) {
+    coeffs[i] = coeffs_from[i] + ( coeffs_to[i] - coeffs_from[i] )*fraction;
+  }
+
+  // Stored coefficients are -a1 and -a2
+  k2_from = -coeffs_from[4];
+  k1_from = -coeffs_from[3]/( 1 + k2_from );
+  k2_to = -coeffs_to[4];
+  k1_to = -coeffs_to[3]/( 1 + k2_to );
+
+  k1 = k1_from + ( k1_to - k1_from )*fraction;
+  k2 = k2_from + ( k2_to - k2_from )*fraction;
+
+  coeffs[3] = -k1*( 1 + k2 );
+  coeffs[4] = -k2;
+}
+
+
+//------------------------------------------------------------------------------------
+// Replace a pair of roots by the real coefficients c1, c2 of z^2 + c1*z + c2
+//------------------------------------------------------------------------------------
+static void dsp_roots_to_coeffs( std::complex<double> root1, std::complex<double> root2, double* c1, double* c2 )
+{
+  *c1 = -( root1 + root2 ).real();
+  *c2 = ( root1*root2 ).real();
+}
+
+
+//------------------------------------------------------------------------------------
+// Map a root of a biquad designed at the full rate to the rate reduced by factor.
+// Roots above the reduced Nyquist frequency (only zeros are accepted there) move to
+// z = -1, the Nyquist frequency of the reduced rate.
+//------------------------------------------------------------------------------------
+static std::complex<double> dsp_resample_root( std::complex<double> root, int factor )
+{
+  if( std::abs( root ) == 0 ) {
+    return( root );
+  }
+
+  if( fabs( std::arg( root ) )*factor >= _PI ) {
+    return( std::complex<double>( -std::pow( std::abs( root ), factor ), 0 ) );
+  }
+
+  return( std::pow( root, factor ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Magnitude of the biquad response at the passed angular frequency
+//------------------------------------------------------------------------------------
+static double dsp_biquad_magnitude( const double* coeffs, double w )
+{
+  std::complex<double>  z1 = std::polar( 1.0, -w );
+  std::complex<double>  z2 = z1*z1;
+
+  return( std::abs( ( coeffs[0] + coeffs[1]*z1 + coeffs[2]*z2 )/( 1.0 - coeffs[3]*z1 - coeffs[4]*z2 ) ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Convert a biquad designed at DSP_SAMPLE_RATE to the rate reduced by factor
+//
+// Poles and zeros are moved with z' = z^factor (matched z-transform), which keeps
+// their frequency and bandwidth. The gain is then matched at whichever of DC, the
+// pole frequency and half the reduced band has the largest original response.
+// Filters with poles above the reduced band can not be converted.
+//------------------------------------------------------------------------------------
+esp_err_t dsp_resample_biquad( const double* coeffs, int factor, double* coeffs_out )
+{
+  std::complex<double>  zero1, zero2, pole1, pole2, disc;
+  double                b1, b2, a1, a2;
+  double                w_ref[3];
+  double                w_best, gain_best, gain;
+
+  if( factor <= 1 ) {
+    memcpy( coeffs_out, coeffs, 5*sizeof( double ) );
+    return( ESP_OK );
+  }
+
+  // Poles are the roots of z^2 - c3*z - c4
+  disc = std::sqrt( std::complex<double>( coeffs[3]*coeffs[3] + 4*coeffs[4], 0 ) );
+  pole1 = ( coeffs[3] + disc )/2.0;
+  pole2 = ( coeffs[3] - disc )/2.0;
+
+  if( fabs( std::arg( pole1 ) )*factor >= _PI || fabs( std::arg( pole2 ) )*factor >= _PI ) {
+    dsp_printf( "E-DSP: ERROR: Biquad poles above the band of the decimated channel\r\n" );
+    return( ESP_FAIL );
+  }
+
+  // Zeros are the roots of b0*z^2 + b1*z + b2
+  if( coeffs[0] == 0 ) {
+    dsp_printf( "E-DSP: ERROR: Biquad with b0 = 0 can not be decimated\r\n" );
+    return( ESP_FAIL );
+  }
+  b1 = coeffs[1]/coeffs[0];
+  b2 = coeffs[2]/coeffs[0];
+  disc = std::sqrt( std::complex<double>( b1*b1 - 4*b2, 0 ) );
+  zero1 = ( -b1 + disc )/2.0;
+  zero2 = ( -b1 - disc )/2.0;
+
+  dsp_roots_to_coeffs( dsp_resample_root( zero1, factor ), dsp_resample_root( zero2, factor ), &b1, &b2 );
+  dsp_roots_to_coeffs( dsp_resample_root( pole1, factor ), dsp_resample_root( pole2, factor ), &a1, &a2 );
+
+  coeffs_out[0] = 1.0;
+  coeffs_out[1] = b1;
+  coeffs_out[2] = b2;
+  coeffs_out[3] = -a1;
+  coeffs_out[4] = -a2;
+
+  // Match the gain where the original filter passes the most
+  w_ref[0] = 0;
+  w_ref[1] = fabs( std::arg( pole1 ) );
+  w_ref[2] = _PI/( 2*factor );
+
+  w_best = 0;
+  gain_best = -1;
+  for( double w : w_ref ) {
+    gain = dsp_biquad_magnitude( coeffs, w );
+    if( gain > gain_best ) {
+      gain_best = gain;
+      w_best = w;
+    }
+  }
+
+  gain = gain_best/dsp_biquad_magnitude( coeffs_out, w_best*factor );
+  for( int i = 0; i < 3; ++ i ) {
+    coeffs_out[i] *= gain;
+  }
+
+  return( ESP_OK );
+}
@@ -0,0 +1,430 @@
+#include "dsp_engine.h"
+
+#define DSP_CASCADE_STAGES    4                   // Max stages fused per pass (W values of 4 stages fit the ESP32 FPU registers)
+
+// Fraction bits of the state of PRC_Q15, which runs the Q31 kernel for wider samples
+#if SAMPLE_BITS == 16
+#define DSP_Q15_SAMPLE_SHIFT  DSP_Q15_SHIFT
+#else
+#define DSP_Q15_SAMPLE_SHIFT  DSP_Q31_SHIFT
+#endif
+
+
+//------------------------------------------------------------------------------------
+// Clear the state of a biquad filter
+//------------------------------------------------------------------------------------
+void dsp_biquad_reset( dsp_filter_t* filter ) {
+
+  memset( &filter->state, 0, sizeof( filter->state ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Convert double coefficients to Q31 coefficients with a post shift in coeffs_q[5].
+// The post shift is the smallest that fits the largest coefficient.
+//------------------------------------------------------------------------------------
+void dsp_biquad_quantize_q31( const double* coeffs, int32_t* coeffs_q ) {
+
+  int       shift;
+  double    scale;
+
+  shift = 1;
+  for( int i = 0; i < 5; ++ i ) {
+    while( shift < DSP_Q31_MAX_SHIFT && fabs( coeffs[i] ) >= ( 1 << shift ) ) {
+      ++ shift;
+    }
+  }
+
+  scale = ldexp( 1.0, 31 - shift );
+  for( int i = 0; i < 5; ++ i ) {
+    coeffs_q[i] = (int32_t) fmax( fmin( round( coeffs[i]*scale ), INT32_MAX ), INT32_MIN );
+  }
+  coeffs_q[5] = shift;
+}
+
+
+//------------------------------------------------------------------------------------
+// Derive the float or fixed-point coefficients of the filter precision from the double
+// coefficients. Call again after changing the precision.
+//------------------------------------------------------------------------------------
+void dsp_biquad_quantize( dsp_filter_t* filter ) {
+
+  if( filter->precision == PRC_Q31 || filter->precision == PRC_Q15 ) {
+    dsp_biquad_quantize_q31( filter->coeffs_d, filter->coeffs_q );
+    return;
+  }
+
+  for( int i = 0; i < 5; ++ i ) {
+    filter->coeffs_f[i] = filter->coeffs_d[i];
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Switch a running biquad to the kernel of another precision. Float and double DF-II
+// share the W values. For any other change the new state is solved from the free
+// response of the old one (its next two outputs for zero input, which fix the rest
+// of a second order response), so the output continues without a step. A state that
+// cannot produce that response (no second pole) starts from zero.
+//------------------------------------------------------------------------------------
+void dsp_biquad_set_precision( dsp_filter_t* filter, int precision ) {
+
+  const double* c = filter->coeffs_d;
+  double        q_scale;
+  double        y0, y1;
+  double        p, q, det;
+  double        w0, w1;
+
+  if( filter->precision == precision ) {
+    return;
+  }
+
+  if( filter->precision <= PRC_DBL && precision <= PRC_DBL ) {
+    filter->precision = precision;
+    dsp_biquad_quantize( filter );
+    return;
+  }
+
+  // DF-II output for zero input: y = p*w0 + q*w1
+  p = c[0]*c[3] + c[1];
+  q = c[0]*c[4] + c[2];
+
+  // Free response of the current state
+  switch( filter->precision ) {
+    case PRC_TDF2:
+      y0 = filter->state.w_d[0];
+      y1 = c[3]*y0 + filter->state.w_d[1];
+      break;
+
+    case PRC_DF1_EF:
+      y0 = c[1]*filter->state.w_ef[0] + c[2]*filter->state.w_ef[1] + c[3]*filter->state.w_ef[2] + c[4]*filter->state.w_ef[3];
+      y1 = c[2]*filter->state.w_ef[0] + c[3]*y0 + c[4]*filter->state.w_ef[2];
+      break;
+
+    case PRC_Q31:
+    case PRC_Q15:
+      q_scale = 1 << ( ( filter->precision == PRC_Q31 ) ? DSP_Q31_SHIFT : DSP_Q15_SAMPLE_SHIFT );
+      y0 = ( c[1]*filter->state.w_q[0] + c[2]*filter->state.w_q[1] + c[3]*filter->state.w_q[2] + c[4]*filter->state.w_q[3] )/q_scale;
+      y1 = ( c[2]*filter->state.w_q[0] + c[4]*filter->state.w_q[2] )/q_scale + c[3]*y0;
+      break;
+
+    default:
+      y0 = p*filter->state.w[0] + q*filter->state.w[1];
+      y1 = ( p*c[3] + q )*filter->state.w[0] + p*c[4]*filter->state.w[1];
+      break;
+  }
+
+  dsp_biquad_reset( filter );
+  filter->precision = precision;
+  dsp_biquad_quantize( filter );
+
+  // State with the same free response, DF-I with zero input history
+  switch( precision ) {
+    case PRC_TDF2:
+      filter->state.w_d[0] = y0;
+      filter->state.w_d[1] = y1 - c[3]*y0;
+      break;
+
+    case PRC_DF1_EF:
+    case PRC_Q31:
+    case PRC_Q15:
+      if( c[4] == 0 ) {
+        break;
+      }
+      w0 = ( y1 - c[3]*y0 )/c[4];
+      w1 = ( y0 - c[3]*w0 )/c[4];
+
+      if( precision != PRC_DF1_EF ) {
+        q_scale = 1 << ( ( precision == PRC_Q31 ) ? DSP_Q31_SHIFT : DSP_Q15_SAMPLE_SHIFT );
+        filter->state.w_q[2] = (int32_t) fmax( fmin( round( w0*q_scale ), INT32_MAX ), INT32_MIN );
+        filter->state.w_q[3] = (int32_t) fmax( fmin( round( w1*q_scale ), INT32_MAX ), INT32_MIN );
+      } else {
+        filter->state.w_ef[2] = w0;
+        filter->state.w_ef[3] = w1;
+      }
+      break;
+
+    default:
+      det = p*p*c[4] - q*( p*c[3] + q );
+      if( det == 0 ) {
+        break;
+      }
+      filter->state.w[0] = ( y0*p*c[4] - q*y1 )/det;
+      filter->state.w[1] = ( p*y1 - ( p*c[3] + q )*y0 )/det;
+      break;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Process a single biquad filter in place with the kernel for its precision
+//------------------------------------------------------------------------------------
+esp_err_t dsp_biquad_filter( float* buffer, int len, dsp_filter_t* filter ) {
+
+  switch( filter->precision ) {
+    case PRC_DBL:
+      return( dsps_biquad_f32_dbl( buffer, buffer, len, filter->coeffs_d, filter->state.w ) );
+
+    case PRC_TDF2:
+      return( dsps_biquad_f32_tdf2( buffer, buffer, len, filter->coeffs_d, filter->state.w_d ) );
+
+    case PRC_DF1_EF:
+      return( dsps_biquad_f32_ef( buffer, buffer, len, filter->coeffs_d, filter->state.w_ef ) );
+
+    case PRC_Q15:
+#if SAMPLE_BITS == 16
+      return( dsps_biquad_f32_q15( buffer, buffer, len, filter->coeffs_q, DSP_Q15_SHIFT, filter->state.w_q ) );
+#endif
+      // Wider samples do not fit the Q15 kernel and run the Q31 kernel
+    case PRC_Q31:
+      return( dsps_biquad_f32_q31( buffer, buffer, len, filter->coeffs_q, DSP_Q31_SHIFT, filter->state.w_q ) );
+
+    default:
+      return( dsps_biquad_f32( buffer, buffer, len, filter->coeffs_f, filter->state.w ) );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Select the coefficient set matching the arithmetic type of the kernel
+//------------------------------------------------------------------------------------
+static inline const float* dsp_cascade_coeffs( dsp_filter_t* filter, float ) {
+  return( filter->coeffs_f );
+}
+
+static inline const double* dsp_cascade_coeffs( dsp_filter_t* filter, double ) {
+  return( filter->coeffs_d );
+}
+
+
+//------------------------------------------------------------------------------------
+// Run N biquad stages sample by sample in a single pass over the buffer
+//
+// Coefficients and W values are held in locals for the whole block so the compiler
+// can keep them in registers. Arithmetic is done in T while the W values and the
+// value passed between stages are kept as float, giving results identical to
+// calling dsps_biquad_f32 (T = float) or dsps_biquad_f32_dbl (T = double) per stage.
+//------------------------------------------------------------------------------------
+template <typename T, int N>
+static void dsp_cascade_stages( float* buffer, int len, dsp_filter_t* filters ) {
+
+  T         c[N][5];
+  float     w0[N];
+  float     w1[N];
+  float     x;
+  T         d0;
+
+  for( int k = 0; k < N; ++ k ) {
+    const T* coeffs = dsp_cascade_coeffs( &filters[k], (T) 0 );
+    for( int i = 0; i < 5; ++ i ) {
+      c[k][i] = coeffs[i];
+    }
+    w0[k] = filters[k].state.w[0];
+    w1[k] = filters[k].state.w[1];
+  }
+
+  for( int i = 0; i < len; ++ i ) {
+    x = buffer[i];
+    for( int k = 0; k < N; ++ k ) {
+      d0 = x + c[k][3]*w0[k] + c[k][4]*w1[k];
+      x = c[k][0]*d0 + c[k][1]*w0[k] + c[k][2]*w1[k];
+      w1[k] = w0[k];
+      w0[k] = d0;
+    }
+    buffer[i] = x;
+  }
+
+  for( int k = 0; k < N; ++ k ) {
+    filters[k].state.w[0] = w0[k];
+    filters[k].state.w[1] = w1[k];
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Run a chain of stages with the same precision in groups of DSP_CASCADE_STAGES
+//------------------------------------------------------------------------------------
+template <typename T>
+static void dsp_cascade_run( float* buffer, int len, dsp_filter_t* filters, int num_filters ) {
+
+  int       stages;
+
+  while( num_filters > 0 ) {
+    stages = num_filters < DSP_CASCADE_STAGES ? num_filters : DSP_CASCADE_STAGES;
+
+    switch( stages ) {
+      case 1:  dsp_cascade_stages<T, 1>( buffer, len, filters ); break;
+      case 2:  dsp_cascade_stages<T, 2>( buffer, len, filters ); break;
+      case 3:  dsp_cascade_stages<T, 3>( buffer, len, filters ); break;
+      default: dsp_cascade_stages<T, 4>( buffer, len, filters ); break;
+    }
+
+    filters += stages;
+    num_filters -= stages;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Process a complete biquad chain in place using the fused cascade kernels
+//------------------------------------------------------------------------------------
+esp_err_t dsp_biquad_cascade( float* buffer, int len, dsp_filter_t* filters, int num_filters ) {
+
+  int       run_start;
+  int       run_end;
+
+  // Split the chain into runs of consecutive filters with the same precision
+  run_start = 0;
+  while( run_start < num_filters ) {
+    run_end = run_start + 1;
+    while( run_end < num_filters && filters[run_end].precision == filters[run_start].precision ) {
+      ++ run_end;
+    }
+
+    if( filters[run_start].precision == PRC_FLT ) {
+      dsp_cascade_run<float>( buffer, len, &filters[run_start], run_end - run_start );
+    } else if( filters[run_start].precision == PRC_DBL ) {
+      dsp_cascade_run<double>( buffer, len, &filters[run_start], run_end - run_start );
+    } else {
+      // Other structures keep their own state layout and run a stage at a time
+      for( int filter_id = run_start; filter_id < run_end; ++ filter_id ) {
+        dsp_biquad_filter( buffer, len, &filters[filter_id] );
+      }
+    }
+
+    run_start = run_end;
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Run N biquad stages of two channels in the same pass
+//
+// The two channels form independent dependency chains, so the FPU can work on one
+// channel while the result of the other is still in the pipeline.
+//------------------------------------------------------------------------------------
+template <typename T, int N>
+static void dsp_cascade_pair_stages( float* buffer_a, dsp_filter_t* filters_a, float* buffer_b, dsp_filter_t* filters_b, int len ) {
+
+  T         ca[N][5];
+  T         cb[N][5];
+  float     wa0[N], wa1[N];
+  float     wb0[N], wb1[N];
+  float     xa, xb;
+  T         da, db;
+
+  for( int k = 0; k < N; ++ k ) {
+    const T* coeffs_a = dsp_cascade_coeffs( &filters_a[k], (T) 0 );
+    const T* coeffs_b = dsp_cascade_coeffs( &filters_b[k], (T) 0 );
+    for( int i = 0; i < 5; ++ i ) {
+      ca[k][i] = coeffs_a[i];
+      cb[k][i] = coeffs_b[i];
+    }
+    wa0[k] = filters_a[k].state.w[0];
+    wa1[k] = filters_a[k].state.w[1];
+    wb0[k] = filters_b[k].state.w[0];
+    wb1[k] = filters_b[k].state.w[1];
+  }
+
+  for( int i = 0; i < len; ++ i ) {
+    xa = buffer_a[i];
+    xb = buffer_b[i];
+    for( int k = 0; k < N; ++ k ) {
+      da = xa + ca[k][3]*wa0[k] + ca[k][4]*wa1[k];
+      db = xb + cb[k][3]*wb0[k] + cb[k][4]*wb1[k];
+      xa = ca[k][0]*da + ca[k][1]*wa0[k] + ca[k][2]*wa1[k];
+      xb = cb[k][0]*db + cb[k][1]*wb0[k] + cb[k][2]*wb1[k];
+      wa1[k] = wa0[k];
+      wb1[k] = wb0[k];
+      wa0[k] = da;
+      wb0[k] = db;
+    }
+    buffer_a[i] = xa;
+    buffer_b[i] = xb;
+  }
+
+  for( int k = 0; k < N; ++ k ) {
+    filters_a[k].state.w[0] = wa0[k];
+    filters_a[k].state.w[1] = wa1[k];
+    filters_b[k].state.w[0] = wb0[k];
+    filters_b[k].state.w[1] = wb1[k];
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Run paired stages with the same precision in groups of DSP_CASCADE_STAGES
+//------------------------------------------------------------------------------------
+template <typename T>
+static void dsp_cascade_pair_run( float* buffer_a, dsp_filter_t* filters_a, float* buffer_b, dsp_filter_t* filters_b, int len, int num_filters ) {
+
+  int       stages;
+
+  while( num_filters > 0 ) {
+    stages = num_filters < DSP_CASCADE_STAGES ? num_filters : DSP_CASCADE_STAGES;
+
+    switch( stages ) {
+      case 1:  dsp_cascade_pair_stages<T, 1>( buffer_a, filters_a, buffer_b, filters_b, len ); break;
+      case 2:  dsp_cascade_pair_stages<T, 2>( buffer_a, filters_a, buffer_b, filters_b, len ); break;
+      case 3:  dsp_cascade_pair_stages<T, 3>( buffer_a, filters_a, buffer_b, filters_b, len ); break;
+      default: dsp_cascade_pair_stages<T, 4>( buffer_a, filters_a, buffer_b, filters_b, len ); break;
+    }
+
+    filters_a += stages;
+    filters_b += stages;
+    num_filters -= stages;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Process the biquad chains of two channels in place, running filter k of both
+// channels in the same loop. Stages whose precision differs between the channels
+// and the tail of the longer chain fall back to the single channel cascade.
+//------------------------------------------------------------------------------------
+esp_err_t dsp_biquad_cascade_pair( float* buffer_a, dsp_filter_t* filters_a, int num_filters_a, float* buffer_b, dsp_filter_t* filters_b, int num_filters_b, int len ) {
+
+  int       num_paired;
+  int       run_start;
+  int       run_end;
+  int       precision;
+
+  num_paired = num_filters_a < num_filters_b ? num_filters_a : num_filters_b;
+
+  run_start = 0;
+  while( run_start < num_paired ) {
+    precision = filters_a[run_start].precision;
+
+    // A stage with different precisions is run separately for each channel
+    if( filters_b[run_start].precision != precision ) {
+      dsp_biquad_cascade( buffer_a, len, &filters_a[run_start], 1 );
+      dsp_biquad_cascade( buffer_b, len, &filters_b[run_start], 1 );
+      ++ run_start;
+      continue;
+    }
+
+    run_end = run_start + 1;
+    while( run_end < num_paired && filters_a[run_end].precision == precision && filters_b[run_end].precision == precision ) {
+      ++ run_end;
+    }
+
+    if( precision == PRC_FLT ) {
+      dsp_cascade_pair_run<float>( buffer_a, &filters_a[run_start], buffer_b, &filters_b[run_start], len, run_end - run_start );
+    } else if( precision == PRC_DBL ) {
+      dsp_cascade_pair_run<double>( buffer_a, &filters_a[run_start], buffer_b, &filters_b[run_start], len, run_end - run_start );
+    } else {
+      dsp_biquad_cascade( buffer_a, len, &filters_a[run_start], run_end - run_start );
+      dsp_biquad_cascade( buffer_b, len, &filters_b[run_start], run_end - run_start );
+    }
+
+    run_start = run_end;
+  }
+
+  // Finish the remaining stages of the longer chain
+  dsp_biquad_cascade( buffer_a, len, &filters_a[num_paired], num_filters_a - num_paired );
+  dsp_biquad_cascade( buffer_b, len, &filters_b[num_paired], num_filters_b - num_paired );
+
+  return( ESP_OK );
+}
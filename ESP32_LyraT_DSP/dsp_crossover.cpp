@@ -0,0 +1,419 @@
+#include "dsp_engine.h"
+
+#define _PI                   3.14159265358979323846
+#define XO_PROFILE_WARMUP     4                   // Blocks run before measuring
+#define XO_PROFILE_BLOCKS     32                  // Blocks measured
+
+static const char*    section_name[] = {"Low Pass", "High Pass", "Band Pass" };
+
+
+//------------------------------------------------------------------------------------
+// Zero order modified Bessel function of the first kind (Kaiser window)
+//------------------------------------------------------------------------------------
+static double dsp_bessel_i0( double x ) {
+
+  double      sum;
+  double      term;
+
+  sum = 1.0;
+  term = 1.0;
+  for( int k = 1; k < 32; ++ k ) {
+    term *= ( x/( 2*k ) )*( x/( 2*k ) );
+    sum += term;
+  }
+
+  return( sum );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the Kaiser window shape parameter for the passed stop band attenuation
+//------------------------------------------------------------------------------------
+static double dsp_kaiser_beta( double attenuation ) {
+
+  if( attenuation > 50 ) {
+    return( 0.1102*( attenuation - 8.7 ) );
+  } else if( attenuation >= 21 ) {
+    return( 0.5842*pow( attenuation - 21, 0.4 ) + 0.07886*( attenuation - 21 ) );
+  }
+
+  return( 0.0 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the (odd) number of taps for a crossover at the passed frequency
+//
+// The slope is met over the octave centred on the crossover frequency: the
+// transition band runs from f/sqrt(2) to f*sqrt(2) and the stop band attenuation
+// is the slope. The Kaiser estimate gives the length for that transition band.
+//------------------------------------------------------------------------------------
+int dsp_crossover_taps( float frequency, int slope ) {
+
+  double      width;
+  int         taps;
+
+  width = frequency*( sqrt( 2.0 ) - sqrt( 0.5 ) )/DSP_SAMPLE_RATE;
+  taps = (int) ceil( ( slope - 7.95 )/( 14.36*width ) ) + 1;
+
+  return( taps | 1 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return a tap of a Kaiser windowed sinc low pass
+//------------------------------------------------------------------------------------
+static double dsp_crossover_tap( int tap, int taps, double cutoff, double beta ) {
+
+  double      x;
+
+  x = tap - taps/2;
+
+  return( ( ( x == 0 ) ? cutoff : sin( _PI*cutoff*x )/( _PI*x ) )*
+    dsp_bessel_i0( beta*sqrt( 1.0 - pow( x/( taps/2 ), 2 ) ) )/dsp_bessel_i0( beta ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Add a Kaiser windowed sinc low pass with unity DC gain to the coefficients. The
+// taps are calculated twice instead of being buffered, to keep the stack small.
+//------------------------------------------------------------------------------------
+static void dsp_crossover_lowpass( double* coeffs, int taps, float frequency, double beta, double sign ) {
+
+  double      cutoff;
+  double      sum;
+
+  cutoff = 2.0*frequency/DSP_SAMPLE_RATE;
+
+  sum = 0;
+  for( int i = 0; i < taps; ++ i ) {
+    sum += dsp_crossover_tap( i, taps, cutoff, beta );
+  }
+
+  for( int i = 0; i < taps; ++ i ) {
+    coeffs[i] += sign*dsp_crossover_tap( i, taps, cutoff, beta )/sum;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Generate a linear-phase crossover section
+//
+// The high pass is a delayed impulse minus the low pass of the same length, and the
+// band pass is the difference of two low passes. Sections with the same frequency
+// and slope therefore sum to a pure delay of (taps - 1)/2 samples.
+//------------------------------------------------------------------------------------
+dsp_crossover_t* dsp_crossover_create( const crossover_def_t* crossover_def ) {
+
+  dsp_crossover_t*  crossover;
+  int               taps;
+  double            beta;
+  double*           coeffs;
+
+  if( crossover_def->section < DSP_CROSSOVER_LOW_PASS || crossover_def->section > DSP_CROSSOVER_BAND_PASS ) {
+    dsp_printf( "E-DSP: ERROR: Invalid crossover section %d\r\n", crossover_def->section );
+    return( NULL );
+  }
+
+  if( crossover_def->slope < DSP_XO_MIN_SLOPE || crossover_def->slope > DSP_XO_MAX_SLOPE ) {
+    dsp_printf( "E-DSP: ERROR: Invalid crossover slope %d dB/octave (%d to %d)\r\n", crossover_def->slope, DSP_XO_MIN_SLOPE, DSP_XO_MAX_SLOPE );
+    return( NULL );
+  }
+
+  if( crossover_def->frequency <= 0 || crossover_def->frequency*sqrt( 2.0 ) >= DSP_SAMPLE_RATE/2 ||
+      ( crossover_def->section == DSP_CROSSOVER_BAND_PASS && ( crossover_def->frequency_high <= crossover_def->frequency ||
+        crossover_def->frequency_high*sqrt( 2.0 ) >= DSP_SAMPLE_RATE/2 ) ) ) {
+    dsp_printf( "E-DSP: ERROR: Invalid crossover frequency %.1f Hz\r\n", crossover_def->frequency );
+    return( NULL );
+  }
+
+  // The lowest frequency sets the length
+  taps = dsp_crossover_taps( crossover_def->frequency, crossover_def->slope );
+  if( taps > DSP_XO_MAX_TAPS ) {
+    dsp_printf( "E-DSP: ERROR: Crossover at %.1f Hz and %d dB/octave needs %d taps (max %d)\r\n",
+      crossover_def->frequency, crossover_def->slope, taps, DSP_XO_MAX_TAPS );
+    return( NULL );
+  }
+
+  beta = dsp_kaiser_beta( crossover_def->slope );
+
+  crossover = (dsp_crossover_t*) malloc( sizeof( dsp_crossover_t ) );
+  coeffs = (double*) calloc( taps, sizeof( double ) );
+
+  if( crossover == NULL || coeffs == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to allocate crossover of %d taps\r\n", taps );
+    free( crossover );
+    free( coeffs );
+    return( NULL );
+  }
+
+  switch( crossover_def->section ) {
+    case DSP_CROSSOVER_LOW_PASS:
+      dsp_crossover_lowpass( coeffs, taps, crossover_def->frequency, beta, 1.0 );
+      break;
+
+    case DSP_CROSSOVER_HIGH_PASS:
+      coeffs[taps/2] = 1.0;
+      dsp_crossover_lowpass( coeffs, taps, crossover_def->frequency, beta, -1.0 );
+      break;
+
+    case DSP_CROSSOVER_BAND_PASS:
+      dsp_crossover_lowpass( coeffs, taps, crossover_def->frequency_high, beta, 1.0 );
+      dsp_crossover_lowpass( coeffs, taps, crossover_def->frequency, beta, -1.0 );
+      break;
+  }
+
+  // Only the first half of the symmetric coefficients and the centre are stored
+  crossover->coeffs = (float*) malloc( ( taps/2 + 1 )*sizeof( float ) );
+  crossover->hist = (float*) malloc( 2*taps*sizeof( float ) );
+
+  if( crossover->coeffs == NULL || crossover->hist == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to allocate crossover of %d taps\r\n", taps );
+    dsp_crossover_free( crossover );
+    free( coeffs );
+    return( NULL );
+  }
+
+  for( int i = 0; i <= taps/2; ++ i ) {
+    crossover->coeffs[i] = coeffs[i];
+  }
+  free( coeffs );
+
+  crossover->crossover_def = crossover_def;
+  crossover->taps = taps;
+  crossover->shared = false;
+  dsp_crossover_reset( crossover );
+
+  return( crossover );
+}
+
+
+//------------------------------------------------------------------------------------
+// Set up a crossover section with the coefficients of an existing one, for another
+// channel using the same definition
+//------------------------------------------------------------------------------------
+dsp_crossover_t* dsp_crossover_share( dsp_crossover_t* source ) {
+
+  dsp_crossover_t*  crossover;
+
+  crossover = (dsp_crossover_t*) malloc( sizeof( dsp_crossover_t ) );
+  if( crossover == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to allocate crossover of %d taps\r\n", source->taps );
+    return( NULL );
+  }
+
+  *crossover = *source;
+  crossover->shared = true;
+  crossover->hist = (float*) malloc( 2*crossover->taps*sizeof( float ) );
+
+  if( crossover->hist == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to allocate crossover of %d taps\r\n", source->taps );
+    free( crossover );
+    return( NULL );
+  }
+
+  dsp_crossover_reset( crossover );
+
+  return( crossover );
+}
+
+
+//------------------------------------------------------------------------------------
+// Release a crossover section
+//------------------------------------------------------------------------------------
+void dsp_crossover_free( dsp_crossover_t* crossover ) {
+
+  if( crossover != NULL ) {
+    if( !crossover->shared ) {
+      free( crossover->coeffs );
+    }
+    free( crossover->hist );
+    free( crossover );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Clear the crossover history
+//------------------------------------------------------------------------------------
+void dsp_crossover_reset( dsp_crossover_t* crossover ) {
+
+  crossover->offset = 0;
+  memset( crossover->hist, 0, 2*crossover->taps*sizeof( float ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Copy the history of a section with the same number of taps, so it continues where
+// the source is
+//------------------------------------------------------------------------------------
+void dsp_crossover_copy_state( dsp_crossover_t* crossover, dsp_crossover_t* source ) {
+
+  crossover->offset = source->offset;
+  memcpy( crossover->hist, source->hist, 2*crossover->taps*sizeof( float ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if two sections with the same number of taps have the same history
+//------------------------------------------------------------------------------------
+bool dsp_crossover_same_state( dsp_crossover_t* crossover, dsp_crossover_t* source ) {
+
+  return( crossover->offset == source->offset && memcmp( crossover->hist, source->hist, 2*crossover->taps*sizeof( float ) ) == 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Filter a block in place with the symmetric FIR kernel
+//
+// Samples at the same distance from the centre share a coefficient, so they are
+// added first and each pair only needs one multiply.
+//------------------------------------------------------------------------------------
+void dsp_crossover_process( dsp_crossover_t* crossover, float* buffer, int sample_count ) {
+
+  int           taps;
+  int           half;
+  int           offset;
+  float*        hist;
+  float*        newest;
+  float*        oldest;
+  const float*  coeffs;
+  float         sum0;
+  float         sum1;
+  int           k;
+
+  taps = crossover->taps;
+  half = taps/2;
+  offset = crossover->offset;
+  hist = crossover->hist;
+  coeffs = crossover->coeffs;
+
+  for( int i = 0; i < sample_count; ++ i ) {
+    // Store each sample twice, so the newest taps are always contiguous
+    offset = ( offset == 0 ) ? taps - 1 : offset - 1;
+    hist[offset] = buffer[i];
+    hist[offset + taps] = buffer[i];
+
+    newest = &hist[offset];
+    oldest = &hist[offset + taps - 1];
+
+    // Two partial sums, so the additions do not wait for each other
+    sum0 = coeffs[half]*newest[half];
+    sum1 = 0;
+    for( k = 0; k + 1 < half; k += 2 ) {
+      sum0 += coeffs[k]*( newest[k] + oldest[-k] );
+      sum1 += coeffs[k + 1]*( newest[k + 1] + oldest[-k - 1] );
+    }
+    if( k < half ) {
+      sum0 += coeffs[k]*( newest[k] + oldest[-k] );
+    }
+
+    buffer[i] = sum0 + sum1;
+  }
+
+  crossover->offset = offset;
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the latency of the crossover in samples
+//------------------------------------------------------------------------------------
+int dsp_crossover_latency( dsp_crossover_t* crossover ) {
+
+  return( crossover->taps/2 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the name of the crossover section
+//------------------------------------------------------------------------------------
+const char* dsp_crossover_name( dsp_crossover_t* crossover ) {
+
+  return( section_name[ crossover->crossover_def->section ] );
+}
+
+
+//------------------------------------------------------------------------------------
+// Profile the crossover kernel for the passed number of taps and return the average
+// cycles per block. Uses its own history, so the audio is not affected.
+//------------------------------------------------------------------------------------
+uint32_t dsp_crossover_profile( int taps, int sample_count ) {
+
+  dsp_crossover_t   crossover;
+  float             buffer[ DSP_MAX_SAMPLES ];
+  uint32_t          start;
+  uint32_t          cycles;
+
+  crossover.taps = taps;
+  crossover.coeffs = (float*) calloc( taps/2 + 1, sizeof( float ) );
+  crossover.hist = (float*) malloc( 2*taps*sizeof( float ) );
+
+  if( crossover.coeffs == NULL || crossover.hist == NULL ) {
+    free( crossover.coeffs );
+    free( crossover.hist );
+    return( UINT32_MAX );
+  }
+
+  dsp_crossover_reset( &crossover );
+
+  cycles = 0;
+  for( int block = 0; block < XO_PROFILE_WARMUP + XO_PROFILE_BLOCKS; ++ block ) {
+    for( int i = 0; i < sample_count; ++ i ) {
+      buffer[i] = ( ( block*sample_count + i ) & 0x3F ) - 32;
+    }
+
+    start = dsp_get_cycles();
+    dsp_crossover_process( &crossover, buffer, sample_count );
+
+    if( block >= XO_PROFILE_WARMUP ) {
+      cycles += dsp_get_cycles() - start;
+    }
+  }
+
+  free( crossover.coeffs );
+  free( crossover.hist );
+
+  return( cycles/XO_PROFILE_BLOCKS );
+}
+
+
+//------------------------------------------------------------------------------------
+// Set up the crossover sections of the channels (one per channel)
+//------------------------------------------------------------------------------------
+esp_err_t dsp_crossover_init( dsp_channel_t* channels, const crossover_def_t* crossover_defs, int crossover_def_count ) {
+
+  dsp_data_t*       dsp_data;
+  dsp_crossover_t*  first;
+
+  for( int def_id = 0; def_id < crossover_def_count; ++ def_id ) {
+
+    first = NULL;
+
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+
+      if( crossover_defs[def_id].channel != channel_id && crossover_defs[def_id].channel != DSP_ALL_CHANNELS ) {
+        continue;
+      }
+
+      dsp_data = channels[channel_id].data;
+
+      if( dsp_data->crossover != NULL ) {
+        dsp_printf( "E-DSP: ERROR: More than one crossover for channel '%s'\r\n", channels[channel_id].name );
+        return( ESP_FAIL );
+      }
+
+      // Channels sharing the definition share its coefficients
+      if( first != NULL ) {
+        dsp_data->crossover = dsp_crossover_share( first );
+      } else {
+        dsp_data->crossover = dsp_crossover_create( &crossover_defs[def_id] );
+        first = dsp_data->crossover;
+      }
+      if( dsp_data->crossover == NULL ) {
+        return( ESP_FAIL );
+      }
+    }
+  }
+
+  return( ESP_OK );
+}
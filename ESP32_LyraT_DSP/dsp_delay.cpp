@@ -0,0 +1,185 @@
+#include "dsp_engine.h"
+
+#define DELAY_MIN_FRACTION    0.001               // Fractions closer than this to a whole sample are rounded
+
+
+//------------------------------------------------------------------------------------
+// Set the delay of the channel in milliseconds and clear the delay line
+//
+// The whole samples are delayed in the delay buffer. Any fraction of a sample is
+// delayed by a first order Thiran all-pass filter, which has a flat magnitude and
+// is accurate for delays between 0.5 and 1.5 samples. The all-pass replaces the
+// one sample base latency every channel has, so for fractions below one half it
+// also takes a sample from the delay buffer.
+//
+// The delay buffer holds the delay plus one block, so a block can be stored before
+// the delayed block is read. It is only reallocated when its size changes, using
+// PSRAM if available. Returns ESP_FAIL if the delay is out of range or the buffer
+// can not be allocated.
+//------------------------------------------------------------------------------------
+esp_err_t dsp_set_delay( dsp_channel_t* channel, float delay_millis ) {
+
+  dsp_data_t*       dsp_data;
+  dsp_fraction_t*   fraction;
+  double            delay;
+  double            whole;
+  double            d;
+  int               delay_length;
+
+  if( delay_millis < 0 || delay_millis > DSP_MAX_DELAY_MILLIS ) {
+    dsp_printf( "E-DSP: Invalid delay setting for channel '%s'\r\n", channel->name );
+    return( ESP_FAIL );
+  }
+
+  dsp_data = channel->data;
+  fraction = &dsp_data->fraction;
+
+  delay = (double) delay_millis*DSP_SAMPLE_RATE/1000;
+  whole = floor( delay );
+
+  if( delay - whole > 1 - DELAY_MIN_FRACTION ) {
+    whole += 1;
+  }
+
+  if( delay - whole < DELAY_MIN_FRACTION ) {
+    fraction->fraction = 0;
+    dsp_data->delay_samples = (int) whole + 1;
+  } else {
+    fraction->fraction = delay - whole;
+
+    // All-pass delay between 0.5 and 1.5 samples
+    if( fraction->fraction < 0.5 ) {
+      d = 1 + fraction->fraction;
+      dsp_data->delay_samples = (int) whole;
+    } else {
+      d = fraction->fraction;
+      dsp_data->delay_samples = (int) whole + 1;
+    }
+    fraction->coeff = ( 1 - d )/( 1 + d );
+  }
+
+  delay_length = dsp_data->delay_samples + DSP_MAX_SAMPLES;
+
+  if( dsp_data->delay_buff == NULL || dsp_data->delay_length != delay_length ) {
+    free( dsp_data->delay_buff );
+    dsp_data->delay_buff = (float*) dsp_malloc_large( delay_length*sizeof( float ) );
+    dsp_data->delay_length = delay_length;
+
+    if( dsp_data->delay_buff == NULL ) {
+      dsp_printf( "E-DSP: Unable to allocate %.3f ms delay buffer for channel '%s'\r\n", delay_millis, channel->name );
+      return( ESP_FAIL );
+    }
+  }
+
+  dsp_data->delay_offset = 0;
+  dsp_data->delay_fill = dsp_data->delay_samples;
+  memset( dsp_data->delay_buff, 0, delay_length*sizeof( float ) );
+  fraction->x1 = 0;
+  fraction->y1 = 0;
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Restart the delay line from silence without touching the buffer, so it can be
+// called by the DSP task. The samples still in the buffer are not read again: until
+// a whole delay has been stored, dsp_delay_process outputs zeros in their place.
+//------------------------------------------------------------------------------------
+void dsp_delay_resync( dsp_data_t* dsp_data ) {
+
+  dsp_data->delay_offset = 0;
+  dsp_data->delay_fill = 0;
+  dsp_data->fraction.x1 = 0;
+  dsp_data->fraction.y1 = 0;
+}
+
+
+//------------------------------------------------------------------------------------
+// Delay the block (in place)
+//
+// The block is copied into the delay buffer and the block delay_samples older is
+// copied back out. Each copy is split in two where it wraps around the end of the
+// buffer. Samples older than the last resync are output as zeros.
+//------------------------------------------------------------------------------------
+void dsp_delay_process( dsp_data_t* dsp_data, float* buffer, int sample_count ) {
+
+  float*        delay_buff;
+  int           length;
+  int           offset;
+  int           count;
+  int           stale;
+
+  delay_buff = dsp_data->delay_buff;
+  length = dsp_data->delay_length;
+
+  // Store the block
+  offset = dsp_data->delay_offset;
+  count = ( offset + sample_count > length ) ? length - offset : sample_count;
+  memcpy( &delay_buff[offset], buffer, count*sizeof( float ) );
+  memcpy( delay_buff, &buffer[count], ( sample_count - count )*sizeof( float ) );
+
+  dsp_data->delay_offset = ( offset + sample_count < length ) ? offset + sample_count : offset + sample_count - length;
+
+  // Read the delayed block
+  offset = ( offset >= dsp_data->delay_samples ) ? offset - dsp_data->delay_samples : offset - dsp_data->delay_samples + length;
+  count = ( offset + sample_count > length ) ? length - offset : sample_count;
+  memcpy( buffer, &delay_buff[offset], count*sizeof( float ) );
+  memcpy( &buffer[count], delay_buff, ( sample_count - count )*sizeof( float ) );
+
+  // Silence until a whole delay has been stored since the resync
+  if( dsp_data->delay_fill < dsp_data->delay_samples ) {
+    stale = dsp_data->delay_samples - dsp_data->delay_fill;
+    memset( buffer, 0, ( stale < sample_count ? stale : sample_count )*sizeof( float ) );
+    dsp_data->delay_fill = ( stale > sample_count ) ? dsp_data->delay_fill + sample_count : dsp_data->delay_samples;
+  }
+
+  // Delay by the fraction of a sample
+  if( dsp_data->fraction.fraction > 0 ) {
+    dsp_fraction_process( &dsp_data->fraction, buffer, sample_count );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Delay the block by the fraction of a sample (in place)
+//------------------------------------------------------------------------------------
+void dsp_fraction_process( dsp_fraction_t* fraction, float* buffer, int sample_count ) {
+
+  float         coeff;
+  float         x0;
+  float         x1;
+  float         y1;
+
+  coeff = fraction->coeff;
+  x1 = fraction->x1;
+  y1 = fraction->y1;
+
+  // y[n] = a*x[n] + x[n-1] - a*y[n-1]
+  for( int i = 0; i < sample_count; ++ i ) {
+    x0 = buffer[i];
+    y1 = coeff*( x0 - y1 ) + x1;
+    x1 = x0;
+    buffer[i] = y1;
+  }
+
+  fraction->x1 = x1;
+  fraction->y1 = y1;
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the delay of the channel in samples, including the fraction
+//------------------------------------------------------------------------------------
+float dsp_delay_samples( dsp_data_t* dsp_data ) {
+
+  float         fraction;
+
+  // Without the fraction, one sample of the delay buffer is the base latency
+  fraction = dsp_data->fraction.fraction;
+  if( fraction > 0 && fraction < 0.5 ) {
+    return( dsp_data->delay_samples + fraction );
+  }
+
+  return( dsp_data->delay_samples - 1 + fraction );
+}
@@ -0,0 +1,240 @@
+#ifndef DSP_DESIGN_H
+#define DSP_DESIGN_H
+
+#include "dsp_engine.h"
+
+// Compile-time design and checking of the filter tables in dsp_config.h
+//
+// All functions are C++11 constexpr (a single return statement each), so loops are
+// recursions. The math follows dsp_get_biquad_rate(), with sin, cos, exp and sqrt
+// replaced by series and Newton iterations that agree with the library functions
+// to about one unit in the last place of a double.
+
+#define DSP_DESIGN_PI           3.14159265358979323846
+#define DSP_DESIGN_LN10         2.30258509299404568402
+#define DSP_DESIGN_SQRT2        1.41421356237309504880
+#define DSP_DESIGN_TERMS        12                // Series terms of sin and cos for |x| <= pi/4
+
+#define DSP_COUNT( defs )       ( sizeof( defs )/sizeof( defs[0] ) )
+
+
+//------------------------------------------------------------------------------------
+// Math
+//------------------------------------------------------------------------------------
+
+// Taylor series of sin (term = x) and cos (term = 1), summed from the smallest term
+constexpr double dsp_design_series( double x2, double term, int k, int n ) {
+  return( n == DSP_DESIGN_TERMS ? term : term + dsp_design_series( x2, -term*x2/( ( k + 1 )*( k + 2 ) ), k + 2, n + 1 ) );
+}
+
+constexpr double dsp_design_sin( double x );
+
+// cos of x in [0, pi]
+constexpr double dsp_design_cos( double x ) {
+  return( x > DSP_DESIGN_PI/2 ? -dsp_design_cos( DSP_DESIGN_PI - x ) :
+          x > DSP_DESIGN_PI/4 ? dsp_design_sin( DSP_DESIGN_PI/2 - x ) :
+          dsp_design_series( x*x, 1, 0, 0 ) );
+}
+
+// sin of x in [0, pi]
+constexpr double dsp_design_sin( double x ) {
+  return( x > DSP_DESIGN_PI/2 ? dsp_design_sin( DSP_DESIGN_PI - x ) :
+          x > DSP_DESIGN_PI/4 ? dsp_design_cos( DSP_DESIGN_PI/2 - x ) :
+          dsp_design_series( x*x, x, 1, 0 ) );
+}
+
+constexpr double dsp_design_square( double x ) {
+  return( x*x );
+}
+
+// exp by halving the argument until the series converges fast, then squaring back
+constexpr double dsp_design_exp( double x ) {
+  return( x > 0.0625 || x < -0.0625 ? dsp_design_square( dsp_design_exp( x/2 ) ) :
+          1 + x*( 1 + x/2*( 1 + x/3*( 1 + x/4*( 1 + x/5*( 1 + x/6*( 1 + x/7*( 1 + x/8 ) ) ) ) ) ) ) );
+}
+
+// Newton iteration for sqrt, starting above the root and stopping when it no longer decreases
+constexpr double dsp_design_sqrt_from( double a, double x );
+
+constexpr double dsp_design_sqrt_step( double a, double x, double next ) {
+  return( next < x ? dsp_design_sqrt_from( a, next ) : x );
+}
+
+constexpr double dsp_design_sqrt_from( double a, double x ) {
+  return( dsp_design_sqrt_step( a, x, ( x + a/x )/2 ) );
+}
+
+constexpr double dsp_design_sqrt( double a ) {
+  return( a <= 0 ? 0 : dsp_design_sqrt_from( a, ( a + 1 )/2 ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Biquad design
+//------------------------------------------------------------------------------------
+
+// Normalize the biquad values
+constexpr biquad_def_t dsp_design_normalize( const filter_def_t& def, double b0, double b1, double b2, double a0, double a1, double a2 ) {
+  return( biquad_def_t{ def.channel, { b0/a0, b1/a0, b2/a0, a1/a0, a2/a0 }
+#ifdef DOUBLE_PRECISION
+    , def.precision
+#endif
+  } );
+}
+
+constexpr biquad_def_t dsp_design_type( const filter_def_t& def, double A, double sqrt_A, double C, double alpha ) {
+  return(
+    def.filter_type == DSP_FILTER_LOW_PASS ?
+      dsp_design_normalize( def, (1 - C)/2, 1 - C, (1 - C)/2, 1 + alpha, 2*C, -(1 - alpha) ) :
+    def.filter_type == DSP_FILTER_HIGH_PASS ?
+      dsp_design_normalize( def, (1 + C)/2, -(1 + C), (1 + C)/2, 1 + alpha, 2*C, -(1 - alpha) ) :
+    def.filter_type == DSP_FILTER_BAND_PASS ?
+      dsp_design_normalize( def, alpha, 0, -alpha, 1 + alpha, 2*C, -(1 - alpha) ) :
+    def.filter_type == DSP_FILTER_NOTCH ?
+      dsp_design_normalize( def, 1, -2*C, 1, 1 + alpha, 2*C, -(1 - alpha) ) :
+    def.filter_type == DSP_FILTER_APF ?
+      dsp_design_normalize( def, 1 - alpha, -2*C, 1 + alpha, 1 + alpha, 2*C, -(1 - alpha) ) :
+    def.filter_type == DSP_FILTER_PEAK_EQ ?
+      dsp_design_normalize( def, 1 + alpha*A, -2*C, 1 - alpha*A, 1 + alpha/A, 2*C, -(1 - alpha/A) ) :
+    def.filter_type == DSP_FILTER_LOW_SHELF ?
+      dsp_design_normalize( def,
+          A*( (A+1) - (A-1)*C + 2*sqrt_A*alpha ),
+        2*A*( (A-1) - (A+1)*C ),
+          A*( (A+1) - (A-1)*C - 2*sqrt_A*alpha ),
+              (A+1) + (A-1)*C + 2*sqrt_A*alpha,
+          2*( (A-1) + (A+1)*C ),
+           -( (A+1) + (A-1)*C - 2*sqrt_A*alpha ) ) :
+      // High shelf, other types fail dsp_design_check_filters()
+      dsp_design_normalize( def,
+          A*( (A+1) + (A-1)*C + 2*sqrt_A*alpha ),
+       -2*A*( (A-1) + (A+1)*C ),
+          A*( (A+1) + (A-1)*C - 2*sqrt_A*alpha ),
+              (A+1) - (A-1)*C + 2*sqrt_A*alpha,
+         -2*( (A-1) - (A+1)*C ),
+           -( (A+1) - (A-1)*C - 2*sqrt_A*alpha ) ) );
+}
+
+constexpr biquad_def_t dsp_design_w0( const filter_def_t& def, double W0, double A ) {
+  return( dsp_design_type( def, A, dsp_design_sqrt( A ), dsp_design_cos( W0 ), dsp_design_sin( W0 )/( 2*def.Q ) ) );
+}
+
+// Biquad of a frequency specified filter, as dsp_get_biquad_rate() calculates it
+constexpr biquad_def_t dsp_design_biquad( const filter_def_t& def, double sample_rate ) {
+  return( dsp_design_w0( def, ( 2*DSP_DESIGN_PI*def.frequency )/sample_rate, dsp_design_exp( def.gain/40.0*DSP_DESIGN_LN10 ) ) );
+}
+
+// Index list 0..N-1 to expand a table element by element
+template<int... I> struct dsp_design_index {};
+
+template<int N, int... I> struct dsp_design_make_index : dsp_design_make_index<N - 1, N - 1, I...> {};
+
+template<int... I> struct dsp_design_make_index<0, I...> : dsp_design_index<I...> {};
+
+// Biquads of a filter table (one element when empty, as arrays can not be empty)
+template<int N> struct dsp_design_table {
+  biquad_def_t  biquad[ N > 0 ? N : 1 ];
+};
+
+template<int... I>
+constexpr dsp_design_table<sizeof...( I )> dsp_design_filters( const filter_def_t* filter_defs, dsp_design_index<I...> ) {
+  return( dsp_design_table<sizeof...( I )>{ { dsp_design_biquad( filter_defs[I], DSP_SAMPLE_RATE )... } } );
+}
+
+
+//------------------------------------------------------------------------------------
+// Table checks (halving the tables keeps the recursion shallow)
+//------------------------------------------------------------------------------------
+
+constexpr bool dsp_design_check_channel( int channel ) {
+  return( channel == DSP_ALL_CHANNELS || ( channel >= 0 && channel < DSP_NUM_CHANNELS ) );
+}
+
+constexpr bool dsp_design_check_filter( const filter_def_t& def ) {
+  return( dsp_design_check_channel( def.channel ) &&
+          def.filter_type >= DSP_FILTER_LOW_PASS && def.filter_type <= DSP_FILTER_HIGH_SHELF &&
+          def.frequency > 0 && def.frequency < DSP_SAMPLE_RATE/2 && def.Q > 0 );
+}
+
+// Valid channel, type, frequency and Q of all filters
+constexpr bool dsp_design_check_filters( const filter_def_t* defs, int count ) {
+  return( count == 0 ? true :
+          count == 1 ? dsp_design_check_filter( defs[0] ) :
+          dsp_design_check_filters( defs, count/2 ) && dsp_design_check_filters( defs + count/2, count - count/2 ) );
+}
+
+constexpr bool dsp_design_check_biquads( const biquad_def_t* defs, int count ) {
+  return( count == 0 ? true :
+          count == 1 ? dsp_design_check_channel( defs[0].channel ) :
+          dsp_design_check_biquads( defs, count/2 ) && dsp_design_check_biquads( defs + count/2, count - count/2 ) );
+}
+
+constexpr bool dsp_design_check_crossover( const crossover_def_t& def ) {
+  return( dsp_design_check_channel( def.channel ) &&
+          def.section >= DSP_CROSSOVER_LOW_PASS && def.section <= DSP_CROSSOVER_BAND_PASS &&
+          def.slope >= DSP_XO_MIN_SLOPE && def.slope <= DSP_XO_MAX_SLOPE &&
+          def.frequency > 0 && def.frequency*DSP_DESIGN_SQRT2 < DSP_SAMPLE_RATE/2 &&
+          ( def.section != DSP_CROSSOVER_BAND_PASS ||
+            ( def.frequency_high > def.frequency && def.frequency_high*DSP_DESIGN_SQRT2 < DSP_SAMPLE_RATE/2 ) ) );
+}
+
+// Valid section, slope and frequencies of all crossovers
+constexpr bool dsp_design_check_crossovers( const crossover_def_t* defs, int count ) {
+  return( count == 0 ? true :
+          count == 1 ? dsp_design_check_crossover( defs[0] ) :
+          dsp_design_check_crossovers( defs, count/2 ) && dsp_design_check_crossovers( defs + count/2, count - count/2 ) );
+}
+
+// Number of entries applying to the channel, including those for all channels
+constexpr int dsp_design_count_filters( const filter_def_t* defs, int count, int channel ) {
+  return( count == 0 ? 0 :
+          count == 1 ? ( defs[0].channel == channel || defs[0].channel == DSP_ALL_CHANNELS ) :
+          dsp_design_count_filters( defs, count/2, channel ) + dsp_design_count_filters( defs + count/2, count - count/2, channel ) );
+}
+
+constexpr int dsp_design_count_biquads( const biquad_def_t* defs, int count, int channel ) {
+  return( count == 0 ? 0 :
+          count == 1 ? ( defs[0].channel == channel || defs[0].channel == DSP_ALL_CHANNELS ) :
+          dsp_design_count_biquads( defs, count/2, channel ) + dsp_design_count_biquads( defs + count/2, count - count/2, channel ) );
+}
+
+constexpr int dsp_design_count_crossovers( const crossover_def_t* defs, int count, int channel ) {
+  return( count == 0 ? 0 :
+          count == 1 ? ( defs[0].channel == channel || defs[0].channel == DSP_ALL_CHANNELS ) :
+          dsp_design_count_crossovers( defs, count/2, channel ) + dsp_design_count_crossovers( defs + count/2, count - count/2, channel ) );
+}
+
+// At most DSP_MAX_FILTERS biquads per channel (imported filters are checked when loaded)
+constexpr bool dsp_design_check_counts( const filter_def_t* filter_defs, int filter_count, const biquad_def_t* biquad_defs, int biquad_count, int channel = 0 ) {
+  return( channel == DSP_NUM_CHANNELS ? true :
+          dsp_design_count_filters( filter_defs, filter_count, channel ) + dsp_design_count_biquads( biquad_defs, biquad_count, channel ) <= DSP_MAX_FILTERS &&
+          dsp_design_check_counts( filter_defs, filter_count, biquad_defs, biquad_count, channel + 1 ) );
+}
+
+// At most one crossover section per channel
+constexpr bool dsp_design_check_crossover_counts( const crossover_def_t* defs, int count, int channel = 0 ) {
+  return( channel == DSP_NUM_CHANNELS ? true :
+          dsp_design_count_crossovers( defs, count, channel ) <= 1 && dsp_design_check_crossover_counts( defs, count, channel + 1 ) );
+}
+
+// Valid ceiling, attack and release of all limiters
+constexpr bool dsp_design_check_limiter( const limiter_def_t& def ) {
+  return( dsp_design_check_channel( def.channel ) &&
+          def.ceiling_dB >= DSP_LIMIT_MIN_CEILING_DB && def.ceiling_dB <= 0 &&
+          def.attack_millis >= 0 && def.attack_millis <= DSP_LIMIT_MAX_ATTACK_MS &&
+          def.release_millis > 0 && def.release_millis <= DSP_LIMIT_MAX_RELEASE_MS );
+}
+
+constexpr bool dsp_design_check_limiters( const limiter_def_t* defs, int count ) {
+  return( count == 0 ? true :
+          count == 1 ? dsp_design_check_limiter( defs[0] ) :
+          dsp_design_check_limiters( defs, count/2 ) && dsp_design_check_limiters( defs + count/2, count - count/2 ) );
+}
+
+// Valid channel and type of all graph nodes. The order is checked at load time.
+constexpr bool dsp_design_check_nodes( const node_def_t* defs, int count ) {
+  return( count == 0 ? true :
+          count == 1 ? dsp_design_check_channel( defs[0].channel ) && defs[0].node_type >= 0 && defs[0].node_type < DSP_NUM_NODE_TYPES :
+          dsp_design_check_nodes( defs, count/2 ) && dsp_design_check_nodes( defs + count/2, count - count/2 ) );
+}
+
+#endif
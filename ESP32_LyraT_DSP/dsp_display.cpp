@@ -20,6 +20,8 @@ Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire );
 #define       BAR_SPACER            1
 #define       BAR_SECTION_SPACER    3
 #define       BAR_CLIPPING_OFFSET   4
+#define       BAR_REDUCTION_HEIGHT  2
+#define       BAR_REDUCTION_DB      12      // Limiter gain reduction shown by the full bar width
 //#define     BAR_DB_SCALE  
 
 #define       IND_SYMBOL_X          122
@@ -46,6 +48,8 @@ static int    disp_output_peak[DSP_NUM_CHANNELS] = {0,0};
 static int    disp_input_clip_count[DSP_NUM_CHANNELS] = {0,0};
 static int    disp_output_clip_count[DSP_NUM_CHANNELS] = {0,0};
 
+static float  disp_output_reduction[DSP_NUM_CHANNELS] = {0,0};
+
 static unsigned long peak_start;
 static unsigned long ind_start;
 static bool     ind_blink_flag; 
@@ -138,10 +142,11 @@ void dsp_display_input( int channel_id, sample_t level, int clip_count ) {
 //------------------------------------------------------------------------------------ 
 // Set the output level for the display
 //------------------------------------------------------------------------------------
-void dsp_display_output( int channel_id, sample_t level, int clip_count ) {
+void dsp_display_output( int channel_id, sample_t level, int clip_count, float reduction_dB ) {
   
   disp_output_level[channel_id] = level;
   disp_output_clip_count[channel_id] = clip_count;
+  disp_output_reduction[channel_id] = reduction_dB;
 }
 
 
@@ -259,6 +264,11 @@ void dsp_display_loop() {
     // Display peak bar
     display.fillRect( OUTPUT_BAR_X + disp_output_peak[channel_id] - 1, OUTPUT_BAR_Y + channel_id*(BAR_HEIGHT + BAR_SPACER), BAR_PEAK_WIDTH, BAR_HEIGHT, WHITE );  
 
+    // Display the limiter gain reduction as a line growing from the right end of the bar
+    bar_width = min( (int) ( disp_output_reduction[channel_id]*BAR_MAX_WIDTH/BAR_REDUCTION_DB ), BAR_MAX_WIDTH );
+    display.fillRect( OUTPUT_BAR_X + BAR_MAX_WIDTH - bar_width, OUTPUT_BAR_Y + channel_id*(BAR_HEIGHT + BAR_SPACER) + BAR_HEIGHT - BAR_REDUCTION_HEIGHT,
+      bar_width, BAR_REDUCTION_HEIGHT, INVERSE );
+
     // Display clip counts
     display.setCursor( OUTPUT_BAR_X + BAR_MAX_WIDTH + BAR_CLIPPING_OFFSET, OUTPUT_BAR_Y + channel_id*(BAR_HEIGHT + BAR_SPACER) );
     display.write( i_to_a4( disp_output_clip_count[channel_id], text, 4 ) );
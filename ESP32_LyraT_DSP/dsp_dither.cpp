@@ -1,32 +1,107 @@
-#include "dsp_process.h"
+#include "dsp_engine.h"
 
-#define NOISE_MASK    ((1 << DITHER_BITS) - 1)
-  
-uint32_t              u = 10, v = 99;
+#define DITHER_STEP     ( (float) ( 1 << DITHER_BITS ) )  // Output quantization step in sample units
+#define DITHER_ROUND    12582912.0f               // 1.5*2^23, adding and subtracting it rounds to an integer
+
+// Error feedback coefficients per noise shaping order: the noise transfer function is
+// 1 - h1*z^-1 - h2*z^-2, so flat, (1 - z^-1) or (1 - z^-1)^2
+static const float    shaping_h1[] = { 0.0f, 1.0f, 2.0f };
+static const float    shaping_h2[] = { 0.0f, 0.0f, -1.0f };
+
+static float          Dither_Noise[DSP_MAX_SAMPLES];
+
+static_assert( DITHER_SHAPING >= 0 && DITHER_SHAPING <= 2, "DITHER_SHAPING must be 0, 1 or 2" );
+
+
+//------------------------------------------------------------------------------------
+// Counter-based random number generator, a 32-bit integer hash of the sample counter.
+// Every value is computed on its own, so a block of noise has no dependency chain.
+//------------------------------------------------------------------------------------
+static inline uint32_t dsp_dither_hash( uint32_t x ) {
+
+  x ^= x >> 16;
+  x *= 0x7FEB352D;
+  x ^= x >> 15;
+  x *= 0x846CA68B;
+  x ^= x >> 16;
+
+  return( x );
+}
 
 
-//------------------------------------------------------------------------------------ 
-// 32-bit random number generator
 //------------------------------------------------------------------------------------
-static int dsp_rand() {
+// Fill a block with TPDF noise between -1 and +1 steps. The two uniform values added
+// for each sample are the 16-bit halves of one hash.
+//------------------------------------------------------------------------------------
+static void dsp_dither_fill( dsp_dither_t* dither, float* noise, int sample_count ) {
 
-  int     rnd;
+  uint32_t          counter;
+  uint32_t          key;
+  uint32_t          rnd;
 
-  v = 36969*(v & 65535) + (v >> 16);
-  u = 18000*(u & 65535) + (u >> 16);
+  counter = dither->counter;
+  key = dither->key;
 
-  rnd = u & NOISE_MASK;
-  if( rnd > (NOISE_MASK+1) >> 1 ) {
-    rnd = -rnd;
+  for( int i = 0; i < sample_count; ++ i ) {
+    rnd = dsp_dither_hash( ( counter + i ) ^ key );
+    noise[i] = ( (float) (int32_t) ( ( rnd & 0xFFFF ) + ( rnd >> 16 ) ) - 65535.0f )*( 1.0f/65536.0f );
   }
-  
-  return( rnd );
+
+  dither->counter = counter + sample_count;
+}
+
+
+//------------------------------------------------------------------------------------
+// Restart the noise and the noise shaping of a channel
+//------------------------------------------------------------------------------------
+void dsp_dither_reset( dsp_dither_t* dither ) {
+
+  dither->counter = 0;
+  dither->error[0] = 0;
+  dither->error[1] = 0;
+}
+
+
+//------------------------------------------------------------------------------------
+// Set up the dither of a channel with its own noise sequence
+//------------------------------------------------------------------------------------
+void dsp_dither_init( dsp_dither_t* dither, int channel_id ) {
+
+  dither->key = dsp_dither_hash( 0x9E3779B9 * ( channel_id + 1 ) );
+  dsp_dither_reset( dither );
 }
 
-//------------------------------------------------------------------------------------ 
-// Add dither to the output to reduce noise impact
+
+//------------------------------------------------------------------------------------
+// Dither a block in place and quantize it to DITHER_RANGE_DB. The noise of the whole
+// block is generated first, then the quantization errors are fed back through the
+// noise shaping filter selected by DITHER_SHAPING.
 //------------------------------------------------------------------------------------
-int32_t dsp_dither( int32_t sample ) {
+void dsp_dither_process( dsp_dither_t* dither, float* buffer, int sample_count ) {
+
+  const float       h1 = shaping_h1[ DITHER_SHAPING ];
+  const float       h2 = shaping_h2[ DITHER_SHAPING ];
+  float             e1;
+  float             e2;
+  float             w;
+  float             r;
+  float             y;
+
+  dsp_dither_fill( dither, Dither_Noise, sample_count );
+
+  e1 = dither->error[0];
+  e2 = dither->error[1];
+
+  for( int i = 0; i < sample_count; ++ i ) {
+    w = buffer[i]*( 1.0f/DITHER_STEP ) - h1*e1 - h2*e2;
+    r = w + Dither_Noise[i];
+    y = ( r + DITHER_ROUND ) - DITHER_ROUND;
+
+    e2 = e1;
+    e1 = y - w;
+    buffer[i] = y*DITHER_STEP;
+  }
 
-  return( ((sample >> DITHER_BITS) << DITHER_BITS) + dsp_rand() );
+  dither->error[0] = e1;
+  dither->error[1] = e2;
 }
@@ -0,0 +1,505 @@
+#ifndef DSP_ENGINE_H
+#define DSP_ENGINE_H
+
+//#define DAC_24_BIT
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined( ARDUINO ) || defined( ESP_PLATFORM )
+#include <esp_err.h>
+#else
+#define DSP_HOST_BUILD
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_INVALID_STATE   0x103
+#endif
+
+
+//------------------------------------------------------------------------------------
+// Constant definitions
+//------------------------------------------------------------------------------------
+
+#define PRC_AUTO                -1                // Select the precision from the noise estimate
+#define PRC_FLT                 0                 // Set filter precision to float
+#define PRC_DBL                 1                 // Set filter precision to double
+#define PRC_TDF2                2                 // Transposed DF-II with double precision state
+#define PRC_DF1_EF              3                 // DF-I in float with first-order error feedback
+#define PRC_Q31                 4                 // DF-I in Q31 fixed point with a 64-bit accumulator
+#define PRC_Q15                 5                 // DF-I with Q15 coefficients and a 32-bit accumulator (16-bit build, else Q31)
+
+#ifndef DSP_NOISE_TARGET_DB
+#define DSP_NOISE_TARGET_DB     (-6.02*SAMPLE_BITS - 12)  // Max estimated filter noise (dBFS) for PRC_AUTO
+#endif
+#define DSP_NOISE_REF_LEVEL     0.125             // Amplitude of each tone of the noise estimate signal (-18 dBFS)
+#define DSP_NOISE_REF_LOW_HZ    30.0              // Low tone, where low frequency poles amplify the errors
+#define DSP_NOISE_REF_HIGH_HZ   1000.0            // Mid band tone
+#ifdef DAC_24_BIT
+#define DSP_PRECISION_COST      { PRC_FLT, PRC_DF1_EF, PRC_Q31, PRC_DBL, PRC_TDF2 }  // Kernels by cost on the ESP32
+#else
+#define DSP_PRECISION_COST      { PRC_FLT, PRC_DF1_EF, PRC_Q15, PRC_Q31, PRC_DBL, PRC_TDF2 }
+#endif
+
+#define DSP_ALL_CHANNELS        -1                // Specify all channels processed
+#define DSP_NUM_CHANNELS        2                 // Number of channels
+#define DSP_MAX_FILTERS         20                // Max number of biquad filters
+#define DSP_SAMPLE_RATE         44100             // The sample rate
+#define DSP_MAX_GAIN            24                // Maximum gain for the channel
+#define DSP_MAX_SAMPLES         96                // Maximum number of samples per channel each loop
+#define DSP_MAX_DELAY_MILLIS    2000              // Maximum delay allowed in milliseconds
+#define DSP_DELAY_PSRAM         true              // Place delay buffers in PSRAM when the board has it
+#define DSP_BLOCK_SAMPLES       DSP_MAX_SAMPLES   // Default I2S block size in samples (all channels interleaved)
+#define DSP_BLOCK_BUDGET        70                // Share of the block period (%) the profiled filters may use
+
+#ifdef DSP_HOST_BUILD
+#define DSP_CPU_MHZ             1000              // Host cycles are counted in nanoseconds
+#else
+#define DSP_CPU_MHZ             240               // ESP32 CPU clock
+#endif
+
+#define DSP_MULTIRATE_TAPS_PHASE 12               // Decimation/interpolation FIR taps per step of the decimation factor (multiple of 4)
+#define DSP_MULTIRATE_TAPS_MAX  (16*DSP_MULTIRATE_TAPS_PHASE)   // FIR taps for the largest decimation factor
+
+#define DSP_FIR_PARTITION       (DSP_MAX_SAMPLES/DSP_NUM_CHANNELS)  // FIR partition length (one block of the default block size)
+#define DSP_FIR_FFT_SIZE        ( DSP_FIR_PARTITION <= 32 ? 64 : DSP_FIR_PARTITION <= 64 ? 128 : DSP_FIR_PARTITION <= 128 ? 256 : 512 )  // FFT size of the FIR convolution (smallest power of two of at least twice the partition length)
+#define DSP_FIR_MAX_TAPS        2048              // Max FIR taps per channel
+
+#define DSP_XO_MAX_TAPS         2047              // Max taps of a linear-phase crossover section
+#define DSP_XO_MIN_SLOPE        12                // Crossover slope range in dB per octave
+#define DSP_XO_MAX_SLOPE        96
+
+#define DSP_LIMIT_CEILING_DB    -0.1              // Default limiter ceiling in dBFS
+#define DSP_LIMIT_ATTACK_MS     0.0               // Default limiter look-ahead and attack time (none, so no added latency)
+#define DSP_LIMIT_RELEASE_MS    50.0              // Default limiter release time constant
+#define DSP_LIMIT_MIN_CEILING_DB -24              // Limiter setting ranges
+#define DSP_LIMIT_MAX_ATTACK_MS 5
+#define DSP_LIMIT_MAX_RELEASE_MS 2000
+
+#define DSP_KERNEL_FILTER       0                 // Run each biquad over the whole block in turn
+#define DSP_KERNEL_CASCADE      1                 // Run the whole biquad chain sample by sample
+#define DSP_KERNEL_PAIRED       2                 // Run the chains of two channels sample by sample together
+#define DSP_KERNEL_DEFAULT      DSP_KERNEL_FILTER // Kernel used at startup (change only after measuring on the ESP32)
+#define DSP_FUSE_OUTPUT_DEFAULT false             // Run gain, limiter and output meter in a row as one step at startup (slower on the host)
+
+#define DSP_TRANSITION_NONE     0                 // Switch to updated filters at the next block
+#define DSP_TRANSITION_CROSSFADE 1                // Run old and new filters together and crossfade the outputs
+#define DSP_TRANSITION_INTERPOLATE 2              // Interpolate the coefficients keeping the filter state
+#define DSP_TRANSITION_DEFAULT  DSP_TRANSITION_CROSSFADE
+#define DSP_TRANSITION_BLOCKS   20                // Default transition length in blocks (about 22 ms at 48 samples)
+
+#define DSP_FILTER_LOW_PASS     0
+#define DSP_FILTER_HIGH_PASS    1
+#define DSP_FILTER_BAND_PASS    2
+#define DSP_FILTER_NOTCH        3
+#define DSP_FILTER_APF          4
+#define DSP_FILTER_PEAK_EQ      5
+#define DSP_FILTER_LOW_SHELF    6
+#define DSP_FILTER_HIGH_SHELF   7
+
+#define DSP_CROSSOVER_LOW_PASS  0                 // Linear-phase crossover sections
+#define DSP_CROSSOVER_HIGH_PASS 1
+#define DSP_CROSSOVER_BAND_PASS 2
+
+#define DSP_NODE_MIX            0                 // Processing graph nodes (see dsp_graph.cpp)
+#define DSP_NODE_METER          1
+#define DSP_NODE_DELAY          2
+#define DSP_NODE_BIQUADS        3
+#define DSP_NODE_CROSSOVER      4
+#define DSP_NODE_FIR            5
+#define DSP_NODE_GAIN           6
+#define DSP_NODE_LIMIT          7
+#define DSP_NODE_DITHER         8
+#define DSP_NUM_NODE_TYPES      9
+#define DSP_MAX_NODES           12                // Max nodes in the graph of a channel
+
+#ifdef DAC_24_BIT
+typedef int32_t    sample_t;
+#define SAMPLE_BITS             24
+#else
+typedef int16_t    sample_t;
+#define SAMPLE_BITS             16
+#endif
+
+#define SAMPLE_NULL_BITS        (sizeof(sample_t)*8 - SAMPLE_BITS)
+
+#define DSP_Q31_SHIFT           (31 - SAMPLE_BITS - 3)    // Fraction bits of the PRC_Q31 samples (18 dB headroom)
+#define DSP_Q15_SHIFT           4                 // Fraction bits of the PRC_Q15 samples
+#define DSP_Q31_MAX_SHIFT       8                 // Max post shift of the fixed-point coefficients (|c| < 256)
+
+#define DSP_MAX_LEVEL           ((1 << (SAMPLE_BITS - 1)) - 1)
+
+#define STATS_ON                1                 // Collect per stage cycle counts (see dsp_stats_info)
+
+#define DSP_STAGE_READ          0                 // Waiting for and reading the I2S input
+#define DSP_STAGE_INPUT         1                 // Mixing, delay and conversion to float
+#define DSP_STAGE_FILTERS       2                 // Biquad filters
+#define DSP_STAGE_OUTPUT        3                 // Gain, limiter, dither and conversion to samples
+#define DSP_STAGE_WRITE         4                 // Writing the I2S output
+#define DSP_NUM_STAGES          5
+
+#define DSP_STREAM_READ_TIMEOUT 0                 // i2s_read failed or returned a short block
+#define DSP_STREAM_WRITE_TIMEOUT 1                // i2s_write failed or wrote a short block
+#define DSP_STREAM_RX_OVERFLOW  2                 // Input DMA buffers overwritten before they were read
+#define DSP_STREAM_TX_UNDERFLOW 3                 // Output DMA ran out of samples
+#define DSP_STREAM_DMA_ERROR    4                 // DMA descriptor error
+#define DSP_STREAM_RESYNC       5                 // Delay lines and filter state resynchronized
+#define DSP_STREAM_RESTART      6                 // I2S driver reinstalled
+#define DSP_NUM_STREAM_EVENTS   7
+
+#define DITHER_ON               ( SAMPLE_BITS == 16 )     // Dither the output by default in the 16-bit build
+#define DITHER_RANGE_DB         96
+#define DITHER_BITS             (SAMPLE_BITS - DITHER_RANGE_DB/6)
+
+#ifndef DITHER_SHAPING
+#define DITHER_SHAPING          1                 // Noise shaping order of the dither (0 = flat TPDF, 1 or 2)
+#endif
+
+//------------------------------------------------------------------------------------
+// Type definitions
+//------------------------------------------------------------------------------------
+
+typedef struct filter_def_t {
+  int           channel;                          // Filter channel
+  int           filter_type;                      // Type of filter to apply
+  float         frequency;                        // Centre frequency of filter
+  double        Q;                                // Q value
+  float         gain;                             // Gain value in dB
+#ifdef DOUBLE_PRECISION
+  int           precision;                        // Implement as float or double
+#endif
+} filter_def_t;
+
+typedef struct biquad_def_t {
+  int           channel;                          // Associated channel
+  double        coeffs[5];                        // Biquad coefficients
+#ifdef DOUBLE_PRECISION
+  int           precision;                        // Implement as float or double
+#endif
+} biquad_def_t;
+
+typedef struct fir_def_t {
+  int           channel;                          // Associated channel
+  int           tap_count;                        // Number of FIR taps
+  float*        taps;                             // FIR impulse response
+} fir_def_t;
+
+typedef struct crossover_def_t {
+  int           channel;                          // Crossover channel
+  int           section;                          // Low, high or band pass section
+  float         frequency;                        // Crossover frequency (lower one of a band pass)
+  float         frequency_high;                   // Upper crossover frequency of a band pass
+  int           slope;                            // Slope in dB per octave
+} crossover_def_t;
+
+typedef struct limiter_def_t {
+  int           channel;                          // Limited channel
+  float         ceiling_dB;                       // Highest output level in dBFS
+  float         attack_millis;                    // Look-ahead, the time the gain takes to come down before a peak
+  float         release_millis;                   // Time constant of the gain recovery after a peak
+} limiter_def_t;
+
+typedef struct node_def_t {
+  int           channel;                          // Node channel
+  int           node_type;                        // Type of node, listed in signal order per channel
+} node_def_t;
+
+typedef union dsp_biquad_state_t {
+  float         w[2];                             // Historic W values (PRC_FLT, PRC_DBL)
+  double        w_d[2];                           // Transposed DF-II state values (PRC_TDF2)
+  float         w_ef[5];                          // DF-I history and error feedback values (PRC_DF1_EF)
+  int32_t       w_q[5];                           // DF-I history and error feedback values (PRC_Q31, PRC_Q15)
+} dsp_biquad_state_t;
+
+typedef struct dsp_filter_t {
+  double        coeffs_d[5];                      // The biquad coefficients for each of the filters (double precision)
+  union {
+    float       coeffs_f[5];                      // The biquad coefficients as floats (PRC_FLT)
+    int32_t     coeffs_q[6];                      // Q31 coefficients scaled by 2^-coeffs_q[5] (PRC_Q31, PRC_Q15)
+  };
+  dsp_biquad_state_t state;                       // Filter state in the layout of the precision
+  int           precision;                        // Precision calculation, selects the coefficient and state layout
+  bool          precision_auto;                   // Precision selected from the noise estimate
+  const filter_def_t* filter_def;                 // Associated frequency defined filter
+} dsp_filter_t;
+
+typedef struct dsp_bank_t {
+  dsp_filter_t  filter[DSP_MAX_FILTERS];          // Filters for channel
+  int           num_filters;                      // Total number of filters in the channel
+  int           share;                            // Earlier channel with the same input and filters (-1 = none)
+} dsp_bank_t;
+
+typedef struct dsp_multirate_t {
+  int           factor;                           // Decimation factor (1 = full rate)
+  int           taps;                             // Number of FIR taps
+  int           phase;                            // Samples since the last reduced rate sample
+  const float*  fir;                              // Decimation FIR coefficients
+  const float*  poly;                             // Interpolation FIR coefficients by phase
+  int           dec_offset;                       // Newest sample in the decimation history
+  int           int_offset;                       // Newest sample in the interpolation history
+  float*        dec_hist;                         // Decimation input history (stored twice, owns the allocation)
+  float*        int_hist;                         // Interpolation input history (stored twice)
+} dsp_multirate_t;
+
+typedef struct dsp_fir_t {
+  float*        taps;                             // Impulse response of the FIR
+  int           tap_count;                        // Number of FIR taps
+  int           partitions;                       // Number of filter partitions of DSP_FIR_PARTITION taps
+  int           newest;                           // Delay line slot of the newest input spectrum
+  int           fill;                             // Samples collected for the next partition
+  float*        spectra;                          // Spectra of the filter partitions
+  float*        fdl;                              // Frequency domain delay line of the input spectra
+  float         window[DSP_FIR_FFT_SIZE];         // Most recent input samples
+  float         work[DSP_FIR_FFT_SIZE];           // Accumulated output spectrum
+  float         input[DSP_FIR_PARTITION];         // Input collected for the next partition
+  float         output[DSP_FIR_PARTITION];        // Output of the last partition
+  bool          shared;                           // Spectra belong to the FIR of another channel
+} dsp_fir_t;
+
+typedef struct dsp_crossover_t {
+  const crossover_def_t* crossover_def;           // Associated crossover definition
+  int           taps;                             // Number of FIR taps (odd)
+  int           offset;                           // Newest sample in the history
+  float*        coeffs;                           // First half of the symmetric coefficients and the centre tap
+  float*        hist;                             // Input history (stored twice)
+  bool          shared;                           // Coefficients belong to the section of another channel
+} dsp_crossover_t;
+
+typedef struct dsp_fraction_t {
+  float         fraction;                         // Fraction of a sample delayed (0 = none)
+  float         coeff;                            // Thiran all-pass coefficient
+  float         x1;                               // Last input sample
+  float         y1;                               // Last output sample
+} dsp_fraction_t;
+
+typedef struct dsp_limiter_t {
+  const limiter_def_t* limiter_def;               // Associated limiter definition
+  float         ceiling;                          // Highest output level in sample units
+  float         release;                          // Release coefficient per sample
+  float         scale;                            // Inverse of the window length
+  int           window;                           // Look-ahead plus one samples, the length of the peak and gain windows
+  int           offset;                           // Slot of the oldest sample of the windows
+  uint32_t      position;                         // Samples processed, to expire the peaks
+  int           head;                             // Oldest entry of the peak queue, the window maximum
+  int           count;                            // Number of entries in the peak queue
+  float         gain;                             // Gain after the release, before the attack smoothing
+  float         reduction_sum;                    // Sum of the gain reductions in the window
+  float*        delay;                            // Input delayed by the look-ahead (window samples, owns the allocation)
+  float*        reduction;                        // Gain reductions (1 - gain) averaged over the window
+  float*        peak_level;                       // Queue of the decreasing peaks of the window
+  uint32_t*     peak_position;                    // Position of each queued peak
+} dsp_limiter_t;
+
+typedef struct dsp_dither_t {
+  uint32_t      key;                              // Key of the channel's noise sequence
+  uint32_t      counter;                          // Samples dithered, the input of the noise generator
+  float         error[2];                         // Last quantization errors in steps, for the noise shaping
+} dsp_dither_t;
+
+struct dsp_data_t;
+
+typedef int (*dsp_step_fn_t)( struct dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled );
+
+typedef struct dsp_step_t {
+  dsp_step_fn_t process;                          // Processes the block in place and returns the clipped samples
+  int           node_type;                        // Node run by the step (the first one of fused nodes)
+} dsp_step_t;
+
+typedef struct dsp_plan_t {
+  int           nodes[DSP_MAX_NODES];             // Graph of the channel in signal order (none = default graph)
+  int           node_count;                       // Number of nodes in the graph
+  dsp_step_t    steps[DSP_MAX_NODES];             // Compiled steps after the mixer
+  int           step_count;                       // Number of steps
+  int           filter_step;                      // Steps before the biquads, which run for all channels together
+  int           shared_steps;                     // Steps after the biquads covered by copying a shared output
+  bool          dither;                           // Dither the output samples
+} dsp_plan_t;
+
+typedef struct dsp_data_t {
+  float         scaling_factor;                   // Factor used to scale values for specified gain
+  float         mix_gain[DSP_NUM_CHANNELS];       // Gain applied to each input when mixing
+  int           delay_samples;                    // Number of whole samples delayed in buffer
+  int           delay_offset;                     // Offset within the delay buffer for storing next set of input values
+  int           delay_length;                     // Size of the delay buffer (delay plus one block)
+  int           delay_fill;                       // Samples stored since the delay line was cleared (up to delay_samples)
+  int           share_input;                      // Earlier channel with the same mixing, delay and decimation (-1 = none)
+  int           in_clip_count;                    // Number of times input audio clipped per channel
+  int           out_clip_count;                   // Number of times output audio clipped per channel
+  float         out_reduction_dB;                 // Max gain reduction of the limiter in the last block
+  float         out_reduction_max_dB;             // Max gain reduction of the limiter since the start
+  long int      in_max_level;                     // Max input level per last sample
+  long int      out_max_level;                    // Max output level per last sample
+  float*        delay_buff;                       // Sample delay buffer (allocated to the delay)
+  dsp_fraction_t fraction;                        // Delay by a fraction of a sample
+  dsp_bank_t    bank[2];                          // Active and pending filter banks (see dsp_get_bank)
+  dsp_multirate_t multirate;                      // Reduced rate processing of band-limited channels
+  dsp_fir_t*    fir;                              // FIR room correction (NULL if none)
+  dsp_crossover_t* crossover;                     // Linear-phase crossover section (NULL if none)
+  dsp_limiter_t limiter;                          // Look-ahead output limiter
+  dsp_dither_t  dither;                           // Output dither and noise shaping
+  dsp_plan_t    plan;                             // Compiled processing graph
+} dsp_data_t;
+
+typedef struct dsp_channel_t {
+  const char*   name;                             // Name of the channel
+  float         inputs[DSP_NUM_CHANNELS];         // Linear gains of the input channels (all selected at 1 = averaged, negative inverts)
+  float         gain_dB;                          // The amount of gain added to the channel
+  float         delay_millis;                     // The delay (in milliseconds, fractions allowed) introduced into the channel
+  int           decimation;                       // Filter at the sample rate divided by 4, 8 or 16 (0 = full rate)
+  dsp_data_t*   data;                             // Data buffer for the channel
+} dsp_channel_t;
+
+
+//------------------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------------------
+
+extern dsp_channel_t  DSP_Channels[DSP_NUM_CHANNELS];
+
+
+//------------------------------------------------------------------------------------
+// Platform functions (implemented by the firmware or host shim)
+//------------------------------------------------------------------------------------
+
+void              dsp_printf( const char* format, ... );
+uint32_t          dsp_get_cycles();
+void*             dsp_malloc_large( size_t size );
+
+
+//------------------------------------------------------------------------------------
+// Global functions (C++)
+//------------------------------------------------------------------------------------
+
+void              dsp_filter_info( dsp_channel_t* channels );
+esp_err_t         dsp_filter_init( dsp_channel_t* channels, const biquad_def_t* biquad_defs, int biquad_def_count, const filter_def_t* filter_defs, int filter_def_count, const biquad_def_t* filter_biquads );
+esp_err_t         dsp_update_filters( const filter_def_t* filter_defs, int filter_def_count );
+esp_err_t         dsp_edit_filter( int channel_id, int filter_id, const filter_def_t* filter_def );
+dsp_bank_t*       dsp_get_bank( dsp_data_t* dsp_data );
+esp_err_t         dsp_filter( dsp_channel_t* channels, sample_t* input_buffer, sample_t* output_buffer, int buffer_len, bool filters_enabled, bool* clip_flag );
+void              dsp_resync( dsp_channel_t* channels );
+int               dsp_block_passes( dsp_channel_t* channels, int sample_count, int* bytes_moved );
+void              dsp_share_channels( dsp_channel_t* channels );
+esp_err_t         dsp_get_biquad( const filter_def_t* filter, double* coeffs );
+esp_err_t         dsp_get_biquad_rate( const filter_def_t* filter, double sample_rate, double* coeffs );
+esp_err_t         dsp_resample_biquad( const double* coeffs, int factor, double* coeffs_out );
+void              dsp_get_biquad_poles( double* coeffs, double* radius, double* frequency );
+double            dsp_get_biquad_noise( double* coeffs, int precision, double sample_rate );
+int               dsp_select_precision( double* coeffs, double sample_rate );
+esp_err_t         dsp_biquad_filter( float* buffer, int len, dsp_filter_t* filter );
+void              dsp_biquad_reset( dsp_filter_t* filter );
+void              dsp_biquad_quantize_q31( const double* coeffs, int32_t* coeffs_q );
+void              dsp_biquad_quantize( dsp_filter_t* filter );
+void              dsp_biquad_set_precision( dsp_filter_t* filter, int precision );
+esp_err_t         dsp_biquad_cascade( float* buffer, int len, dsp_filter_t* filters, int num_filters );
+esp_err_t         dsp_biquad_cascade_pair( float* buffer_a, dsp_filter_t* filters_a, int num_filters_a, float* buffer_b, dsp_filter_t* filters_b, int num_filters_b, int len );
+void              dsp_interpolate_biquad( double* coeffs_from, double* coeffs_to, double fraction, double* coeffs );
+void              dsp_set_kernel( int kernel );
+int               dsp_get_kernel();
+void              dsp_set_transition( int mode, int blocks );
+int               dsp_get_transition();
+esp_err_t         dsp_set_block_size( dsp_channel_t* channels, int block_samples );
+int               dsp_get_block_size();
+uint32_t          dsp_profile_block( dsp_channel_t* channels, int block_samples );
+esp_err_t         dsp_set_delay( dsp_channel_t* channel, float delay_millis );
+void              dsp_delay_resync( dsp_data_t* dsp_data );
+void              dsp_delay_process( dsp_data_t* dsp_data, float* buffer, int sample_count );
+void              dsp_fraction_process( dsp_fraction_t* fraction, float* buffer, int sample_count );
+float             dsp_delay_samples( dsp_data_t* dsp_data );
+esp_err_t         dsp_set_decimation( dsp_channel_t* channel, int factor );
+void              dsp_multirate_reset( dsp_multirate_t* multirate );
+void              dsp_multirate_copy_state( dsp_multirate_t* multirate, dsp_multirate_t* source );
+int               dsp_decimate( dsp_multirate_t* multirate, float* input, int sample_count, float* output );
+void              dsp_interpolate( dsp_multirate_t* multirate, float* input, float* output, int sample_count );
+int               dsp_multirate_latency( dsp_multirate_t* multirate );
+dsp_fir_t*        dsp_fir_create( float* taps, int tap_count );
+dsp_fir_t*        dsp_fir_share( dsp_fir_t* source );
+void              dsp_fir_copy_state( dsp_fir_t* fir, dsp_fir_t* source );
+bool              dsp_fir_same_state( dsp_fir_t* fir, dsp_fir_t* source );
+void              dsp_fir_free( dsp_fir_t* fir );
+void              dsp_fir_reset( dsp_fir_t* fir );
+void              dsp_fir_process( dsp_fir_t* fir, float* buffer, int sample_count );
+int               dsp_fir_latency( int sample_count );
+uint32_t          dsp_fir_profile( int partitions );
+esp_err_t         dsp_crossover_init( dsp_channel_t* channels, const crossover_def_t* crossover_defs, int crossover_def_count );
+int               dsp_crossover_taps( float frequency, int slope );
+dsp_crossover_t*  dsp_crossover_create( const crossover_def_t* crossover_def );
+dsp_crossover_t*  dsp_crossover_share( dsp_crossover_t* source );
+void              dsp_crossover_copy_state( dsp_crossover_t* crossover, dsp_crossover_t* source );
+bool              dsp_crossover_same_state( dsp_crossover_t* crossover, dsp_crossover_t* source );
+void              dsp_crossover_free( dsp_crossover_t* crossover );
+void              dsp_crossover_reset( dsp_crossover_t* crossover );
+void              dsp_crossover_process( dsp_crossover_t* crossover, float* buffer, int sample_count );
+int               dsp_crossover_latency( dsp_crossover_t* crossover );
+const char*       dsp_crossover_name( dsp_crossover_t* crossover );
+uint32_t          dsp_crossover_profile( int taps, int sample_count );
+esp_err_t         dsp_limiter_set( dsp_channel_t* channel, const limiter_def_t* limiter_def );
+esp_err_t         dsp_limiter_init( dsp_channel_t* channels, const limiter_def_t* limiter_defs, int limiter_def_count );
+void              dsp_limiter_reset( dsp_limiter_t* limiter );
+float             dsp_limiter_process( dsp_limiter_t* limiter, float* buffer, int sample_count, float scaling_factor, float* max_level );
+void              dsp_limiter_meter( dsp_data_t* dsp_data, float min_gain );
+int               dsp_limiter_latency( dsp_limiter_t* limiter );
+bool              dsp_limiter_same( dsp_limiter_t* limiter_a, dsp_limiter_t* limiter_b );
+esp_err_t         dsp_graph_init( dsp_channel_t* channels, const node_def_t* node_defs, int node_def_count );
+void              dsp_graph_plan( dsp_channel_t* channels );
+void              dsp_graph_set_fused( dsp_channel_t* channels, bool fused );
+void              dsp_graph_info( dsp_data_t* dsp_data );
+bool              dsp_graph_has_node( dsp_data_t* dsp_data, int node_type );
+int               dsp_graph_latency( dsp_data_t* dsp_data, int sample_count, int* node_latency );
+biquad_def_t*     dsp_import_filters( int* import_filter_count );
+fir_def_t*        dsp_import_fir( int* import_fir_count );
+void              dsp_dither_init( dsp_dither_t* dither, int channel_id );
+void              dsp_dither_reset( dsp_dither_t* dither );
+void              dsp_dither_process( dsp_dither_t* dither, float* buffer, int sample_count );
+void              dsp_stats_add( int stage, uint32_t cycles );
+void              dsp_stats_block( int sample_count );
+void              dsp_stats_stream( int event );
+void              dsp_stats_period( uint32_t cycles, int sample_count );
+uint32_t          dsp_stats_faults();
+void              dsp_stats_reset();
+void              dsp_stats_info();
+
+
+//------------------------------------------------------------------------------------
+// Global functions (C)
+//------------------------------------------------------------------------------------
+
+extern "C" {
+  esp_err_t       dsps_biquad_f32_ae32( const float* input, float* output, int len, float* coef, float* w );
+}
+
+extern "C" {
+  esp_err_t       dsps_biquad_f32_ansi( const float* input, float* output, int len, float* coef, float* w );
+}
+
+extern "C" {
+  esp_err_t       dsps_biquad_f32_dbl( const float *input, float *output, int len, double *coef, float* w);
+}
+
+extern "C" {
+  esp_err_t       dsps_biquad_f32_tdf2( const float *input, float *output, int len, double *coef, double* s );
+}
+
+extern "C" {
+  esp_err_t       dsps_biquad_f32_ef( const float *input, float *output, int len, double *coef, float* s );
+}
+
+extern "C" {
+  esp_err_t       dsps_biquad_f32_q31( const float *input, float *output, int len, const int32_t *coef, int shift, int32_t* s );
+}
+
+extern "C" {
+  esp_err_t       dsps_biquad_f32_q15( const float *input, float *output, int len, const int32_t *coef, int shift, int32_t* s );
+}
+
+// Use the ESP32 assembler biquad on target and the C reference on the host
+#ifdef DSP_HOST_BUILD
+#define dsps_biquad_f32         dsps_biquad_f32_ansi
+#else
+#define dsps_biquad_f32         dsps_biquad_f32_ae32
+#endif
+
+#endif
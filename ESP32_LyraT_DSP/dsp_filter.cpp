@@ -1,9 +1,104 @@
-#include "dsp_process.h"
+#include "dsp_engine.h"
+
+#define DSP_PROFILE_WARMUP      4                 // Blocks run before measuring
+#define DSP_PROFILE_BLOCKS      32                // Blocks measured
 
 static const char   compile_date[] = __DATE__ " " __TIME__;
-static float        Biquad_Buff_F32[ DSP_MAX_SAMPLES ];  // Single channel input buffer for biquad function
-static char*        filter_name[] = {"Low Pass", "High Pass", "Band Pass", "Notch Pass", "All Pass", "Peak EQ", "Low Shelf", "High Shelf" };
-static bool         filter_update = false;
+static float*       Input_F32[ DSP_NUM_CHANNELS ];       // Deinterleaved I2S input
+static float*       Biquad_Buff_F32[ DSP_NUM_CHANNELS ]; // Per channel buffers processed in place by the steps
+static float*       Decim_Buff_F32[ DSP_NUM_CHANNELS ];  // Reduced rate buffers of decimated channels
+static float*       Fade_Buff_F32[ DSP_NUM_CHANNELS ];   // Outputs of the old filters when crossfading
+static const char*  filter_name[] = {"Low Pass", "High Pass", "Band Pass", "Notch Pass", "All Pass", "Peak EQ", "Low Shelf", "High Shelf" };
+
+// Filter bank double buffering. Every channel has two banks and all channels use the
+// bank selected by bank_active. Updates are written into the bank not in use and
+// handed over by atomically storing its index in bank_pending, which the DSP task
+// swaps in at the start of the next block. The updating task only writes the bank
+// it took from bank_free, which the DSP task gives back once it stops using it (at
+// the swap, or at the end of a filter transition). bank_published is only used by
+// the updating task and is the bank most recently handed over.
+static int          bank_active = 0;
+static int          bank_pending = -1;
+static int          bank_free = 1;
+static int          bank_published = 0;
+static int          bank_previous = 0;
+
+// Filter transitions. The mode and length are read when the updated bank is swapped
+// in, after which the DSP task runs the transition from bank_previous to bank_active.
+static int          transition_mode = DSP_TRANSITION_DEFAULT;
+static int          transition_blocks = DSP_TRANSITION_BLOCKS;
+static int          transition_type = DSP_TRANSITION_NONE;      // Transition in progress
+static int          transition_block;
+static int          transition_length;
+static dsp_bank_t   Transition_Bank[ DSP_NUM_CHANNELS ];                     // Interpolated filters
+static double       biquad_identity[5] = { 1.0, 0.0, 0.0, 0.0, 0.0 };
+static const char*  transition_name[] = {"NONE", "CROSSFADE", "INTERPOLATE" };
+
+// Single filter edits. The updating task fills in the edit and sets edit_pending,
+// the DSP task then moves the filter of the active bank to the new coefficients
+// (interpolated over the transition length) and clears edit_pending when done.
+static int          edit_pending = 0;
+static int          edit_channel;
+static int          edit_filter;
+static int          edit_precision;
+static bool         edit_precision_auto;
+static int          edit_block;
+static int          edit_length;
+static double       edit_coeffs_from[5];
+static double       edit_coeffs_to[5];
+static filter_def_t Edit_Defs[ DSP_NUM_CHANNELS ][ DSP_MAX_FILTERS ];       // Definitions of edited filters
+
+// Shared processing. A channel whose processing matches an earlier channel copies
+// the result of that channel instead of repeating it. share_input of the channel
+// data covers the mixing, delay and decimation, share of each bank the biquads, and
+// Output_Share the interpolation, crossover and FIR of the last block, which the DSP
+// task updates as the banks change.
+static int          Output_Share[ DSP_NUM_CHANNELS ];
+static bool         profile_shared = true;                                   // Profile the shared processing only once
+
+// Block size (latency mode). The block size is only changed through the presets,
+// after profiling the current filters at that size.
+static const int    block_presets[] = { 16, 32, 64, 96 };
+static int          block_samples = DSP_BLOCK_SAMPLES;
+static dsp_bank_t   Profile_Bank[ DSP_NUM_CHANNELS ];                        // Copies of the filters being profiled
+static float        Profile_Buff_F32[ DSP_NUM_CHANNELS ][ DSP_MAX_SAMPLES ];
+static float        Profile_Decim_F32[ DSP_NUM_CHANNELS ][ DSP_MAX_SAMPLES ];
+static dsp_multirate_t Profile_Multirate[ DSP_NUM_CHANNELS ];                 // Copies of the decimation state being profiled
+static float        Profile_Hist_F32[ 2*DSP_MULTIRATE_TAPS_MAX + 2*DSP_MULTIRATE_TAPS_PHASE ];  // History of all the copies, only the cycles count
+
+// The block buffers are planes of one pool, assigned by the phases of the block they
+// are used in. Buffers not used in the same phase share a plane.
+#define PHASE_DEINTERLEAVE      0
+#define PHASE_MIX               1
+#define PHASE_DECIMATE          2                 // Steps before the biquads and decimation
+#define PHASE_BIQUADS           3
+#define PHASE_INTERPOLATE       4                 // Interpolation and the shared steps after the biquads
+#define PHASE_OUTPUT            5
+#define PHASE_INTERLEAVE        6
+
+typedef struct dsp_buffer_use_t {
+  float**       planes;                           // Table of the channel planes of the buffer
+  int           first;                            // First phase the buffer is used in
+  int           last;                             // Last phase the buffer is used in
+} dsp_buffer_use_t;
+
+static const dsp_buffer_use_t buffer_uses[] = {   // In order of the first phase
+  { Input_F32,        PHASE_DEINTERLEAVE, PHASE_MIX },
+  { Biquad_Buff_F32,  PHASE_MIX,          PHASE_INTERLEAVE },
+  { Decim_Buff_F32,   PHASE_DECIMATE,     PHASE_INTERPOLATE },
+  { Fade_Buff_F32,    PHASE_BIQUADS,      PHASE_BIQUADS }
+};
+#define PLANE_SAMPLES           ( ( DSP_MAX_SAMPLES + 3 ) & ~3 )   // Keeps the planes 16 byte aligned
+#define MAX_PLANES              ( DSP_NUM_CHANNELS*sizeof( buffer_uses )/sizeof( dsp_buffer_use_t ) )
+static float*       plane_pool = NULL;
+static int          plane_count;
+
+static int          filter_kernel = DSP_KERNEL_DEFAULT;
+static const char*  kernel_name[] = {"FILTER", "CASCADE", "PAIRED" };
+static const char*  precision_name[] = {"FLT", "DBL", "TDF2", "DF1EF", "Q31", "Q15" };
+
+static int          dsp_fir_max_taps( dsp_channel_t* channels );
+static bool         dsp_same_output( dsp_data_t* data_a, dsp_data_t* data_b );
 
 
 //------------------------------------------------------------------------------------
@@ -13,51 +108,217 @@ void dsp_filter_info( dsp_channel_t* channels ) {
 
   dsp_channel_t*  channel;
   dsp_data_t*     dsp_data;
-  filter_def_t*   filter_def;
-
-  SERIAL.printf( "Compile date: %s\r\n", compile_date );
-  SERIAL.printf( "I-DSP:   Sampling rate = %d\r\n", DSP_SAMPLE_RATE );
-  SERIAL.printf( "I-DSP:   Sampling bits = %d\r\n", SAMPLE_BITS );
-  SERIAL.printf( "I-DSP:   Sampling delay = %f ms\r\n", ((float) DSP_MAX_SAMPLES)*1000*2/DSP_SAMPLE_RATE );  
-  SERIAL.printf( "I-DSP:   Dither = %s\r\n", DITHER_ON ? "ON" : "OFF" );  
-  SERIAL.printf( "\r\n" );
+  dsp_bank_t*     bank;
+  const filter_def_t* filter_def;
+  const crossover_def_t* crossover_def;
+  const limiter_def_t* limiter_def;
+  double          pole_radius;
+  double          pole_freq;
+  uint32_t        shared_cycles;
+  uint32_t        unshared_cycles;
+  int             share_id;
+
+  // Cost of the filters with and without the shared processing
+  shared_cycles = dsp_profile_block( channels, block_samples );
+  profile_shared = false;
+  unshared_cycles = dsp_profile_block( channels, block_samples );
+  profile_shared = true;
+
+  dsp_printf( "Compile date: %s\r\n", compile_date );
+  dsp_printf( "I-DSP:   Sampling rate = %d\r\n", DSP_SAMPLE_RATE );
+  dsp_printf( "I-DSP:   Sampling bits = %d\r\n", SAMPLE_BITS );
+  dsp_printf( "I-DSP:   Block size = %d samples\r\n", block_samples );
+  dsp_printf( "I-DSP:   Sampling delay = %f ms\r\n", ((float) block_samples)*1000*2/DSP_SAMPLE_RATE );  
+  dsp_printf( "I-DSP:   Dither = %s (TPDF, noise shaping order %d)\r\n", DITHER_ON ? "ON" : "OFF", DITHER_SHAPING );
+  dsp_printf( "I-DSP:   Block buffers = %d planes (%d without sharing)\r\n", plane_count, (int) MAX_PLANES );
+  dsp_printf( "I-DSP:   Biquad kernel = %s\r\n", kernel_name[ filter_kernel ] );
+  dsp_printf( "I-DSP:   Filter transition = %s (%d blocks)\r\n", transition_name[ transition_mode ], transition_blocks );
+  dsp_printf( "I-DSP:   Filter noise target = %.1f dBFS\r\n", (double) DSP_NOISE_TARGET_DB );
+  dsp_printf( "I-DSP:   Stream faults = %u (see stats)\r\n", dsp_stats_faults() );
+  dsp_printf( "I-DSP:   FIR partition = %d samples, max taps = %d per channel\r\n", DSP_FIR_PARTITION, dsp_fir_max_taps( channels ) );
+  dsp_printf( "I-DSP:   Filter cycles = %u/block (%u without shared processing, %d%% saved)\r\n", shared_cycles, unshared_cycles,
+    ( unshared_cycles > shared_cycles ) ? (int) ( 100ULL*( unshared_cycles - shared_cycles )/unshared_cycles ) : 0 );
+  dsp_printf( "\r\n" );
 
   for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
     channel = &channels[channel_id];
     dsp_data = channel->data;
+    bank = dsp_get_bank( dsp_data );
 
-    SERIAL.printf( "I-DSP: Channel %c: %s\r\n", channel_id + 'A', channel->name );
+    dsp_printf( "I-DSP: Channel %c: %s\r\n", channel_id + 'A', channel->name );
     for( int i=0; i < DSP_NUM_CHANNELS; ++ i ) {
-      SERIAL.printf( "I-DSP:   Input %d = %d\r\n", i, channel->inputs[i] );
+      dsp_printf( "I-DSP:   Input %d = %g (mix gain %.3f)\r\n", i, channel->inputs[i], dsp_data->mix_gain[i] );
+    }
+    dsp_printf( "I-DSP:   Gain = %f dB\r\n", channel->gain_dB );
+    dsp_printf( "I-DSP:   Scaling factor = %f\r\n", dsp_data->scaling_factor );
+    dsp_printf( "I-DSP:   User delay = %.3f millis\r\n", channel->delay_millis );
+    dsp_printf( "I-DSP:   Delay samples = %.3f\r\n", dsp_delay_samples( dsp_data ) );
+    dsp_graph_info( dsp_data );
+    if( dsp_data->share_input >= 0 ) {
+      share_id = bank->share;
+      dsp_printf( "I-DSP:   Shared = input with channel %c", dsp_data->share_input + 'A' );
+      if( share_id >= 0 ) {
+        dsp_printf( ", filters with channel %c", share_id + 'A' );
+        if( dsp_same_output( dsp_data, channels[share_id].data ) ) {
+          dsp_printf( ", output with channel %c", share_id + 'A' );
+        }
+      }
+      dsp_printf( "\r\n" );
+    } else {
+      dsp_printf( "I-DSP:   Shared = OFF\r\n" );
+    }
+    if( dsp_data->multirate.factor > 1 ) {
+      dsp_printf( "I-DSP:   Decimation = %d (filter rate = %.1f Hz, latency = %d samples, %.2f ms)\r\n", dsp_data->multirate.factor,
+        (double) DSP_SAMPLE_RATE/dsp_data->multirate.factor, dsp_multirate_latency( &dsp_data->multirate ),
+        dsp_multirate_latency( &dsp_data->multirate )*1000.0/DSP_SAMPLE_RATE );
+    } else {
+      dsp_printf( "I-DSP:   Decimation = OFF\r\n" );
+    }
+    if( dsp_data->fir != NULL ) {
+      dsp_printf( "I-DSP:   FIR = %d taps (%d partitions, latency = %d samples, %u cycles/block)\r\n", dsp_data->fir->tap_count,
+        dsp_data->fir->partitions, dsp_fir_latency( block_samples/DSP_NUM_CHANNELS ),
+        (uint32_t) ( (uint64_t) dsp_fir_profile( dsp_data->fir->partitions )*block_samples/DSP_NUM_CHANNELS/DSP_FIR_PARTITION ) );
+    } else {
+      dsp_printf( "I-DSP:   FIR = OFF\r\n" );
+    }
+    if( dsp_data->crossover != NULL ) {
+      crossover_def = dsp_data->crossover->crossover_def;
+      dsp_printf( "I-DSP:   Crossover = %s, %d dB/octave (%d taps, latency = %d samples, %.2f ms, %u cycles/block)\r\n",
+        dsp_crossover_name( dsp_data->crossover ), crossover_def->slope, dsp_data->crossover->taps,
+        dsp_crossover_latency( dsp_data->crossover ), dsp_crossover_latency( dsp_data->crossover )*1000.0/DSP_SAMPLE_RATE,
+        dsp_crossover_profile( dsp_data->crossover->taps, block_samples/DSP_NUM_CHANNELS ) );
+
+      if( crossover_def->section == DSP_CROSSOVER_BAND_PASS ) {
+        dsp_printf( "I-DSP:     Frequency=%7.1f to %7.1f\r\n", crossover_def->frequency, crossover_def->frequency_high );
+      } else {
+        dsp_printf( "I-DSP:     Frequency=%7.1f\r\n", crossover_def->frequency );
+      }
     }
-    SERIAL.printf( "I-DSP:   Gain = %f dB\r\n", channel->gain_dB );
-    SERIAL.printf( "I-DSP:   Scaling factor = %f\r\n", dsp_data->scaling_factor );
-    SERIAL.printf( "I-DSP:   User delay = %d millis\r\n", channel->delay_millis );
-    SERIAL.printf( "I-DSP:   Delay samples = %d\r\n", dsp_data->delay_samples );
 #if DEBUG_ON
-    SERIAL.printf( "I-DSP:   Input level max = %d\r\n", dsp_data->in_max_level );
-    SERIAL.printf( "I-DSP:   Output level max = %d\r\n", dsp_data->out_max_level );    
+    dsp_printf( "I-DSP:   Input level max = %d\r\n", dsp_data->in_max_level );
+    dsp_printf( "I-DSP:   Output level max = %d\r\n", dsp_data->out_max_level );    
 #endif
-    SERIAL.printf( "I-DSP:   Input clipping count = %d\r\n", dsp_data->in_clip_count );
-    SERIAL.printf( "I-DSP:   Output clipping count = %d\r\n", dsp_data->out_clip_count );
-    SERIAL.printf( "I-DSP:   Filter count = %d\r\n", dsp_data->num_filters );
+    dsp_printf( "I-DSP:   Input clipping count = %d\r\n", dsp_data->in_clip_count );
+    dsp_printf( "I-DSP:   Output clipping count = %d\r\n", dsp_data->out_clip_count );
+    if( dsp_graph_has_node( dsp_data, DSP_NODE_LIMIT ) ) {
+      limiter_def = dsp_data->limiter.limiter_def;
+      dsp_printf( "I-DSP:   Limiter = ceiling %.1f dBFS, release %.0f ms (look-ahead = %d samples, %.2f ms)\r\n", limiter_def->ceiling_dB,
+        limiter_def->release_millis, dsp_data->limiter.window - 1, ( dsp_data->limiter.window - 1 )*1000.0/DSP_SAMPLE_RATE );
+      dsp_printf( "I-DSP:   Limiter gain reduction = %.1f dB (max %.1f dB)\r\n", dsp_data->out_reduction_dB, dsp_data->out_reduction_max_dB );
+    } else {
+      dsp_printf( "I-DSP:   Limiter = OFF\r\n" );
+    }
+    dsp_printf( "I-DSP:   Filter count = %d\r\n", bank->num_filters );
 
-    for( int i = 0; i < dsp_data->num_filters; ++ i ) {
+    for( int i = 0; i < bank->num_filters; ++ i ) {
       // Show BiQuad information
-      SERIAL.printf( "I-DSP:   Filter %d coeffs = %16.14e %16.14e %16.14e %16.14e %16.14e (%s)\r\n",
-        i+1, dsp_data->filter[i].coeffs_d[0], dsp_data->filter[i].coeffs_d[1],
-        dsp_data->filter[i].coeffs_d[2], -dsp_data->filter[i].coeffs_d[3], 
-        -dsp_data->filter[i].coeffs_d[4], dsp_data->filter[i].precision == PRC_DBL ? "DBL" : "FLT" );
+      dsp_printf( "I-DSP:   Filter %d coeffs = %16.14e %16.14e %16.14e %16.14e %16.14e (%s)\r\n",
+        i+1, bank->filter[i].coeffs_d[0], bank->filter[i].coeffs_d[1],
+        bank->filter[i].coeffs_d[2], -bank->filter[i].coeffs_d[3], 
+        -bank->filter[i].coeffs_d[4], precision_name[ bank->filter[i].precision ] );
+
+      // Show pole position and estimated noise of the selected kernel
+      dsp_get_biquad_poles( bank->filter[i].coeffs_d, &pole_radius, &pole_freq );
+      pole_freq /= dsp_data->multirate.factor;
+      dsp_printf( "I-DSP:     Poles: r=%.6f  f=%7.1f Hz  Noise=%6.1f dBFS  Precision=%s%s\r\n",
+        pole_radius, pole_freq, dsp_get_biquad_noise( bank->filter[i].coeffs_d, bank->filter[i].precision, (double) DSP_SAMPLE_RATE/dsp_data->multirate.factor ),
+        precision_name[ bank->filter[i].precision ], bank->filter[i].precision_auto ? " (auto)" : "" );
 
       // Show filter information (if applicable)
-      filter_def = dsp_data->filter[i].filter_def;
+      filter_def = bank->filter[i].filter_def;
       
       if( filter_def != NULL ) {
-        SERIAL.printf( "I-DSP:     %s: Frequency=%7.1f  Q=%16.14e  Gain=%4.1f\r\n", 
+        dsp_printf( "I-DSP:     %s: Frequency=%7.1f  Q=%16.14e  Gain=%4.1f\r\n", 
           filter_name[ filter_def->filter_type ], filter_def->frequency, filter_def->Q, filter_def->gain );
       }
     }
-    SERIAL.printf( "\r\n" );
+    dsp_printf( "\r\n" );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Allocate the block buffers once, sharing a plane between buffers that are not used
+// in the same phase of the block. The uses are sorted by their first phase, so
+// taking the first plane that is free again is optimal.
+//------------------------------------------------------------------------------------
+static esp_err_t dsp_plan_buffers( void ) {
+
+  int               plane_last[ MAX_PLANES ];
+  int               plane_ids[ MAX_PLANES ];
+  int               use_count;
+  int               plane_id;
+  float*            pool;
+
+  if( plane_pool != NULL ) {
+    return( ESP_OK );
+  }
+
+  use_count = 0;
+  plane_count = 0;
+
+  for( const dsp_buffer_use_t& use : buffer_uses ) {
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+
+      for( plane_id = 0; plane_id < plane_count; ++ plane_id ) {
+        if( plane_last[plane_id] < use.first ) {
+          break;
+        }
+      }
+
+      if( plane_id == plane_count ) {
+        ++ plane_count;
+      }
+      plane_last[plane_id] = use.last;
+      plane_ids[ use_count ++ ] = plane_id;
+    }
+  }
+
+  pool = (float*) calloc( plane_count*PLANE_SAMPLES + 3, sizeof( float ) );
+  if( pool == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to allocate the block buffers\r\n" );
+    return( ESP_FAIL );
+  }
+  plane_pool = (float*) ( ( (uintptr_t) pool + 15 ) & ~(uintptr_t) 15 );
+
+  use_count = 0;
+  for( const dsp_buffer_use_t& use : buffer_uses ) {
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      use.planes[channel_id] = &plane_pool[ plane_ids[ use_count ++ ]*PLANE_SAMPLES ];
+    }
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Precompute the mixing gains of the channel inputs
+//
+// The inputs are linear gains, so {0.5,0.5} averages left and right, {2,0} raises
+// the left input by 6 dB and {-1,0} inverts its polarity. The one exception is the
+// legacy pattern where every selected input is 1, like {1,1}: the N selected inputs
+// are averaged with a gain of 1/N each, as before the gains existed.
+//------------------------------------------------------------------------------------
+static void dsp_set_mix( dsp_channel_t* channel ) {
+
+  int               num_inputs;
+  bool              legacy;
+  float             scale;
+
+  num_inputs = 0;
+  legacy = true;
+  for( int i = 0; i < DSP_NUM_CHANNELS; ++ i ) {
+    if( channel->inputs[i] != 0 ) {
+      ++ num_inputs;
+      legacy = legacy && channel->inputs[i] == 1;
+    }
+  }
+
+  scale = ( legacy && num_inputs > 1 ) ? 1.0f/num_inputs : 1.0f;
+
+  for( int i = 0; i < DSP_NUM_CHANNELS; ++ i ) {
+    channel->data->mix_gain[i] = channel->inputs[i]*scale;
   }
 }
 
@@ -68,27 +329,18 @@ void dsp_filter_info( dsp_channel_t* channels ) {
 static dsp_data_t* dsp_setup_channel( dsp_channel_t* channel ) {
 
   dsp_data_t*       dsp_data;
-  int               delay_samples;  
   
   // Check if specified gain is within limits
   if( channel->gain_dB < -DSP_MAX_GAIN || channel->gain_dB > DSP_MAX_GAIN ) {
-    SERIAL.printf( "E-DSP: ERROR: Invalid gain setting for channel '%s'\r\n", channel->name );
+    dsp_printf( "E-DSP: ERROR: Invalid gain setting for channel '%s'\r\n", channel->name );
     return( NULL );
   }
 
-  // Check if specified delay is within limits
-  if( channel->delay_millis != 0 ) {
-    if( channel->delay_millis < DSP_MIN_DELAY_MILLIS || channel->delay_millis > DSP_MAX_DELAY_MILLIS ) {
-      SERIAL.printf( "E-DSP: Invalid delay setting for channel '%s'\r\n", channel->name );
-      return( NULL );
-    }
-  }
-  
   // Allocate the necessary data buffers for delay and biquad calculations
   channel->data = (dsp_data_t*) malloc( sizeof( dsp_data_t ) );
 
   if( channel->data == NULL ) {
-    SERIAL.printf( "E-DSP: Unable to allocate data structure for channel '%s'\r\n", channel->name );
+    dsp_printf( "E-DSP: Unable to allocate data structure for channel '%s'\r\n", channel->name );
     return( NULL );
   }
   
@@ -96,7 +348,23 @@ static dsp_data_t* dsp_setup_channel( dsp_channel_t* channel ) {
 
   // Set scaling factor
   dsp_data->scaling_factor = exp10( channel->gain_dB/20.0 );
-  dsp_data->num_filters = 0;
+
+  // Set the mixing gains of the inputs
+  dsp_set_mix( channel );
+  dsp_data->bank[0].num_filters = 0;
+  dsp_data->bank[1].num_filters = 0;
+  dsp_data->bank[0].share = -1;
+  dsp_data->bank[1].share = -1;
+  dsp_data->share_input = -1;
+  dsp_data->fir = NULL;
+  dsp_data->delay_buff = NULL;
+  dsp_data->limiter.delay = NULL;
+  dsp_data->limiter.window = 0;
+  dsp_data->multirate.dec_hist = NULL;
+  dsp_data->multirate.int_hist = NULL;
+  dsp_data->multirate.taps = 0;
+  dsp_data->crossover = NULL;
+  dsp_data->plan.node_count = 0;
   
   // Set channel clipping counts
   dsp_data->in_clip_count = 0;
@@ -105,35 +373,49 @@ static dsp_data_t* dsp_setup_channel( dsp_channel_t* channel ) {
   // Set max levels
   dsp_data->in_max_level = 0;
   dsp_data->out_max_level = 0;
+  dsp_data->out_reduction_dB = 0;
+  dsp_data->out_reduction_max_dB = 0;
 
-  // Calculate number of delay samples required
-  delay_samples = DSP_SAMPLE_RATE*channel->delay_millis/1000;
+  // Set up the default limiter
+  if( dsp_limiter_set( channel, NULL ) != ESP_OK ) {
+    return( NULL );
+  }
 
-  if( delay_samples > 0 ) {
-    // Set up the delay buffer
-    dsp_data->delay_samples = delay_samples;
-    dsp_data->delay_offset = 0;
-    memset( dsp_data->delay_buff, 0, DSP_MAX_DELAY_SAMPLES*sizeof( sample_t ) );
-  } else {
-    // No delay buffer
-    dsp_data->delay_samples = 0;
-    dsp_data->delay_offset = 0;
-  }  
+  // Set up the delay buffer and the fractional delay
+  if( dsp_set_delay( channel, channel->delay_millis ) != ESP_OK ) {
+    return( NULL );
+  }
+
+  // Set up the reduced rate path
+  if( dsp_set_decimation( channel, channel->decimation ) != ESP_OK ) {
+    return( NULL );
+  }
 
   return( dsp_data );
 }
 
 
+//------------------------------------------------------------------------------------
+// Resolve an automatic precision to the cheapest kernel meeting the noise target
+//------------------------------------------------------------------------------------
+static void dsp_set_precision( dsp_filter_t* filter, double sample_rate ) {
+
+  filter->precision_auto = ( filter->precision == PRC_AUTO );
+
+  if( filter->precision_auto ) {
+    filter->precision = dsp_select_precision( filter->coeffs_d, sample_rate );
+  }
+}
+
+
 //------------------------------------------------------------------------------------
 // Load biquad definitions
 //------------------------------------------------------------------------------------
-static esp_err_t dsp_load_biquads( dsp_channel_t* channel, int channel_id, biquad_def_t* biquad_defs, int biquad_def_count ) {
+static esp_err_t dsp_load_biquads( dsp_channel_t* channel, dsp_bank_t* bank, int channel_id, const biquad_def_t* biquad_defs, int biquad_def_count ) {
 
   int         num_filters;
-  dsp_data_t* dsp_data;
 
-  dsp_data = channel->data;
-  num_filters = dsp_data->num_filters;
+  num_filters = bank->num_filters;
   
   // Load each biquad defined filter
   for( int filter_id = 0; filter_id < biquad_def_count; ++filter_id ) {
@@ -141,32 +423,39 @@ static esp_err_t dsp_load_biquads( dsp_channel_t* channel, int channel_id, biqua
     if( ( biquad_defs[filter_id].channel == channel_id ) || ( biquad_defs[filter_id].channel == DSP_ALL_CHANNELS ) ) {
       
       // Check if filter count is within limits
-      if( num_filters > DSP_MAX_FILTERS ) {
-        SERIAL.printf( "E-DSP: ERROR: Maximum filters exceeded for channel '%s'\r\n", channel->name );
+      if( num_filters >= DSP_MAX_FILTERS ) {
+        dsp_printf( "E-DSP: ERROR: Maximum filters exceeded for channel '%s'\r\n", channel->name );
         return( ESP_FAIL );
       }
       
-      // Store biquads as floats and doubles
-      for( int i=0; i<5; ++i ) {
-        dsp_data->filter[num_filters].coeffs_d[i] = biquad_defs[filter_id].coeffs[i];
-        dsp_data->filter[num_filters].coeffs_f[i] = biquad_defs[filter_id].coeffs[i];          
+      // Store biquads as floats and doubles, converted to the reduced rate if decimated
+      if( channel->data->multirate.factor > 1 ) {
+        if( dsp_resample_biquad( biquad_defs[filter_id].coeffs, channel->data->multirate.factor, bank->filter[num_filters].coeffs_d ) != ESP_OK ) {
+          dsp_printf( "E-DSP: ERROR: Biquad %d of channel '%s' is not band-limited for decimation %d\r\n", filter_id + 1, channel->name, channel->data->multirate.factor );
+          return( ESP_FAIL );
+        }
+      } else {
+        for( int i=0; i<5; ++i ) {
+          bank->filter[num_filters].coeffs_d[i] = biquad_defs[filter_id].coeffs[i];
+        }
       }
 
-#if DOUBLE_PRECISION
-      dsp_data->filter[num_filters].precision = biquad_defs[filter_id].precision;
+#ifdef DOUBLE_PRECISION
+      bank->filter[num_filters].precision = biquad_defs[filter_id].precision;
 #else
-      dsp_data->filter[num_filters].precision = PRC_FLT;
+      bank->filter[num_filters].precision = PRC_AUTO;
 #endif
-      dsp_data->filter[num_filters].w[0] = 0.0;
-      dsp_data->filter[num_filters].w[1] = 0.0;
+      dsp_set_precision( &bank->filter[num_filters], (double) DSP_SAMPLE_RATE/channel->data->multirate.factor );
+      dsp_biquad_quantize( &bank->filter[num_filters] );
+      dsp_biquad_reset( &bank->filter[num_filters] );
     
-      dsp_data->filter[num_filters].filter_def = NULL;      
+      bank->filter[num_filters].filter_def = NULL;      
 
       ++ num_filters; 
     }
   }
   
-  dsp_data->num_filters = num_filters;
+  bank->num_filters = num_filters;
   
   return( ESP_OK );
 }
@@ -174,19 +463,20 @@ static esp_err_t dsp_load_biquads( dsp_channel_t* channel, int channel_id, biqua
 
 //------------------------------------------------------------------------------------
 // Load frequency specified filter definitions
+//
+// Filter_biquads holds the biquads of the definitions designed at compile time for
+// the full sample rate (see dsp_design.h). Without it, or for decimated channels,
+// the biquads are calculated here.
 //------------------------------------------------------------------------------------
-static esp_err_t dsp_load_filters( dsp_channel_t* channel, int channel_id, filter_def_t* filter_defs, int filter_def_count, bool reset_filters ) {
+static esp_err_t dsp_load_filters( dsp_channel_t* channel, dsp_bank_t* bank, int channel_id, const filter_def_t* filter_defs, int filter_def_count, const biquad_def_t* filter_biquads, bool reset_filters ) {
 
   int         num_filters;
-  dsp_data_t* dsp_data;
-
-  dsp_data = channel->data;
 
   // Are we resetting the filters
   if( reset_filters ) {
     num_filters = 0;
   } else {
-    num_filters = dsp_data->num_filters;
+    num_filters = bank->num_filters;
   }
 
   // Load each frequency specified filter    
@@ -195,48 +485,260 @@ static esp_err_t dsp_load_filters( dsp_channel_t* channel, int channel_id, filte
     if( ( filter_defs[filter_id].channel == channel_id ) || ( filter_defs[filter_id].channel == DSP_ALL_CHANNELS ) ) {
       
       // Check if filter count is within limits
-      if( num_filters > DSP_MAX_FILTERS ) {
-        SERIAL.printf( "E-DSP: ERROR: Maximum filters exceeded for channel '%s'\r\n", channel->name );
+      if( num_filters >= DSP_MAX_FILTERS ) {
+        dsp_printf( "E-DSP: ERROR: Maximum filters exceeded for channel '%s'\r\n", channel->name );
         return( ESP_FAIL );
       }
 
-      if( dsp_get_biquad( &filter_defs[filter_id], &dsp_data->filter[num_filters].coeffs_d[0] ) != ESP_OK ) {
+      if( filter_biquads != NULL && channel->data->multirate.factor == 1 ) {
+        for( int i=0; i<5; ++i ) {
+          bank->filter[num_filters].coeffs_d[i] = filter_biquads[filter_id].coeffs[i];
+        }
+      } else if( dsp_get_biquad_rate( &filter_defs[filter_id], (double) DSP_SAMPLE_RATE/channel->data->multirate.factor, &bank->filter[num_filters].coeffs_d[0] ) != ESP_OK ) {
         return( ESP_FAIL );
       }
 
-      // Save each double-precision coefficient also as floating point
-      for( int i=0; i<5; ++i ) {
-        dsp_data->filter[num_filters].coeffs_f[i] = dsp_data->filter[num_filters].coeffs_d[i];          
-      }
 #ifdef DOUBLE_PRECISION
-      dsp_data->filter[num_filters].precision = filter_defs[filter_id].precision;
+      bank->filter[num_filters].precision = filter_defs[filter_id].precision;
 #else
-      dsp_data->filter[num_filters].precision = PRC_FLT;
+      bank->filter[num_filters].precision = PRC_AUTO;
 #endif      
-      dsp_data->filter[num_filters].w[0] = 0.0;
-      dsp_data->filter[num_filters].w[1] = 0.0;
+      dsp_set_precision( &bank->filter[num_filters], (double) DSP_SAMPLE_RATE/channel->data->multirate.factor );
+
+      // Save the double-precision coefficients also in the format of the precision
+      dsp_biquad_quantize( &bank->filter[num_filters] );
+      dsp_biquad_reset( &bank->filter[num_filters] );
     
-      dsp_data->filter[num_filters].filter_def = &filter_defs[filter_id];
+      bank->filter[num_filters].filter_def = &filter_defs[filter_id];
       
       ++ num_filters;         
     }      
   }
   
-  dsp_data->num_filters = num_filters;
+  bank->num_filters = num_filters;
   
   return( ESP_OK );  
 }
 
 
+//------------------------------------------------------------------------------------
+// Load the FIR of the channel. A response for the channel itself takes precedence
+// over one for all channels.
+//------------------------------------------------------------------------------------
+static esp_err_t dsp_load_fir( dsp_channel_t* channels, int channel_id, fir_def_t* fir_defs, int fir_def_count ) {
+
+  dsp_channel_t*  channel;
+  dsp_fir_t*      fir;
+  fir_def_t*      fir_def;
+
+  channel = &channels[channel_id];
+  fir_def = NULL;
+
+  for( int def_id = 0; def_id < fir_def_count; ++ def_id ) {
+    if( fir_defs[def_id].channel == channel_id ) {
+      if( fir_def != NULL && fir_def->channel == channel_id ) {
+        dsp_printf( "E-DSP: ERROR: More than one FIR for channel '%s'\r\n", channel->name );
+        return( ESP_FAIL );
+      }
+      fir_def = &fir_defs[def_id];
+    } else if( fir_defs[def_id].channel == DSP_ALL_CHANNELS && fir_def == NULL ) {
+      fir_def = &fir_defs[def_id];
+    }
+  }
+
+  if( fir_def == NULL || fir_def->tap_count == 0 ) {
+    return( ESP_OK );
+  }
+
+  // Channels with the same taps share the partition spectra
+  for( int i = 0; i < channel_id; ++ i ) {
+    fir = channels[i].data->fir;
+    if( fir != NULL && !fir->shared && fir->taps == fir_def->taps && fir->tap_count == fir_def->tap_count ) {
+      channel->data->fir = dsp_fir_share( fir );
+      return( ( channel->data->fir == NULL ) ? ESP_FAIL : ESP_OK );
+    }
+  }
+
+  channel->data->fir = dsp_fir_create( fir_def->taps, fir_def->tap_count );
+  if( channel->data->fir == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to load FIR for channel '%s'\r\n", channel->name );
+    return( ESP_FAIL );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if a node of the two channels has the same settings. Channels with
+// the same crossover or FIR definitions share the coefficients, so comparing them is
+// enough.
+//------------------------------------------------------------------------------------
+static bool dsp_same_node( dsp_data_t* data_a, dsp_data_t* data_b, int node_type ) {
+
+  switch( node_type ) {
+
+    case DSP_NODE_GAIN:
+      return( data_a->scaling_factor == data_b->scaling_factor );
+
+    case DSP_NODE_LIMIT:
+      return( dsp_limiter_same( &data_a->limiter, &data_b->limiter ) );
+
+    case DSP_NODE_CROSSOVER:
+      return( data_a->crossover->coeffs == data_b->crossover->coeffs );
+
+    case DSP_NODE_FIR:
+      return( data_a->fir->spectra == data_b->fir->spectra );
+  }
+
+  return( true );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the two channels run the same steps first to last - 1
+//------------------------------------------------------------------------------------
+static bool dsp_same_steps( dsp_data_t* data_a, dsp_data_t* data_b, int first, int last ) {
+
+  for( int i = first; i < last; ++ i ) {
+    if( data_a->plan.steps[i].process != data_b->plan.steps[i].process || !dsp_same_node( data_a, data_b, data_a->plan.steps[i].node_type ) ) {
+      return( false );
+    }
+  }
+
+  return( true );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the two channels mix, delay and decimate their input the same way
+// and run the same steps before the biquads
+//------------------------------------------------------------------------------------
+static bool dsp_same_input( dsp_data_t* data_a, dsp_data_t* data_b ) {
+
+  return( memcmp( data_a->mix_gain, data_b->mix_gain, sizeof( data_a->mix_gain ) ) == 0 &&
+    data_a->delay_samples == data_b->delay_samples && data_a->fraction.fraction == data_b->fraction.fraction &&
+    data_a->fraction.coeff == data_b->fraction.coeff && data_a->multirate.factor == data_b->multirate.factor &&
+    data_a->plan.filter_step == data_b->plan.filter_step && dsp_same_steps( data_a, data_b, 0, data_a->plan.filter_step ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the two banks run the same filters
+//------------------------------------------------------------------------------------
+static bool dsp_same_filters( dsp_bank_t* bank_a, dsp_bank_t* bank_b ) {
+
+  if( bank_a->num_filters != bank_b->num_filters ) {
+    return( false );
+  }
+
+  for( int i = 0; i < bank_a->num_filters; ++ i ) {
+    if( bank_a->filter[i].precision != bank_b->filter[i].precision ||
+        memcmp( bank_a->filter[i].coeffs_d, bank_b->filter[i].coeffs_d, sizeof( bank_a->filter[i].coeffs_d ) ) != 0 ) {
+      return( false );
+    }
+  }
+
+  return( true );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the two channels run the same crossover and FIR steps right after
+// the biquads, the output processing one channel can copy from the other
+//------------------------------------------------------------------------------------
+static bool dsp_same_output( dsp_data_t* data_a, dsp_data_t* data_b ) {
+
+  int               node_type;
+
+  if( data_a->plan.shared_steps != data_b->plan.shared_steps ) {
+    return( false );
+  }
+
+  for( int i = 0; i < data_a->plan.shared_steps; ++ i ) {
+    node_type = data_a->plan.steps[ data_a->plan.filter_step + i ].node_type;
+    if( node_type != data_b->plan.steps[ data_b->plan.filter_step + i ].node_type || !dsp_same_node( data_a, data_b, node_type ) ) {
+      return( false );
+    }
+  }
+
+  return( true );
+}
+
+
+//------------------------------------------------------------------------------------
+// Find the channels of a bank that have the same input and filters as an earlier
+// channel, which is the first one of the kind so it is always processed itself
+//------------------------------------------------------------------------------------
+static void dsp_share_bank( dsp_channel_t* channels, int bank_id ) {
+
+  dsp_bank_t*       bank;
+  int               input_id;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    bank = &channels[channel_id].data->bank[bank_id];
+    bank->share = -1;
+
+    input_id = channels[channel_id].data->share_input;
+    if( input_id < 0 ) {
+      continue;
+    }
+
+    for( int i = input_id; i < channel_id; ++ i ) {
+      if( ( i == input_id || channels[i].data->share_input == input_id ) && channels[i].data->bank[bank_id].share < 0 &&
+          dsp_same_filters( bank, &channels[i].data->bank[bank_id] ) ) {
+        bank->share = i;
+        break;
+      }
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Compile the channel graphs and find the channels whose processing matches an
+// earlier channel
+//
+// Called by dsp_filter_init. The inputs are compared once, the filters again every
+// time a bank is loaded. After changing the mixing, delay, decimation, crossover or
+// FIR of a channel it has to be called again followed by dsp_resync, while the DSP
+// task is stopped.
+//------------------------------------------------------------------------------------
+void dsp_share_channels( dsp_channel_t* channels ) {
+
+  dsp_graph_plan( channels );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    channels[channel_id].data->share_input = -1;
+    Output_Share[channel_id] = -1;
+
+    for( int i = 0; i < channel_id; ++ i ) {
+      if( channels[i].data->share_input < 0 && dsp_same_input( channels[channel_id].data, channels[i].data ) ) {
+        channels[channel_id].data->share_input = i;
+        break;
+      }
+    }
+  }
+
+  dsp_share_bank( channels, 0 );
+  dsp_share_bank( channels, 1 );
+}
+
+
 //------------------------------------------------------------------------------------
 // Initialize the DSP filters
+//
+// Filter_biquads are the biquads of filter_defs designed at compile time, or NULL to
+// calculate them here.
 //------------------------------------------------------------------------------------
-esp_err_t dsp_filter_init( dsp_channel_t* channels, biquad_def_t* biquad_defs, int biquad_def_count, filter_def_t* filter_defs, int filter_def_count ) {
+esp_err_t dsp_filter_init( dsp_channel_t* channels, const biquad_def_t* biquad_defs, int biquad_def_count, const filter_def_t* filter_defs, int filter_def_count, const biquad_def_t* filter_biquads ) {
 
   dsp_channel_t*    channel;
   dsp_data_t*       dsp_data;
   biquad_def_t*     import_defs;
   int               import_def_count;
+  fir_def_t*        fir_defs;
+  int               fir_def_count;
 
   // Load imported filters
   import_defs = dsp_import_filters( &import_def_count );
@@ -244,6 +746,15 @@ esp_err_t dsp_filter_init( dsp_channel_t* channels, biquad_def_t* biquad_defs, i
     return( ESP_FAIL );
   }
 
+  fir_defs = dsp_import_fir( &fir_def_count );
+  if( fir_defs == NULL ) {
+    return( ESP_FAIL );
+  }
+
+  if( dsp_plan_buffers() == ESP_FAIL ) {
+    return( ESP_FAIL );
+  }
+
   for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
 
     channel = &channels[channel_id];
@@ -253,270 +764,1325 @@ esp_err_t dsp_filter_init( dsp_channel_t* channels, biquad_def_t* biquad_defs, i
     if( dsp_data == NULL ) {
       return( ESP_FAIL );
     }
+    dsp_dither_init( &dsp_data->dither, channel_id );
+
+    if( dsp_load_biquads( channel, &dsp_data->bank[bank_active], channel_id, import_defs, import_def_count ) == ESP_FAIL ) {
+      return( ESP_FAIL );
+    }
 
-    if( dsp_load_biquads( channel, channel_id, import_defs, import_def_count ) == ESP_FAIL ) {
+    if( dsp_load_biquads( channel, &dsp_data->bank[bank_active], channel_id, biquad_defs, biquad_def_count ) == ESP_FAIL ) {
       return( ESP_FAIL );
     }
 
-    if( dsp_load_biquads( channel, channel_id, biquad_defs, biquad_def_count ) == ESP_FAIL ) {
+    if( dsp_load_filters( channel, &dsp_data->bank[bank_active], channel_id, filter_defs, filter_def_count, filter_biquads, false ) == ESP_FAIL ) {
       return( ESP_FAIL );
     }
 
-    if( dsp_load_filters( channel, channel_id, filter_defs, filter_def_count, false ) == ESP_FAIL ) {
+    if( dsp_load_fir( channels, channel_id, fir_defs, fir_def_count ) == ESP_FAIL ) {
       return( ESP_FAIL );
     }
   }
 
+  dsp_share_channels( channels );
+
   return( ESP_OK );
 }
 
 
 //------------------------------------------------------------------------------------
 // Update the DSP filters
+//
+// The new filters are loaded into the bank not used by the DSP task and swapped in
+// at the next block boundary, so the audio is never processed with half written
+// coefficients and filtering is never bypassed during the update. While the DSP
+// task is still running a transition on both banks ESP_ERR_INVALID_STATE is
+// returned and the update should be retried.
 //------------------------------------------------------------------------------------
-esp_err_t dsp_update_filters( filter_def_t* filter_defs, int filter_def_count ) {
+esp_err_t dsp_update_filters( const filter_def_t* filter_defs, int filter_def_count ) {
 
-  // Stop filter processing
-  filter_update = true;
+  int         bank_id;
+
+  // Take back an update the DSP task has not swapped in yet, otherwise use the bank
+  // released by the DSP task
+  bank_id = __atomic_exchange_n( &bank_pending, -1, __ATOMIC_ACQ_REL );
+  if( bank_id < 0 ) {
+    bank_id = __atomic_exchange_n( &bank_free, -1, __ATOMIC_ACQ_REL );
+    if( bank_id < 0 ) {
+      return( ESP_ERR_INVALID_STATE );
+    }
+  }
 
   // Load the update filters for each channel
   for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
     
-    if( dsp_load_filters( &DSP_Channels[ channel_id ], channel_id, filter_defs, filter_def_count, true ) == ESP_FAIL ) {
+    if( dsp_load_filters( &DSP_Channels[ channel_id ], &DSP_Channels[ channel_id ].data->bank[ bank_id ], channel_id, filter_defs, filter_def_count, NULL, true ) == ESP_FAIL ) {
+      __atomic_store_n( &bank_free, bank_id, __ATOMIC_RELEASE );
       return( ESP_FAIL );
     }
   } 
 
-  // Re-enable filter processing 
-  filter_update = false;
+  dsp_share_bank( DSP_Channels, bank_id );
+
+  // Hand the bank to the DSP task
+  bank_published = bank_id;
+  __atomic_store_n( &bank_pending, bank_id, __ATOMIC_RELEASE );
   
   return( ESP_OK );
 }
 
 
 //------------------------------------------------------------------------------------
-// Process the input buffer
+// Change a single filter of a channel
+//
+// Only the biquad of the edited filter is recalculated. The DSP task moves it to the
+// new coefficients at the next block boundary, interpolating over the transition
+// length unless transitions are off, and all other filters keep running untouched.
+// ESP_ERR_INVALID_STATE is returned while a previous edit, a filter update or a
+// transition is still in progress and the edit should be retried.
 //------------------------------------------------------------------------------------
-static esp_err_t dsp_process_input( dsp_channel_t* channel, int sample_count, sample_t* input_buffer, bool* clip_flag, bool filters_enabled ) {
-
-  dsp_data_t*       dsp_data;
-  int               num_inputs;
-  int               delay_samples;
-  int               delay_offset;
-  sample_t*         delay_buff;
-  int               input_channel;
-  sample_t          input_value; 
-  int               max_level;  
+esp_err_t dsp_edit_filter( int channel_id, int filter_id, const filter_def_t* filter_def ) {
 
-  dsp_data = channel->data;
+  dsp_bank_t*     bank;
+  dsp_filter_t    filter;
 
-  // Determine number of input channels
-  num_inputs = 0;
-  for( int i = 0; i < DSP_NUM_CHANNELS; ++ i ) {
-    if( channel->inputs[i] ) {
-      ++ num_inputs;
-    }
+  if( channel_id < 0 || channel_id >= DSP_NUM_CHANNELS ) {
+    dsp_printf( "E-DSP: ERROR: Invalid channel '%d'\r\n", channel_id );
+    return( ESP_FAIL );
   }
 
-  // If no input channels, set to 1 to avoid DIV/0
-  if( num_inputs == 0 ) {
-    num_inputs = 1;
-  }  
+  bank = &DSP_Channels[ channel_id ].data->bank[ bank_published ];
 
-  // Set delay parameters
-  if( filters_enabled ) {
-    delay_samples = dsp_data->delay_samples;
-    delay_offset = dsp_data->delay_offset;
-  } else {
-    delay_samples = 0;
-    delay_offset = 0;
+  if( filter_id < 0 || filter_id >= bank->num_filters ) {
+    dsp_printf( "E-DSP: ERROR: Invalid filter '%d' for channel '%s'\r\n", filter_id + 1, DSP_Channels[ channel_id ].name );
+    return( ESP_FAIL );
   }
-  
-  delay_buff = &dsp_data->delay_buff[0]; 
 
-  max_level = 0;  
- 
-  for( int i = 0; i < sample_count; ++ i ) {
-    // Output the delayed samples from the delay buffer
-    Biquad_Buff_F32[i] = delay_buff[delay_offset];
+  // The DSP task must be running the published bank on its own
+  if( __atomic_load_n( &edit_pending, __ATOMIC_ACQUIRE ) || __atomic_load_n( &bank_pending, __ATOMIC_ACQUIRE ) >= 0 ||
+      __atomic_load_n( &bank_free, __ATOMIC_ACQUIRE ) < 0 ) {
+    return( ESP_ERR_INVALID_STATE );
+  }
 
-    // Replace the delay buffer sample with the next sample(s) from the input stream
-    input_value = 0;
-    for( input_channel = 0; input_channel < DSP_NUM_CHANNELS; ++ input_channel ) {
-      input_value += ( ( input_buffer[i*DSP_NUM_CHANNELS + input_channel]/num_inputs )>>SAMPLE_NULL_BITS )*channel->inputs[input_channel];
-    }
-    delay_buff[delay_offset] = input_value;
+  if( dsp_get_biquad_rate( filter_def, (double) DSP_SAMPLE_RATE/DSP_Channels[ channel_id ].data->multirate.factor, filter.coeffs_d ) != ESP_OK ) {
+    return( ESP_FAIL );
+  }
 
-    if( abs( input_value ) > max_level ) {
-      max_level = abs( input_value );
-    }
+#ifdef DOUBLE_PRECISION
+  filter.precision = filter_def->precision;
+#else
+  filter.precision = PRC_AUTO;
+#endif
+  dsp_set_precision( &filter, (double) DSP_SAMPLE_RATE/DSP_Channels[ channel_id ].data->multirate.factor );
 
-    if( abs( input_value ) >= DSP_MAX_LEVEL ) {      
-       // Set clipping flag
-      *clip_flag = true;        
-      ++dsp_data->in_clip_count;          
-    }
-    
-    // Increment the delay buffer pointer and wrap it when at end of delay buffer     
-    if( delay_offset == delay_samples ) {
-      delay_offset = 0;
-    } else {
-      ++ delay_offset;   
-    }
-  }
+  // Set up the edit for the DSP task
+  edit_channel = channel_id;
+  edit_filter = filter_id;
+  edit_precision = filter.precision;
+  edit_precision_auto = filter.precision_auto;
+  edit_block = 0;
+  edit_length = ( transition_mode == DSP_TRANSITION_NONE || transition_blocks <= 0 ) ? 1 : transition_blocks;
+  memcpy( edit_coeffs_from, bank->filter[ filter_id ].coeffs_d, sizeof( edit_coeffs_from ) );
+  memcpy( edit_coeffs_to, filter.coeffs_d, sizeof( edit_coeffs_to ) );
 
-  // Update the buffer pointer
-  dsp_data->delay_offset = delay_offset;
+  Edit_Defs[ channel_id ][ filter_id ] = *filter_def;
+  bank->filter[ filter_id ].filter_def = &Edit_Defs[ channel_id ][ filter_id ];
 
-  // Set the input max level
-  dsp_data->in_max_level = max_level; 
+  __atomic_store_n( &edit_pending, 1, __ATOMIC_RELEASE );
 
   return( ESP_OK );
 }
 
 
 //------------------------------------------------------------------------------------
-// Process the filters 
+// Return the most recently loaded filter bank of the channel
 //------------------------------------------------------------------------------------
-static esp_err_t dsp_process_filters( dsp_data_t* dsp_data, int sample_count ) {
+dsp_bank_t* dsp_get_bank( dsp_data_t* dsp_data ) {
 
-  esp_err_t         res;
+  return( &dsp_data->bank[ bank_published ] );
+}
 
-  // Process each biquad filter in the channel
-  if( dsp_data->num_filters > 0 ){
-    
-    int filter_id = 0;
-    while( true ) {
-      if( dsp_data->filter[filter_id].precision == PRC_DBL ) {
-        res = dsps_biquad_f32_dbl( Biquad_Buff_F32, Biquad_Buff_F32, sample_count, dsp_data->filter[filter_id].coeffs_d, dsp_data->filter[filter_id].w );        
-      } else {
-        res = dsps_biquad_f32_ae32( Biquad_Buff_F32, Biquad_Buff_F32, sample_count, dsp_data->filter[filter_id].coeffs_f, dsp_data->filter[filter_id].w );
-      }
-      
-      if( res != ESP_OK ) {
-        SERIAL.printf( "E-DSP: ERROR: Failure during biquad processing = '%d'\r\n", res );
-        return( res );
-      }
 
-      ++ filter_id;
-      if( filter_id == dsp_data->num_filters ) {
-        break;
-      }
-    }
+//------------------------------------------------------------------------------------
+// Deinterleave the I2S input block into planar buffers
+//
+// The null bits of the samples are removed by the scale, which is 1.0 for 16 bit
+// samples and is then optimized away by the compiler.
+//------------------------------------------------------------------------------------
+static void dsp_deinterleave( sample_t* input_buffer, float** planes, int sample_count ) {
+
+  const float       scale = 1.0f/( 1 << SAMPLE_NULL_BITS );
+  int               i;
+
+#if DSP_NUM_CHANNELS == 2
+  float*            left = planes[0];
+  float*            right = planes[1];
+
+  for( i = 0; i + 4 <= sample_count; i += 4 ) {
+    left[i] = input_buffer[2*i]*scale;
+    right[i] = input_buffer[2*i + 1]*scale;
+    left[i + 1] = input_buffer[2*i + 2]*scale;
+    right[i + 1] = input_buffer[2*i + 3]*scale;
+    left[i + 2] = input_buffer[2*i + 4]*scale;
+    right[i + 2] = input_buffer[2*i + 5]*scale;
+    left[i + 3] = input_buffer[2*i + 6]*scale;
+    right[i + 3] = input_buffer[2*i + 7]*scale;
+  }
+  for( ; i < sample_count; ++ i ) {
+    left[i] = input_buffer[2*i]*scale;
+    right[i] = input_buffer[2*i + 1]*scale;
   }
+#else
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    float*          plane = planes[channel_id];
+    sample_t*       input = &input_buffer[channel_id];
 
-  return( res );
+    for( i = 0; i < sample_count; ++ i ) {
+      plane[i] = input[i*DSP_NUM_CHANNELS]*scale;
+    }
+  }
+#endif
 }
 
 
 //------------------------------------------------------------------------------------
-// Process the output buffer
+// Check if every channel takes its own input alone at unity gain. The input block is
+// then deinterleaved straight into the channel buffers, saving the mixing pass.
 //------------------------------------------------------------------------------------
-static esp_err_t dsp_process_output( dsp_channel_t* channel, int channel_id, int sample_count, sample_t* output_buffer, bool* clip_flag, bool filters_enabled ) {
+static bool dsp_direct_input( dsp_channel_t* channels ) {
 
-  dsp_data_t*       dsp_data;  
-  sample_t          output_value;
-  sample_t          prev_value;
-  int               max_level;
-  float             scaling_factor;
+  float*            mix_gain;
 
-  dsp_data = channel->data;
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    mix_gain = channels[channel_id].data->mix_gain;
 
-  if( filters_enabled ) {
-    scaling_factor = dsp_data->scaling_factor;      
-  } else {
-    scaling_factor = 1.0;
+    for( int input_channel = 0; input_channel < DSP_NUM_CHANNELS; ++ input_channel ) {
+      if( mix_gain[input_channel] != ( ( input_channel == channel_id ) ? 1.0f : 0.0f ) ) {
+        return( false );
+      }
+    }
   }
-    
-  // Copy results of filter processing to the output filter
-  prev_value = 0;
-  max_level = 0;
-  
-  for( int i = 0; i < sample_count; ++ i ) {
-    output_value = (int32_t) ( Biquad_Buff_F32[i]*scaling_factor );
-    
-    if( DITHER_ON ) {
-      output_value = dsp_dither( output_value );
+
+  return( true );
+}
+
+
+//------------------------------------------------------------------------------------
+// Count the passes over a block between the I2S buffer and the channel buffers, and
+// the bytes they read and write: the deinterleave, the mixing of each selected input
+// unless the input is direct, and the interleave. The steps are not included.
+//------------------------------------------------------------------------------------
+int dsp_block_passes( dsp_channel_t* channels, int sample_count, int* bytes_moved ) {
+
+  dsp_data_t*       dsp_data;
+  int               buffer_len;
+  int               plane_len;
+  int               passes;
+  bool              mixed;
+
+  buffer_len = sample_count*DSP_NUM_CHANNELS*sizeof( sample_t );
+  plane_len = sample_count*sizeof( float );
+
+  passes = 2;
+  *bytes_moved = 2*( buffer_len + DSP_NUM_CHANNELS*plane_len );
+
+  if( dsp_direct_input( channels ) ) {
+    return( passes );
+  }
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_data = channels[channel_id].data;
+    if( dsp_data->share_input >= 0 ) {
+      continue;
     }
-    
-    // Check if value out of range
-    if( output_value < -DSP_MAX_LEVEL || output_value > DSP_MAX_LEVEL ) {          
-       // Set clipping flag
-      *clip_flag = true;
-      ++ dsp_data->out_clip_count;
 
-      // Set sample to limit audible distortion
-      output_value = ( ( DSP_MAX_LEVEL*( output_value < 0 ? -1 : 1 ) ) + prev_value )/2;
+    // The first input is written, the others are added to the buffer
+    mixed = false;
+    for( int input_channel = 0; input_channel < DSP_NUM_CHANNELS; ++ input_channel ) {
+      if( dsp_data->mix_gain[input_channel] != 0 ) {
+        ++ passes;
+        *bytes_moved += ( mixed ? 3 : 2 )*plane_len;
+        mixed = true;
+      }
     }
 
-    output_buffer[i*DSP_NUM_CHANNELS + channel_id] = output_value << SAMPLE_NULL_BITS;
-    
-    if( abs( output_value ) > max_level ) {
-      max_level = abs( output_value );
+    if( !mixed ) {
+      ++ passes;
+      *bytes_moved += plane_len;
     }
+  }
+
+  return( passes );
+}
+
+
+//------------------------------------------------------------------------------------
+// Mix the planar inputs of a channel one input at a time, skipping inputs not
+// selected
+//------------------------------------------------------------------------------------
+static void dsp_mix_input( dsp_channel_t* channel, int sample_count, float* biquad_buffer ) {
+
+  float*            mix_gain;
+  float*            input;
+  float             gain;
+  bool              mixed;
+
+  mix_gain = channel->data->mix_gain;
+
+  mixed = false;
+  for( int input_channel = 0; input_channel < DSP_NUM_CHANNELS; ++ input_channel ) {
+    gain = mix_gain[input_channel];
+    input = Input_F32[input_channel];
+
+    if( gain == 0 ) {
+      continue;
+    }
+
+    if( !mixed ) {
+      for( int i = 0; i < sample_count; ++ i ) {
+        biquad_buffer[i] = gain*input[i];
+      }
+      mixed = true;
+    } else {
+      for( int i = 0; i < sample_count; ++ i ) {
+        biquad_buffer[i] += gain*input[i];
+      }
+    }
+  }
+
+  if( !mixed ) {
+    memset( biquad_buffer, 0, sample_count*sizeof( float ) );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Run the steps first to last - 1 of the plan of a channel on its buffer
+//------------------------------------------------------------------------------------
+static inline void dsp_run_steps( dsp_data_t* dsp_data, int first, int last, float* biquad_buffer, int sample_count, bool* clip_flag, bool filters_enabled ) {
+
+  dsp_step_t*       steps;
+
+  steps = dsp_data->plan.steps;
+
+  for( int i = first; i < last; ++ i ) {
+    if( steps[i].process( dsp_data, biquad_buffer, sample_count, filters_enabled ) > 0 ) {
+      *clip_flag = true;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Select the biquad kernel used to process the filters
+//------------------------------------------------------------------------------------
+void dsp_set_kernel( int kernel ) {
+
+  filter_kernel = kernel;
+}
+
+int dsp_get_kernel() {
+
+  return( filter_kernel );
+}
+
+
+//------------------------------------------------------------------------------------
+// Set/get the transition used when updated filters are swapped in
+//------------------------------------------------------------------------------------
+void dsp_set_transition( int mode, int blocks ) {
+
+  transition_mode = mode;
+  transition_blocks = blocks;
+}
+
+int dsp_get_transition() {
+
+  return( transition_mode );
+}
+
+
+//------------------------------------------------------------------------------------
+// Process the filters 
+//------------------------------------------------------------------------------------
+static esp_err_t dsp_process_filters( dsp_bank_t* bank, float* biquad_buffer, int sample_count ) {
+
+  esp_err_t         res;
+
+  res = ESP_OK;
+
+  // Run the whole chain sample by sample
+  if( filter_kernel == DSP_KERNEL_CASCADE ) {
+    return( dsp_biquad_cascade( biquad_buffer, sample_count, bank->filter, bank->num_filters ) );
+  }
+
+  // Process each biquad filter in the channel
+  if( bank->num_filters > 0 ){
     
-    prev_value = output_value;
+    int filter_id = 0;
+    while( true ) {
+      res = dsp_biquad_filter( biquad_buffer, sample_count, &bank->filter[filter_id] );
+      
+      if( res != ESP_OK ) {
+        dsp_printf( "E-DSP: ERROR: Failure during biquad processing = '%d'\r\n", res );
+        return( res );
+      }
+
+      ++ filter_id;
+      if( filter_id == bank->num_filters ) {
+        break;
+      }
+    }
+  }
+
+  return( res );
+}
+
+
+//------------------------------------------------------------------------------------
+// Convert an output sample to an integer and saturate it
+//------------------------------------------------------------------------------------
+static inline sample_t dsp_pack_sample( float value ) {
+
+  int32_t           sample;
+
+  sample = (int32_t) value;
+
+  sample = ( sample > DSP_MAX_LEVEL ) ? DSP_MAX_LEVEL : sample;
+  sample = ( sample < -DSP_MAX_LEVEL ) ? -DSP_MAX_LEVEL : sample;
+
+  return( (sample_t) ( sample << SAMPLE_NULL_BITS ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Interleave the planar output buffers into the I2S output block, dithering the
+// channels whose graph ends with a dither node first
+//------------------------------------------------------------------------------------
+static void dsp_interleave( dsp_channel_t* channels, sample_t* output_buffer, int sample_count ) {
+
+  int               i;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    if( channels[channel_id].data->plan.dither ) {
+      dsp_dither_process( &channels[channel_id].data->dither, Biquad_Buff_F32[channel_id], sample_count );
+    }
+  }
+
+#if DSP_NUM_CHANNELS == 2
+  float*            left = Biquad_Buff_F32[0];
+  float*            right = Biquad_Buff_F32[1];
+
+  for( i = 0; i + 4 <= sample_count; i += 4 ) {
+    output_buffer[2*i] = dsp_pack_sample( left[i] );
+    output_buffer[2*i + 1] = dsp_pack_sample( right[i] );
+    output_buffer[2*i + 2] = dsp_pack_sample( left[i + 1] );
+    output_buffer[2*i + 3] = dsp_pack_sample( right[i + 1] );
+    output_buffer[2*i + 4] = dsp_pack_sample( left[i + 2] );
+    output_buffer[2*i + 5] = dsp_pack_sample( right[i + 2] );
+    output_buffer[2*i + 6] = dsp_pack_sample( left[i + 3] );
+    output_buffer[2*i + 7] = dsp_pack_sample( right[i + 3] );
+  }
+  for( ; i < sample_count; ++ i ) {
+    output_buffer[2*i] = dsp_pack_sample( left[i] );
+    output_buffer[2*i + 1] = dsp_pack_sample( right[i] );
+  }
+#else
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    float*          plane = Biquad_Buff_F32[channel_id];
+    sample_t*       output = &output_buffer[channel_id];
+
+    for( i = 0; i < sample_count; ++ i ) {
+      output[i*DSP_NUM_CHANNELS] = dsp_pack_sample( plane[i] );
+    }
+  }
+#endif
+}
+
+
+//------------------------------------------------------------------------------------
+// Apply the filters of each channel's bank to its buffer with the selected kernel.
+// Decimated channels have fewer samples, so only channels running at the same rate
+// are paired. Channels sharing the filters of an earlier channel copy its output.
+//------------------------------------------------------------------------------------
+static void dsp_filter_banks( dsp_bank_t** banks, float** biquad_buffers, int* sample_counts ) {
+
+  int               run_ids[ DSP_NUM_CHANNELS ];
+  int               run_count;
+  int               channel_id;
+  int               next_id;
+  int               i;
+
+  run_count = 0;
+  for( channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
+    if( banks[channel_id]->share < 0 ) {
+      run_ids[run_count ++] = channel_id;
+    }
+  }
+
+  i = 0;
+
+  if( filter_kernel == DSP_KERNEL_PAIRED ) {
+    // Filter the channels two at a time
+    for( ; i + 1 < run_count; i += 2 ) {
+      channel_id = run_ids[i];
+      next_id = run_ids[i + 1];
+      if( sample_counts[channel_id] == sample_counts[next_id] ) {
+        dsp_biquad_cascade_pair( biquad_buffers[channel_id], banks[channel_id]->filter, banks[channel_id]->num_filters,
+          biquad_buffers[next_id], banks[next_id]->filter, banks[next_id]->num_filters, sample_counts[channel_id] );
+      } else {
+        dsp_process_filters( banks[channel_id], biquad_buffers[channel_id], sample_counts[channel_id] );
+        dsp_process_filters( banks[next_id], biquad_buffers[next_id], sample_counts[next_id] );
+      }
+    }
+  }
+
+  for( ; i < run_count; ++ i ) {
+    dsp_process_filters( banks[run_ids[i]], biquad_buffers[run_ids[i]], sample_counts[run_ids[i]] );
+  }
+
+  for( channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
+    if( banks[channel_id]->share >= 0 ) {
+      memcpy( biquad_buffers[channel_id], biquad_buffers[banks[channel_id]->share], sample_counts[channel_id]*sizeof( float ) );
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the profiled channel copies the output of an earlier channel
+//------------------------------------------------------------------------------------
+static bool dsp_profile_output_shared( dsp_channel_t* channels, int channel_id ) {
+
+  int               share_id;
+
+  share_id = dsp_get_bank( channels[channel_id].data )->share;
+
+  return( profile_shared && share_id >= 0 && dsp_same_output( channels[channel_id].data, channels[share_id].data ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Profile the filters at the passed block size and return the average cycles per
+// block. The filters of the most recently loaded bank are run on copies, so the
+// audio is not affected. While crossfading both banks are run, which is included.
+// Decimated channels are profiled with their reduced rate block plus the cost of
+// the decimation and interpolation filters. Shared processing is only counted once
+// unless profile_shared is cleared.
+//------------------------------------------------------------------------------------
+static uint32_t dsp_profile_banks( dsp_channel_t* channels, int block_samples ) {
+
+  dsp_bank_t*       banks[ DSP_NUM_CHANNELS ];
+  float*            buffers[ DSP_NUM_CHANNELS ];
+  int               counts[ DSP_NUM_CHANNELS ];
+  int               sample_count;
+  int               input_id;
+  int               passes;
+  uint32_t          start;
+  uint32_t          cycles;
+
+  sample_count = block_samples/DSP_NUM_CHANNELS;
+  passes = ( transition_mode == DSP_TRANSITION_CROSSFADE ) ? 2 : 1;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    Profile_Bank[channel_id] = *dsp_get_bank( channels[channel_id].data );
+    if( !profile_shared ) {
+      Profile_Bank[channel_id].share = -1;
+    }
+    for( int i = 0; i < Profile_Bank[channel_id].num_filters; ++ i ) {
+      dsp_biquad_reset( &Profile_Bank[channel_id].filter[i] );
+    }
+    banks[channel_id] = &Profile_Bank[channel_id];
+    buffers[channel_id] = Profile_Buff_F32[channel_id];
+    Profile_Multirate[channel_id] = channels[channel_id].data->multirate;
+    if( Profile_Multirate[channel_id].factor > 1 ) {
+      Profile_Multirate[channel_id].dec_hist = Profile_Hist_F32;
+      Profile_Multirate[channel_id].int_hist = &Profile_Hist_F32[2*Profile_Multirate[channel_id].taps];
+      dsp_multirate_reset( &Profile_Multirate[channel_id] );
+    }
+  }
+
+  cycles = 0;
+  for( int block = 0; block < DSP_PROFILE_WARMUP + DSP_PROFILE_BLOCKS; ++ block ) {
+    // Low level test signal, so the filter values stay in the normal range
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      for( int i = 0; i < sample_count; ++ i ) {
+        Profile_Buff_F32[channel_id][i] = ( ( block*sample_count + i ) & 0x3F ) - 32;
+      }
+    }
+
+    start = dsp_get_cycles();
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      counts[channel_id] = sample_count;
+      input_id = channels[channel_id].data->share_input;
+      if( profile_shared && input_id >= 0 && Profile_Multirate[channel_id].factor > 1 ) {
+        counts[channel_id] = counts[input_id];
+        memcpy( Profile_Decim_F32[channel_id], Profile_Decim_F32[input_id], counts[channel_id]*sizeof( float ) );
+        buffers[channel_id] = Profile_Decim_F32[channel_id];
+      } else if( Profile_Multirate[channel_id].factor > 1 ) {
+        counts[channel_id] = dsp_decimate( &Profile_Multirate[channel_id], Profile_Buff_F32[channel_id], sample_count, Profile_Decim_F32[channel_id] );
+        buffers[channel_id] = Profile_Decim_F32[channel_id];
+      }
+    }
+
+    for( int pass = 0; pass < passes; ++ pass ) {
+      dsp_filter_banks( banks, buffers, counts );
+    }
+
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      if( dsp_profile_output_shared( channels, channel_id ) ) {
+        memcpy( Profile_Buff_F32[channel_id], Profile_Buff_F32[Profile_Bank[channel_id].share], sample_count*sizeof( float ) );
+      } else if( Profile_Multirate[channel_id].factor > 1 ) {
+        dsp_interpolate( &Profile_Multirate[channel_id], Profile_Decim_F32[channel_id], Profile_Buff_F32[channel_id], sample_count );
+      }
+    }
+
+    if( block >= DSP_PROFILE_WARMUP ) {
+      cycles += dsp_get_cycles() - start;
+    }
+  }
+
+  return( cycles/DSP_PROFILE_BLOCKS );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the cycles per block of the channel FIRs and crossovers at the passed block
+// size. Blocks smaller than a FIR partition only run a partition every few blocks,
+// which is averaged.
+//------------------------------------------------------------------------------------
+static uint32_t dsp_profile_fir( dsp_channel_t* channels, int block_samples ) {
+
+  dsp_data_t*       dsp_data;
+  dsp_plan_t*       plan;
+  int               shared_end;
+  uint64_t          cycles;
+
+  cycles = 0;
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_data = channels[channel_id].data;
+    plan = &dsp_data->plan;
+
+    // The steps copied from another channel are not run
+    shared_end = dsp_profile_output_shared( channels, channel_id ) ? plan->filter_step + plan->shared_steps : 0;
+
+    for( int i = 0; i < plan->step_count; ++ i ) {
+      if( i >= plan->filter_step && i < shared_end ) {
+        continue;
+      }
+
+      if( plan->steps[i].node_type == DSP_NODE_FIR ) {
+        cycles += (uint64_t) dsp_fir_profile( dsp_data->fir->partitions )*block_samples/DSP_NUM_CHANNELS/DSP_FIR_PARTITION;
+      } else if( plan->steps[i].node_type == DSP_NODE_CROSSOVER ) {
+        cycles += dsp_crossover_profile( dsp_data->crossover->taps, block_samples/DSP_NUM_CHANNELS );
+      }
+    }
+  }
+
+  return( (uint32_t) cycles );
+}
+
+
+//------------------------------------------------------------------------------------
+// Profile the filters and FIRs at the passed block size and return the average
+// cycles per block
+//------------------------------------------------------------------------------------
+uint32_t dsp_profile_block( dsp_channel_t* channels, int block_samples ) {
+
+  return( dsp_profile_banks( channels, block_samples ) + dsp_profile_fir( channels, block_samples ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the cycles the filters may use per block of the passed size
+//------------------------------------------------------------------------------------
+static uint32_t dsp_block_budget( int block_samples ) {
+
+  return( (uint32_t) ( (double) block_samples/DSP_NUM_CHANNELS*DSP_CPU_MHZ*1e6/DSP_SAMPLE_RATE*DSP_BLOCK_BUDGET/100 ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Estimate the longest FIR every channel can run next to the current biquads and
+// crossovers within the block budget. The FIR cost is a fixed part for the FFTs plus a part for each
+// partition, which are measured separately.
+//------------------------------------------------------------------------------------
+static int dsp_fir_max_taps( dsp_channel_t* channels ) {
+
+  uint32_t          fixed;
+  uint32_t          slope;
+  uint32_t          used;
+  uint32_t          budget;
+  uint64_t          available;
+  int               partitions;
+  int               fir_count;
+
+  fixed = dsp_fir_profile( 1 );
+  slope = ( dsp_fir_profile( 9 ) - fixed )/8;
+  if( slope == 0 ) {
+    slope = 1;
+  }
+
+  // Channels copying the output of an earlier channel do not run a FIR of their own
+  used = dsp_profile_banks( channels, block_samples );
+  fir_count = 0;
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    if( dsp_profile_output_shared( channels, channel_id ) ) {
+      continue;
+    }
+
+    ++ fir_count;
+    if( channels[channel_id].data->crossover != NULL ) {
+      used += dsp_crossover_profile( channels[channel_id].data->crossover->taps, block_samples/DSP_NUM_CHANNELS );
+    }
+  }
+
+  budget = dsp_block_budget( block_samples );
+  if( used >= budget ) {
+    return( 0 );
+  }
+
+  // Cycles available to each channel per partition of input
+  available = (uint64_t) ( budget - used )*DSP_FIR_PARTITION/( block_samples/DSP_NUM_CHANNELS )/fir_count;
+  if( available < fixed ) {
+    return( 0 );
+  }
+
+  partitions = 1 + ( available - fixed )/slope;
+
+  return( ( partitions*DSP_FIR_PARTITION > DSP_FIR_MAX_TAPS ) ? DSP_FIR_MAX_TAPS : partitions*DSP_FIR_PARTITION );
+}
+
+
+//------------------------------------------------------------------------------------
+// Select the block size from the presets
+//
+// The size is rejected if the profiled cost of the current filters does not fit in
+// DSP_BLOCK_BUDGET percent of the block period. The rest is left for the input and
+// output processing and the I2S driver.
+//------------------------------------------------------------------------------------
+esp_err_t dsp_set_block_size( dsp_channel_t* channels, int block_samples_new ) {
+
+  bool              preset;
+  uint32_t          cycles;
+  uint32_t          budget;
+
+  preset = false;
+  for( int size : block_presets ) {
+    if( size == block_samples_new ) {
+      preset = true;
+    }
+  }
+
+  if( !preset || block_samples_new > DSP_MAX_SAMPLES ) {
+    dsp_printf( "E-DSP: Invalid block size = '%d'\r\n", block_samples_new );
+    return( ESP_FAIL );
+  }
+
+  cycles = dsp_profile_block( channels, block_samples_new );
+  budget = dsp_block_budget( block_samples_new );
+
+  dsp_printf( "I-DSP: Block size %d: filters use %u of %u cycles (%.1f%% of the block period)\r\n", block_samples_new, cycles, budget,
+    (double) cycles*DSP_BLOCK_BUDGET/budget );
+
+  if( cycles > budget ) {
+    dsp_printf( "E-DSP: Filters do not fit in a block of %d samples\r\n", block_samples_new );
+    return( ESP_FAIL );
   }
 
-  // Set the output max level
-  dsp_data->out_max_level = max_level;
+  __atomic_store_n( &block_samples, block_samples_new, __ATOMIC_RELEASE );
 
   return( ESP_OK );
 }
 
+int dsp_get_block_size() {
+
+  return( __atomic_load_n( &block_samples, __ATOMIC_ACQUIRE ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Set up the interpolated filters from the old and new banks
+//
+// Filter k of the old bank moves to filter k of the new bank. The shorter chain is
+// padded with pass-through filters, and the state of the old filter is carried over,
+// converted when the precision changes, so the transition does not restart the
+// filters from zero. A channel that shared the old filters takes their state
+// from the channel it shared them with.
+//------------------------------------------------------------------------------------
+static void dsp_transition_begin( dsp_channel_t* channels ) {
+
+  dsp_bank_t*       bank_from;
+  dsp_bank_t*       bank_to;
+  dsp_filter_t*     filter;
+  dsp_filter_t*     filter_from;
+  dsp_filter_t      filter_convert;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    bank_from = &channels[channel_id].data->bank[bank_previous];
+    bank_to = &channels[channel_id].data->bank[bank_active];
+
+    // Only shared if both banks were shared with the same channel
+    Transition_Bank[channel_id].share = ( bank_from->share == bank_to->share ) ? bank_to->share : -1;
+    if( bank_from->share >= 0 ) {
+      bank_from = &channels[bank_from->share].data->bank[bank_previous];
+    }
+
+    Transition_Bank[channel_id].num_filters = bank_from->num_filters > bank_to->num_filters ? bank_from->num_filters : bank_to->num_filters;
+
+    for( int i = 0; i < Transition_Bank[channel_id].num_filters; ++ i ) {
+      filter = &Transition_Bank[channel_id].filter[i];
+      filter_from = ( i < bank_from->num_filters ) ? &bank_from->filter[i] : NULL;
+
+      if( i < bank_to->num_filters ) {
+        *filter = bank_to->filter[i];
+      } else {
+        memset( filter, 0, sizeof( dsp_filter_t ) );
+        filter->precision = filter_from->precision;
+      }
+      dsp_biquad_reset( filter );
+
+      if( filter_from == NULL ) {
+        continue;
+      }
+
+      if( filter_from->precision == filter->precision ) {
+        filter->state = filter_from->state;
+      } else {
+        // Carry the state over to the new structure
+        filter_convert = *filter_from;
+        dsp_biquad_set_precision( &filter_convert, filter->precision );
+        filter->state = filter_convert.state;
+      }
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Set the interpolated filter coefficients for the current transition block
+//------------------------------------------------------------------------------------
+static void dsp_transition_interpolate( dsp_channel_t* channels ) {
+
+  dsp_bank_t*       bank_from;
+  dsp_bank_t*       bank_to;
+  dsp_filter_t*     filter;
+  double*           coeffs_from;
+  double*           coeffs_to;
+  double            fraction;
+
+  // The first block runs the old coefficients so that added pass-through filters
+  // fill their W values before they start to change
+  fraction = (double) transition_block/transition_length;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    bank_from = &channels[channel_id].data->bank[bank_previous];
+    bank_to = &channels[channel_id].data->bank[bank_active];
+
+    for( int i = 0; i < Transition_Bank[channel_id].num_filters; ++ i ) {
+      filter = &Transition_Bank[channel_id].filter[i];
+      coeffs_from = ( i < bank_from->num_filters ) ? bank_from->filter[i].coeffs_d : biquad_identity;
+      coeffs_to = ( i < bank_to->num_filters ) ? bank_to->filter[i].coeffs_d : biquad_identity;
+
+      dsp_interpolate_biquad( coeffs_from, coeffs_to, fraction, filter->coeffs_d );
+      dsp_biquad_quantize( filter );
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Copy the filter state of a bank into a bank with the same filters
+//------------------------------------------------------------------------------------
+static void dsp_copy_filter_state( dsp_bank_t* bank, dsp_bank_t* source ) {
+
+  for( int i = 0; i < bank->num_filters; ++ i ) {
+    bank->filter[i].state = source->filter[i].state;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the filters of two banks with the same filters are in the same state
+//------------------------------------------------------------------------------------
+static bool dsp_same_filter_state( dsp_bank_t* bank_a, dsp_bank_t* bank_b ) {
+
+  for( int i = 0; i < bank_a->num_filters; ++ i ) {
+    if( memcmp( &bank_a->filter[i].state, &bank_b->filter[i].state, sizeof( bank_a->filter[i].state ) ) != 0 ) {
+      return( false );
+    }
+  }
+
+  return( true );
+}
+
+
+//------------------------------------------------------------------------------------
+// Finish the transition and give the old bank back to the updating task
+//------------------------------------------------------------------------------------
+static void dsp_transition_end( dsp_channel_t* channels ) {
+
+  dsp_bank_t*       bank_to;
+  dsp_filter_t*     filter;
+
+  // The new filters continue from the state of the interpolated filters
+  if( transition_type == DSP_TRANSITION_INTERPOLATE ) {
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      bank_to = &channels[channel_id].data->bank[bank_active];
+
+      for( int i = 0; i < bank_to->num_filters; ++ i ) {
+        filter = &Transition_Bank[channel_id].filter[i];
+        bank_to->filter[i].state = filter->state;
+      }
+    }
+
+    // A channel that only shares the new filters came from different filters, so it
+    // keeps running them itself unless it ended up in the same state
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      bank_to = &channels[channel_id].data->bank[bank_active];
+
+      if( Transition_Bank[channel_id].share < 0 && bank_to->share >= 0 &&
+          !dsp_same_filter_state( bank_to, &channels[bank_to->share].data->bank[bank_active] ) ) {
+        bank_to->share = -1;
+      }
+    }
+  }
+
+  transition_type = DSP_TRANSITION_NONE;
+  __atomic_store_n( &bank_free, bank_previous, __ATOMIC_RELEASE );
+}
+
+
+//------------------------------------------------------------------------------------
+// Stop sharing the filters of the active bank between the edited channel and other
+// channels. The channels that were not processed get the state of the shared filters.
+//------------------------------------------------------------------------------------
+static void dsp_edit_unshare( dsp_channel_t* channels ) {
+
+  dsp_bank_t*       bank;
+  dsp_bank_t*       edit_bank;
+
+  edit_bank = &channels[edit_channel].data->bank[bank_active];
+
+  if( edit_bank->share >= 0 ) {
+    dsp_copy_filter_state( edit_bank, &channels[edit_bank->share].data->bank[bank_active] );
+    edit_bank->share = -1;
+  }
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    bank = &channels[channel_id].data->bank[bank_active];
+    if( bank->share == edit_channel ) {
+      dsp_copy_filter_state( bank, edit_bank );
+      bank->share = -1;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Move the edited filter one block further towards its new coefficients
+//------------------------------------------------------------------------------------
+static void dsp_edit_step( dsp_channel_t* channels ) {
+
+  dsp_filter_t*     filter;
+
+  if( edit_block == 0 ) {
+    dsp_edit_unshare( channels );
+  }
+
+  filter = &channels[edit_channel].data->bank[bank_active].filter[edit_filter];
+
+  // Switch the structure first, the state is converted so the output has no step
+  if( edit_block == 0 && filter->precision != edit_precision ) {
+    dsp_biquad_set_precision( filter, edit_precision );
+  }
+  filter->precision_auto = edit_precision_auto;
+
+  ++ edit_block;
+  dsp_interpolate_biquad( edit_coeffs_from, edit_coeffs_to, (double) edit_block/edit_length, filter->coeffs_d );
+
+  // Finish on the exact coefficients
+  if( edit_block >= edit_length ) {
+    memcpy( filter->coeffs_d, edit_coeffs_to, sizeof( filter->coeffs_d ) );
+  }
+
+  dsp_biquad_quantize( filter );
+
+  if( edit_block >= edit_length ) {
+    __atomic_store_n( &edit_pending, 0, __ATOMIC_RELEASE );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Filter a block during a transition
+//
+// Crossfade runs the old and new filters on the same input and fades linearly from
+// the old to the new output over the whole transition. Interpolate only runs one
+// set of filters whose coefficients move towards the new filters each block.
+//------------------------------------------------------------------------------------
+static void dsp_transition_filter( dsp_channel_t* channels, float** buffers, int* sample_counts ) {
+
+  dsp_bank_t*       banks[ DSP_NUM_CHANNELS ];
+  float*            fade_buffers[ DSP_NUM_CHANNELS ];
+  float*            buffer;
+  float*            fade_buffer;
+  int               sample_count;
+  float             gain;
+  float             gain_step;
+
+  if( transition_type == DSP_TRANSITION_INTERPOLATE ) {
+    dsp_transition_interpolate( channels );
+
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      banks[channel_id] = &Transition_Bank[channel_id];
+    }
+    dsp_filter_banks( banks, buffers, sample_counts );
+  } else {
+    // Run the old filters on a copy of the input
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      memcpy( Fade_Buff_F32[channel_id], buffers[channel_id], sample_counts[channel_id]*sizeof( float ) );
+      fade_buffers[channel_id] = Fade_Buff_F32[channel_id];
+      banks[channel_id] = &channels[channel_id].data->bank[bank_previous];
+    }
+    dsp_filter_banks( banks, fade_buffers, sample_counts );
+
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      banks[channel_id] = &channels[channel_id].data->bank[bank_active];
+    }
+    dsp_filter_banks( banks, buffers, sample_counts );
+
+    // Mix the outputs
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      buffer = buffers[channel_id];
+      fade_buffer = Fade_Buff_F32[channel_id];
+      sample_count = sample_counts[channel_id];
+      if( sample_count == 0 ) {
+        continue;
+      }
+
+      gain_step = 1.0f/( transition_length*sample_count );
+      gain = transition_block*sample_count*gain_step;
+
+      for( int i = 0; i < sample_count; ++ i ) {
+        gain += gain_step;
+        buffer[i] = fade_buffer[i] + ( buffer[i] - fade_buffer[i] )*gain;
+      }
+    }
+  }
+
+  if( ++ transition_block >= transition_length ) {
+    dsp_transition_end( channels );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the interpolation and shared crossover and FIR steps of two
+// channels with the same output processing are in the same state
+//------------------------------------------------------------------------------------
+static bool dsp_same_output_state( dsp_data_t* data_a, dsp_data_t* data_b ) {
+
+  dsp_multirate_t*  multirate_a;
+  dsp_multirate_t*  multirate_b;
+  dsp_plan_t*       plan;
+
+  multirate_a = &data_a->multirate;
+  multirate_b = &data_b->multirate;
+  plan = &data_a->plan;
+
+  if( multirate_a->factor > 1 && ( multirate_a->phase != multirate_b->phase || multirate_a->int_offset != multirate_b->int_offset ||
+      memcmp( multirate_a->int_hist, multirate_b->int_hist, 2*DSP_MULTIRATE_TAPS_PHASE*sizeof( float ) ) != 0 ) ) {
+    return( false );
+  }
+
+  for( int i = plan->filter_step; i < plan->filter_step + plan->shared_steps; ++ i ) {
+    if( plan->steps[i].node_type == DSP_NODE_CROSSOVER && !dsp_crossover_same_state( data_a->crossover, data_b->crossover ) ) {
+      return( false );
+    }
+
+    if( plan->steps[i].node_type == DSP_NODE_FIR && !dsp_fir_same_state( data_a->fir, data_b->fir ) ) {
+      return( false );
+    }
+  }
+
+  return( true );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the earlier channel whose interpolation, crossover and FIR output the
+// channel can copy this block, or -1. While crossfading both banks have to be shared
+// with the same channel. A channel only starts copying once the history of its
+// interpolation, crossover and FIR matches the other channel, so after running
+// different filters it keeps processing itself until the old output has passed.
+//------------------------------------------------------------------------------------
+static int dsp_output_share( dsp_channel_t* channels, int channel_id ) {
+
+  dsp_data_t*       dsp_data;
+  int               share_id;
+
+  dsp_data = channels[channel_id].data;
+
+  if( transition_type == DSP_TRANSITION_INTERPOLATE ) {
+    share_id = Transition_Bank[channel_id].share;
+  } else {
+    share_id = dsp_data->bank[bank_active].share;
+  }
+
+  if( transition_type == DSP_TRANSITION_CROSSFADE && dsp_data->bank[bank_previous].share != share_id ) {
+    share_id = -1;
+  }
+
+  if( share_id >= 0 && !dsp_same_output( dsp_data, channels[share_id].data ) ) {
+    share_id = -1;
+  }
+
+  if( share_id >= 0 && Output_Share[channel_id] != share_id && !dsp_same_output_state( dsp_data, channels[share_id].data ) ) {
+    share_id = -1;
+  }
+
+  return( share_id );
+}
+
+
+//------------------------------------------------------------------------------------
+// Give a channel that stops copying the output of another channel the state of the
+// interpolation and shared crossover and FIR steps of that channel, so it continues
+// seamlessly
+//------------------------------------------------------------------------------------
+static void dsp_output_fork( dsp_data_t* dsp_data, dsp_data_t* source ) {
+
+  dsp_plan_t*       plan;
+
+  plan = &dsp_data->plan;
+  dsp_multirate_copy_state( &dsp_data->multirate, &source->multirate );
+
+  for( int i = plan->filter_step; i < plan->filter_step + plan->shared_steps; ++ i ) {
+    if( plan->steps[i].node_type == DSP_NODE_CROSSOVER ) {
+      dsp_crossover_copy_state( dsp_data->crossover, source->crossover );
+    }
+
+    if( plan->steps[i].node_type == DSP_NODE_FIR ) {
+      dsp_fir_copy_state( dsp_data->fir, source->fir );
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Resynchronize the channels after a stream fault
+//
+// Every channel restarts with its configured delay from the first block after the
+// dropout, and the filters restart from silence instead of ringing on the
+// discontinuity. Only called by the DSP task, so nothing is allocated or printed and
+// the delay buffers are not cleared (see dsp_delay_resync).
+//------------------------------------------------------------------------------------
+void dsp_resync( dsp_channel_t* channels ) {
+
+  dsp_data_t*       dsp_data;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_data = channels[channel_id].data;
+
+    dsp_delay_resync( dsp_data );
+    dsp_multirate_reset( &dsp_data->multirate );
+
+    if( dsp_data->fir != NULL ) {
+      dsp_fir_reset( dsp_data->fir );
+    }
+
+    if( dsp_data->crossover != NULL ) {
+      dsp_crossover_reset( dsp_data->crossover );
+    }
+
+    dsp_limiter_reset( &dsp_data->limiter );
+    dsp_dither_reset( &dsp_data->dither );
+
+    for( int i = 0; i < dsp_data->bank[bank_active].num_filters; ++ i ) {
+      dsp_biquad_reset( &dsp_data->bank[bank_active].filter[i] );
+    }
+
+    // Filters of a running transition
+    if( transition_type != DSP_TRANSITION_NONE ) {
+      for( int i = 0; i < dsp_data->bank[bank_previous].num_filters; ++ i ) {
+        dsp_biquad_reset( &dsp_data->bank[bank_previous].filter[i] );
+      }
+      for( int i = 0; i < Transition_Bank[channel_id].num_filters; ++ i ) {
+        dsp_biquad_reset( &Transition_Bank[channel_id].filter[i] );
+      }
+    }
+  }
+
+  dsp_stats_stream( DSP_STREAM_RESYNC );
+}
+
 
 //------------------------------------------------------------------------------------
 // Process the audio stream by cascading the biquad filters and applying delay/gain
+//
+// The input block is deinterleaved before anything is written to the output block,
+// so both may be the same buffer and the block can be processed in place.
 //------------------------------------------------------------------------------------
 esp_err_t dsp_filter( dsp_channel_t* channels, sample_t* input_buffer, sample_t* output_buffer, int buffer_len, bool filters_enabled, bool* clip_flag ) {
 
-  esp_err_t         res;
-  dsp_channel_t*    channel;
   int               channel_id;
+  int               bank_id;
   dsp_data_t*       dsp_data;
+  dsp_bank_t*       banks[ DSP_NUM_CHANNELS ];
+  float*            buffers[ DSP_NUM_CHANNELS ];
+  int               counts[ DSP_NUM_CHANNELS ];
+  int               output_ids[ DSP_NUM_CHANNELS ];
+  dsp_multirate_t*  multirate;
+  int               input_id;
   int               sample_count;
+  uint32_t          stage_start;
+  uint32_t          stage_end;
   
   // Check if input sample count exceeded
   sample_count = buffer_len/sizeof( sample_t )/2;
 
   if( sample_count > DSP_MAX_SAMPLES ) {
-    SERIAL.printf( "E-DSP: Too many samples = '%d'\r\n", sample_count );
+    dsp_printf( "E-DSP: Too many samples = '%d'\r\n", sample_count );
     return( ESP_FAIL );
   }
 
   // Reset the clipping flag
   *clip_flag = false;
 
-  // If updating filters, temporarily turn off filters
-  if( filter_update ) {
-    filters_enabled = false;
+  // Apply a single filter edit, which holds back any bank update until it is done
+  if( transition_type == DSP_TRANSITION_NONE && __atomic_load_n( &edit_pending, __ATOMIC_ACQUIRE ) ) {
+    dsp_edit_step( channels );
+  } else if( transition_type == DSP_TRANSITION_NONE ) {
+    // Swap in updated filters at the block boundary
+    bank_id = __atomic_exchange_n( &bank_pending, -1, __ATOMIC_ACQUIRE );
+    if( bank_id >= 0 ) {
+      bank_previous = bank_active;
+      bank_active = bank_id;
+
+      if( transition_mode == DSP_TRANSITION_NONE || transition_blocks <= 0 || !filters_enabled ) {
+        __atomic_store_n( &bank_free, bank_previous, __ATOMIC_RELEASE );
+      } else {
+        transition_type = transition_mode;
+        transition_block = 0;
+        transition_length = transition_blocks;
+
+        if( transition_type == DSP_TRANSITION_INTERPOLATE ) {
+          dsp_transition_begin( channels );
+        }
+      }
+    }
+  } else if( !filters_enabled ) {
+    // Nothing to fade while the filters are bypassed
+    dsp_transition_end( channels );
+  }
+
+  stage_start = STATS_ON ? dsp_get_cycles() : 0;
+
+  // Process the input buffer. All channels are mixed before any further processing,
+  // as the input planes are reused for the decimated buffers.
+  if( dsp_direct_input( channels ) ) {
+    dsp_deinterleave( input_buffer, Biquad_Buff_F32, sample_count );
+  } else {
+    dsp_deinterleave( input_buffer, Input_F32, sample_count );
+
+    for( channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
+      if( channels[channel_id].data->share_input < 0 ) {
+        dsp_mix_input( &channels[channel_id], sample_count, Biquad_Buff_F32[channel_id] );
+      }
+    }
   }
 
   for( channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
-        
-    channel = &channels[channel_id];
-    dsp_data = channel->data;
+    dsp_data = channels[channel_id].data;
+    multirate = &dsp_data->multirate;
+
+    // Copy the input of an earlier channel processed the same way
+    input_id = dsp_data->share_input;
+    if( input_id >= 0 ) {
+      counts[channel_id] = counts[input_id];
+      buffers[channel_id] = ( buffers[input_id] == Decim_Buff_F32[input_id] ) ? Decim_Buff_F32[channel_id] : Biquad_Buff_F32[channel_id];
+      memcpy( buffers[channel_id], buffers[input_id], counts[channel_id]*sizeof( float ) );
+      dsp_data->in_max_level = channels[input_id].data->in_max_level;
+      dsp_data->in_clip_count = channels[input_id].data->in_clip_count;
+      continue;
+    }
 
-    // Process the input buffer
-    dsp_process_input( channel, sample_count, input_buffer, clip_flag, filters_enabled );      
+    dsp_run_steps( dsp_data, 0, dsp_data->plan.filter_step, Biquad_Buff_F32[channel_id], sample_count, clip_flag, filters_enabled );
+
+    // Band-limited channels are filtered at a reduced rate
+    if( filters_enabled && multirate->factor > 1 ) {
+      counts[channel_id] = dsp_decimate( multirate, Biquad_Buff_F32[channel_id], sample_count, Decim_Buff_F32[channel_id] );
+      buffers[channel_id] = Decim_Buff_F32[channel_id];
+    } else {
+      counts[channel_id] = sample_count;
+      buffers[channel_id] = Biquad_Buff_F32[channel_id];
+    }
+  }
 
-#ifdef DISPLAY_ON
-    // Send input level for display
-    dsp_display_input( channel_id, dsp_data->in_max_level, dsp_data->in_clip_count );
-#endif    
+  if( STATS_ON ) {
+    stage_end = dsp_get_cycles();
+    dsp_stats_add( DSP_STAGE_INPUT, stage_end - stage_start );
+    stage_start = stage_end;
+  }
 
-    // Apply the filters
-    if( filters_enabled ) {
-      dsp_process_filters( dsp_data, sample_count );
+  // Apply the filters
+  if( filters_enabled ) {
+    // Channels that stop copying the output of an earlier channel take over its state
+    // before any output is processed
+    for( channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
+      output_ids[channel_id] = dsp_output_share( channels, channel_id );
+      if( Output_Share[channel_id] >= 0 && output_ids[channel_id] != Output_Share[channel_id] ) {
+        dsp_output_fork( channels[channel_id].data, channels[Output_Share[channel_id]].data );
+      }
+      Output_Share[channel_id] = output_ids[channel_id];
     }
 
-    // Process the output buffer
-    dsp_process_output( channel, channel_id, sample_count, output_buffer, clip_flag, filters_enabled );
-    
-#ifdef DISPLAY_ON
-    // Send output level for display
-    dsp_display_output( channel_id, dsp_data->out_max_level, dsp_data->out_clip_count );
-#endif
+    if( transition_type != DSP_TRANSITION_NONE ) {
+      dsp_transition_filter( channels, buffers, counts );
+    } else {
+      for( channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
+        banks[channel_id] = &channels[channel_id].data->bank[bank_active];
+      }
+      dsp_filter_banks( banks, buffers, counts );
+    }
+
+    // Interpolate and run the crossover and FIR steps right after the biquads
+    for( channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
+      dsp_data = channels[channel_id].data;
+
+      if( output_ids[channel_id] >= 0 ) {
+        memcpy( Biquad_Buff_F32[channel_id], Biquad_Buff_F32[output_ids[channel_id]], sample_count*sizeof( float ) );
+        continue;
+      }
+
+      if( buffers[channel_id] == Decim_Buff_F32[channel_id] ) {
+        dsp_interpolate( &dsp_data->multirate, Decim_Buff_F32[channel_id], Biquad_Buff_F32[channel_id], sample_count );
+      }
+
+      dsp_run_steps( dsp_data, dsp_data->plan.filter_step, dsp_data->plan.filter_step + dsp_data->plan.shared_steps,
+        Biquad_Buff_F32[channel_id], sample_count, clip_flag, filters_enabled );
+    }
+  }
+
+  if( STATS_ON ) {
+    stage_end = dsp_get_cycles();
+    dsp_stats_add( DSP_STAGE_FILTERS, stage_end - stage_start );
+    stage_start = stage_end;
   }
+
+  // Process the output buffer with the remaining steps of each channel
+  for( channel_id = 0; channel_id < DSP_NUM_CHANNELS ; ++ channel_id ) {
+    dsp_data = channels[channel_id].data;
+    dsp_run_steps( dsp_data, dsp_data->plan.filter_step + dsp_data->plan.shared_steps, dsp_data->plan.step_count,
+      Biquad_Buff_F32[channel_id], sample_count, clip_flag, filters_enabled );
+  }
+
+  dsp_interleave( channels, output_buffer, sample_count );
+
+  if( STATS_ON ) {
+    dsp_stats_add( DSP_STAGE_OUTPUT, dsp_get_cycles() - stage_start );
+    dsp_stats_block( sample_count );
+  }
+
   return( ESP_OK );
 }
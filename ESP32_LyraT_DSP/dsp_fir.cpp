@@ -0,0 +1,492 @@
+#include "dsp_engine.h"
+
+#define _PI                   3.14159265358979323846
+#define FIR_FFT_HALF          (DSP_FIR_FFT_SIZE/2)  // Size of the complex FFT behind the real FFT
+#define FIR_PROFILE_WARMUP    4                     // Partitions run before measuring
+#define FIR_PROFILE_STEPS     32                    // Partitions measured
+
+// Twiddle factors of the complex FFT and of the real FFT split, and the bit reversed
+// order of the complex FFT
+static float          fft_cos[ FIR_FFT_HALF/2 ];
+static float          fft_sin[ FIR_FFT_HALF/2 ];
+static float          split_cos[ FIR_FFT_HALF ];
+static float          split_sin[ FIR_FFT_HALF ];
+static int            fft_bitrev[ FIR_FFT_HALF ];
+static bool           fft_ready = false;
+
+// Overlap-save discards the first FFT size - partition outputs, which have to cover
+// the partition of taps
+static_assert( ( DSP_FIR_FFT_SIZE & ( DSP_FIR_FFT_SIZE - 1 ) ) == 0, "DSP_FIR_FFT_SIZE must be a power of two" );
+static_assert( DSP_FIR_FFT_SIZE >= 2*DSP_FIR_PARTITION, "DSP_FIR_FFT_SIZE must be at least twice DSP_FIR_PARTITION" );
+
+
+//------------------------------------------------------------------------------------
+// Calculate the FFT tables
+//------------------------------------------------------------------------------------
+static void dsp_fft_init() {
+
+  int         bits;
+  int         rev;
+
+  for( int k = 0; k < FIR_FFT_HALF/2; ++ k ) {
+    fft_cos[k] = cos( 2*_PI*k/FIR_FFT_HALF );
+    fft_sin[k] = sin( 2*_PI*k/FIR_FFT_HALF );
+  }
+
+  for( int k = 0; k < FIR_FFT_HALF; ++ k ) {
+    split_cos[k] = cos( 2*_PI*k/DSP_FIR_FFT_SIZE );
+    split_sin[k] = sin( 2*_PI*k/DSP_FIR_FFT_SIZE );
+  }
+
+  bits = 0;
+  while( ( 1 << bits ) < FIR_FFT_HALF ) {
+    ++ bits;
+  }
+
+  for( int i = 0; i < FIR_FFT_HALF; ++ i ) {
+    rev = 0;
+    for( int b = 0; b < bits; ++ b ) {
+      rev |= ( ( i >> b ) & 1 ) << ( bits - 1 - b );
+    }
+    fft_bitrev[i] = rev;
+  }
+
+  fft_ready = true;
+}
+
+
+//------------------------------------------------------------------------------------
+// In place radix-2 complex FFT of FIR_FFT_HALF interleaved values. The inverse is
+// not scaled.
+//------------------------------------------------------------------------------------
+static void dsp_fft_complex( float* data, bool inverse ) {
+
+  int         j;
+  int         a;
+  int         b;
+  int         half;
+  int         step;
+  float       wr;
+  float       wi;
+  float       tr;
+  float       ti;
+
+  for( int i = 0; i < FIR_FFT_HALF; ++ i ) {
+    j = fft_bitrev[i];
+    if( j > i ) {
+      tr = data[2*i];
+      ti = data[2*i + 1];
+      data[2*i] = data[2*j];
+      data[2*i + 1] = data[2*j + 1];
+      data[2*j] = tr;
+      data[2*j + 1] = ti;
+    }
+  }
+
+  for( int size = 2; size <= FIR_FFT_HALF; size *= 2 ) {
+    half = size/2;
+    step = FIR_FFT_HALF/size;
+
+    for( int start = 0; start < FIR_FFT_HALF; start += size ) {
+      for( int k = 0; k < half; ++ k ) {
+        wr = fft_cos[k*step];
+        wi = inverse ? fft_sin[k*step] : -fft_sin[k*step];
+
+        a = 2*( start + k );
+        b = a + size;
+
+        tr = wr*data[b] - wi*data[b + 1];
+        ti = wr*data[b + 1] + wi*data[b];
+        data[b] = data[a] - tr;
+        data[b + 1] = data[a + 1] - ti;
+        data[a] += tr;
+        data[a + 1] += ti;
+      }
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// In place FFT of DSP_FIR_FFT_SIZE real values
+//
+// The even and odd samples are transformed together as one complex sequence of half
+// the size and then split. The spectrum is packed: DC and Nyquist (both real) come
+// first, followed by the real and imaginary parts of the other bins.
+//------------------------------------------------------------------------------------
+static void dsp_fft_real( float* data ) {
+
+  int         j;
+  float       z0;
+  float       er, ei;
+  float       odr, odi;
+  float       tr, ti;
+
+  dsp_fft_complex( data, false );
+
+  z0 = data[0];
+  data[0] = z0 + data[1];
+  data[1] = z0 - data[1];
+
+  for( int k = 1; k <= FIR_FFT_HALF/2; ++ k ) {
+    j = FIR_FFT_HALF - k;
+
+    // Spectra of the even and odd samples
+    er = 0.5f*( data[2*k] + data[2*j] );
+    ei = 0.5f*( data[2*k + 1] - data[2*j + 1] );
+    odr = 0.5f*( data[2*k + 1] + data[2*j + 1] );
+    odi = -0.5f*( data[2*k] - data[2*j] );
+
+    tr = split_cos[k]*odr + split_sin[k]*odi;
+    ti = split_cos[k]*odi - split_sin[k]*odr;
+
+    data[2*k] = er + tr;
+    data[2*k + 1] = ei + ti;
+    data[2*j] = er - tr;
+    data[2*j + 1] = ti - ei;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Inverse of dsp_fft_real(). The result is scaled by FIR_FFT_HALF.
+//------------------------------------------------------------------------------------
+static void dsp_fft_real_inverse( float* data ) {
+
+  int         j;
+  float       x0;
+  float       er, ei;
+  float       dr, di;
+  float       odr, odi;
+
+  x0 = data[0];
+  data[0] = 0.5f*( x0 + data[1] );
+  data[1] = 0.5f*( x0 - data[1] );
+
+  for( int k = 1; k <= FIR_FFT_HALF/2; ++ k ) {
+    j = FIR_FFT_HALF - k;
+
+    er = 0.5f*( data[2*k] + data[2*j] );
+    ei = 0.5f*( data[2*k + 1] - data[2*j + 1] );
+    dr = 0.5f*( data[2*k] - data[2*j] );
+    di = 0.5f*( data[2*k + 1] + data[2*j + 1] );
+
+    odr = dr*split_cos[k] - di*split_sin[k];
+    odi = dr*split_sin[k] + di*split_cos[k];
+
+    data[2*k] = er - odi;
+    data[2*k + 1] = ei + odr;
+    data[2*j] = er + odi;
+    data[2*j + 1] = odr - ei;
+  }
+
+  dsp_fft_complex( data, true );
+}
+
+
+//------------------------------------------------------------------------------------
+// Allocate a FIR with the passed number of partitions
+//------------------------------------------------------------------------------------
+static dsp_fir_t* dsp_fir_alloc( int partitions ) {
+
+  dsp_fir_t*  fir;
+
+  if( !fft_ready ) {
+    dsp_fft_init();
+  }
+
+  fir = (dsp_fir_t*) malloc( sizeof( dsp_fir_t ) );
+  if( fir == NULL ) {
+    return( NULL );
+  }
+
+  // Set before the buffers, dsp_fir_free() checks them if an allocation fails
+  fir->taps = NULL;
+  fir->tap_count = 0;
+  fir->partitions = partitions;
+  fir->shared = false;
+
+  fir->spectra = (float*) malloc( partitions*DSP_FIR_FFT_SIZE*sizeof( float ) );
+  fir->fdl = (float*) malloc( partitions*DSP_FIR_FFT_SIZE*sizeof( float ) );
+
+  if( fir->spectra == NULL || fir->fdl == NULL ) {
+    dsp_fir_free( fir );
+    return( NULL );
+  }
+
+  memset( fir->spectra, 0, partitions*DSP_FIR_FFT_SIZE*sizeof( float ) );
+  dsp_fir_reset( fir );
+
+  return( fir );
+}
+
+
+//------------------------------------------------------------------------------------
+// Set up a FIR filter for uniformly partitioned overlap-save convolution
+//
+// The impulse response is split into partitions of DSP_FIR_PARTITION taps and the
+// spectrum of each partition is calculated once. Every partition of input then
+// costs one forward and one inverse FFT plus a multiply-accumulate of the spectra.
+//------------------------------------------------------------------------------------
+dsp_fir_t* dsp_fir_create( float* taps, int tap_count ) {
+
+  dsp_fir_t*  fir;
+  float*      spectrum;
+  int         count;
+
+  if( tap_count < 1 || tap_count > DSP_FIR_MAX_TAPS ) {
+    dsp_printf( "E-DSP: ERROR: Invalid FIR tap count %d (1 to %d)\r\n", tap_count, DSP_FIR_MAX_TAPS );
+    return( NULL );
+  }
+
+  fir = dsp_fir_alloc( ( tap_count + DSP_FIR_PARTITION - 1 )/DSP_FIR_PARTITION );
+  if( fir == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to allocate FIR of %d taps\r\n", tap_count );
+    return( NULL );
+  }
+
+  fir->taps = taps;
+  fir->tap_count = tap_count;
+
+  // The scaling of the inverse FFT is applied to the filter spectra
+  for( int k = 0; k < fir->partitions; ++ k ) {
+    spectrum = &fir->spectra[k*DSP_FIR_FFT_SIZE];
+    count = tap_count - k*DSP_FIR_PARTITION;
+    if( count > DSP_FIR_PARTITION ) {
+      count = DSP_FIR_PARTITION;
+    }
+
+    for( int i = 0; i < count; ++ i ) {
+      spectrum[i] = taps[k*DSP_FIR_PARTITION + i]/FIR_FFT_HALF;
+    }
+    dsp_fft_real( spectrum );
+  }
+
+  return( fir );
+}
+
+
+//------------------------------------------------------------------------------------
+// Set up a FIR filter with the same taps as an existing one
+//
+// Only the history is allocated, the partition spectra of the source are used, so
+// channels with the same room correction store it once.
+//------------------------------------------------------------------------------------
+dsp_fir_t* dsp_fir_share( dsp_fir_t* source ) {
+
+  dsp_fir_t*  fir;
+
+  fir = (dsp_fir_t*) malloc( sizeof( dsp_fir_t ) );
+  if( fir == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to allocate FIR of %d taps\r\n", source->tap_count );
+    return( NULL );
+  }
+
+  *fir = *source;
+  fir->shared = true;
+  fir->fdl = (float*) malloc( fir->partitions*DSP_FIR_FFT_SIZE*sizeof( float ) );
+
+  if( fir->fdl == NULL ) {
+    dsp_printf( "E-DSP: ERROR: Unable to allocate FIR of %d taps\r\n", source->tap_count );
+    free( fir );
+    return( NULL );
+  }
+
+  dsp_fir_reset( fir );
+
+  return( fir );
+}
+
+
+//------------------------------------------------------------------------------------
+// Release a FIR filter
+//------------------------------------------------------------------------------------
+void dsp_fir_free( dsp_fir_t* fir ) {
+
+  if( fir != NULL ) {
+    if( !fir->shared ) {
+      free( fir->spectra );
+    }
+    free( fir->fdl );
+    free( fir );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Clear the FIR history
+//------------------------------------------------------------------------------------
+void dsp_fir_reset( dsp_fir_t* fir ) {
+
+  fir->newest = 0;
+  fir->fill = 0;
+  memset( fir->fdl, 0, fir->partitions*DSP_FIR_FFT_SIZE*sizeof( float ) );
+  memset( fir->window, 0, sizeof( fir->window ) );
+  memset( fir->input, 0, sizeof( fir->input ) );
+  memset( fir->output, 0, sizeof( fir->output ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Copy the history of a FIR with the same number of partitions, so it continues
+// where the source is
+//------------------------------------------------------------------------------------
+void dsp_fir_copy_state( dsp_fir_t* fir, dsp_fir_t* source ) {
+
+  fir->newest = source->newest;
+  fir->fill = source->fill;
+  memcpy( fir->fdl, source->fdl, fir->partitions*DSP_FIR_FFT_SIZE*sizeof( float ) );
+  memcpy( fir->window, source->window, sizeof( fir->window ) );
+  memcpy( fir->input, source->input, sizeof( fir->input ) );
+  memcpy( fir->output, source->output, sizeof( fir->output ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if two FIRs with the same number of partitions have the same history
+//------------------------------------------------------------------------------------
+bool dsp_fir_same_state( dsp_fir_t* fir, dsp_fir_t* source ) {
+
+  return( fir->newest == source->newest && fir->fill == source->fill &&
+    memcmp( fir->window, source->window, sizeof( fir->window ) ) == 0 &&
+    memcmp( fir->input, source->input, sizeof( fir->input ) ) == 0 &&
+    memcmp( fir->output, source->output, sizeof( fir->output ) ) == 0 &&
+    memcmp( fir->fdl, source->fdl, fir->partitions*DSP_FIR_FFT_SIZE*sizeof( float ) ) == 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Filter one partition of input. Input and output may be the same buffer.
+//------------------------------------------------------------------------------------
+static void dsp_fir_step( dsp_fir_t* fir, float* input, float* output ) {
+
+  float*        spectrum;
+  float*        filter;
+  float*        work;
+  int           slot;
+
+  // Slide the input window by one partition
+  memmove( fir->window, &fir->window[DSP_FIR_PARTITION], ( DSP_FIR_FFT_SIZE - DSP_FIR_PARTITION )*sizeof( float ) );
+  memcpy( &fir->window[DSP_FIR_FFT_SIZE - DSP_FIR_PARTITION], input, DSP_FIR_PARTITION*sizeof( float ) );
+
+  // Spectrum of the window becomes the newest entry of the delay line
+  fir->newest = ( fir->newest == 0 ) ? fir->partitions - 1 : fir->newest - 1;
+  spectrum = &fir->fdl[fir->newest*DSP_FIR_FFT_SIZE];
+  memcpy( spectrum, fir->window, sizeof( fir->window ) );
+  dsp_fft_real( spectrum );
+
+  // Multiply-accumulate each filter partition with the matching input spectrum
+  work = fir->work;
+  memset( work, 0, sizeof( fir->work ) );
+
+  slot = fir->newest;
+  for( int k = 0; k < fir->partitions; ++ k ) {
+    spectrum = &fir->fdl[slot*DSP_FIR_FFT_SIZE];
+    filter = &fir->spectra[k*DSP_FIR_FFT_SIZE];
+
+    // DC and Nyquist are real
+    work[0] += spectrum[0]*filter[0];
+    work[1] += spectrum[1]*filter[1];
+
+    for( int i = 2; i < DSP_FIR_FFT_SIZE; i += 2 ) {
+      work[i] += spectrum[i]*filter[i] - spectrum[i + 1]*filter[i + 1];
+      work[i + 1] += spectrum[i]*filter[i + 1] + spectrum[i + 1]*filter[i];
+    }
+
+    if( ++ slot == fir->partitions ) {
+      slot = 0;
+    }
+  }
+
+  // The last partition of the window is free of circular wrap around
+  dsp_fft_real_inverse( work );
+  memcpy( output, &work[DSP_FIR_FFT_SIZE - DSP_FIR_PARTITION], DSP_FIR_PARTITION*sizeof( float ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Filter a block in place
+//
+// Blocks of whole partitions are filtered directly without added latency. Other
+// block sizes are collected into partitions, which delays the output by one
+// partition.
+//------------------------------------------------------------------------------------
+void dsp_fir_process( dsp_fir_t* fir, float* buffer, int sample_count ) {
+
+  int           count;
+  float         sample;
+
+  if( fir->fill == 0 && sample_count % DSP_FIR_PARTITION == 0 ) {
+    for( int offset = 0; offset < sample_count; offset += DSP_FIR_PARTITION ) {
+      dsp_fir_step( fir, &buffer[offset], &buffer[offset] );
+    }
+    return;
+  }
+
+  while( sample_count > 0 ) {
+    count = DSP_FIR_PARTITION - fir->fill;
+    if( count > sample_count ) {
+      count = sample_count;
+    }
+
+    for( int i = 0; i < count; ++ i ) {
+      sample = buffer[i];
+      buffer[i] = fir->output[fir->fill + i];
+      fir->input[fir->fill + i] = sample;
+    }
+
+    fir->fill += count;
+    buffer += count;
+    sample_count -= count;
+
+    if( fir->fill == DSP_FIR_PARTITION ) {
+      dsp_fir_step( fir, fir->input, fir->output );
+      fir->fill = 0;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the latency of the FIR in samples for the passed block size (per channel)
+//------------------------------------------------------------------------------------
+int dsp_fir_latency( int sample_count ) {
+
+  return( ( sample_count % DSP_FIR_PARTITION == 0 ) ? 0 : DSP_FIR_PARTITION );
+}
+
+
+//------------------------------------------------------------------------------------
+// Profile the convolution of a FIR with the passed number of partitions and return
+// the average cycles per partition of input. Uses its own FIR, so the audio is not
+// affected.
+//------------------------------------------------------------------------------------
+uint32_t dsp_fir_profile( int partitions ) {
+
+  dsp_fir_t*  fir;
+  uint32_t    start;
+  uint32_t    cycles;
+
+  fir = dsp_fir_alloc( partitions );
+  if( fir == NULL ) {
+    return( UINT32_MAX );
+  }
+
+  cycles = 0;
+  for( int step = 0; step < FIR_PROFILE_WARMUP + FIR_PROFILE_STEPS; ++ step ) {
+    for( int i = 0; i < DSP_FIR_PARTITION; ++ i ) {
+      fir->input[i] = ( ( step*DSP_FIR_PARTITION + i ) & 0x3F ) - 32;
+    }
+
+    start = dsp_get_cycles();
+    dsp_fir_step( fir, fir->input, fir->output );
+
+    if( step >= FIR_PROFILE_WARMUP ) {
+      cycles += dsp_get_cycles() - start;
+    }
+  }
+
+  dsp_fir_free( fir );
+
+  return( cycles/FIR_PROFILE_STEPS );
+}
@@ -0,0 +1,480 @@
+#include "dsp_engine.h"
+
+// The processing graph of a channel is a chain of nodes in signal order, fed by the
+// mixer. The biquads are the one node run for all channels together (pairing,
+// shared processing and filter transitions work across channels), the other nodes
+// are compiled per channel into a list of steps run before or after them.
+
+static const char*  node_name[] = {"MIX", "METER", "DELAY", "BIQUADS", "CROSSOVER", "FIR", "GAIN", "LIMIT", "DITHER" };
+
+// Graph of channels without nodes in the configuration
+static const int    default_graph[] = { DSP_NODE_MIX, DSP_NODE_METER, DSP_NODE_DELAY, DSP_NODE_BIQUADS, DSP_NODE_CROSSOVER, DSP_NODE_FIR,
+                                        DSP_NODE_GAIN, DSP_NODE_LIMIT, DSP_NODE_METER, DSP_NODE_DITHER };
+#define DEFAULT_NODES   ( DITHER_ON ? 10 : 9 )
+
+static bool         fuse_output = DSP_FUSE_OUTPUT_DEFAULT;    // Gain, limit and output meter in a row run as one step
+
+
+//------------------------------------------------------------------------------------
+// Input level and clipping, without branches
+//------------------------------------------------------------------------------------
+static int dsp_step_meter_in( dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled ) {
+
+  float             max_level;
+  int               clip_count;
+
+  max_level = 0;
+  clip_count = 0;
+  for( int i = 0; i < sample_count; ++ i ) {
+    max_level = ( fabsf( buffer[i] ) > max_level ) ? fabsf( buffer[i] ) : max_level;
+    clip_count += ( fabsf( buffer[i] ) >= DSP_MAX_LEVEL );
+  }
+
+  dsp_data->in_clip_count += clip_count;
+  dsp_data->in_max_level = (long int) max_level;
+
+  return( clip_count );
+}
+
+
+//------------------------------------------------------------------------------------
+// Output level and clipping, without branches. The level of a clipped block is
+// full scale, as the samples are saturated when they are converted.
+//------------------------------------------------------------------------------------
+static int dsp_step_meter_out( dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled ) {
+
+  float             max_level;
+  int               clip_count;
+
+  max_level = 0;
+  clip_count = 0;
+  for( int i = 0; i < sample_count; ++ i ) {
+    max_level = ( fabsf( buffer[i] ) > max_level ) ? fabsf( buffer[i] ) : max_level;
+    clip_count += ( fabsf( buffer[i] ) > DSP_MAX_LEVEL );
+  }
+
+  dsp_data->out_clip_count += clip_count;
+  dsp_data->out_max_level = ( clip_count > 0 ) ? DSP_MAX_LEVEL : (long int) max_level;
+
+  return( clip_count );
+}
+
+
+//------------------------------------------------------------------------------------
+// Delay the block (bypassed with the filters)
+//------------------------------------------------------------------------------------
+static int dsp_step_delay( dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled ) {
+
+  if( filters_enabled ) {
+    dsp_delay_process( dsp_data, buffer, sample_count );
+  }
+
+  return( 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Crossover section and FIR (bypassed with the filters)
+//------------------------------------------------------------------------------------
+static int dsp_step_crossover( dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled ) {
+
+  if( filters_enabled ) {
+    dsp_crossover_process( dsp_data->crossover, buffer, sample_count );
+  }
+
+  return( 0 );
+}
+
+static int dsp_step_fir( dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled ) {
+
+  if( filters_enabled ) {
+    dsp_fir_process( dsp_data->fir, buffer, sample_count );
+  }
+
+  return( 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Apply the channel gain (bypassed with the filters)
+//------------------------------------------------------------------------------------
+static int dsp_step_gain( dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled ) {
+
+  float             scaling_factor;
+
+  if( filters_enabled ) {
+    scaling_factor = dsp_data->scaling_factor;
+    for( int i = 0; i < sample_count; ++ i ) {
+      buffer[i] *= scaling_factor;
+    }
+  }
+
+  return( 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Look-ahead limiter (see dsp_limiter.cpp). Limited samples do not count as clipped.
+//------------------------------------------------------------------------------------
+static int dsp_step_limit( dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled ) {
+
+  float             max_level;
+
+  dsp_limiter_meter( dsp_data, dsp_limiter_process( &dsp_data->limiter, buffer, sample_count, 1.0f, &max_level ) );
+
+  return( 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Gain, limiter and output meter fused into a single pass over the block. Samples
+// can only exceed the limit by rounding, so they are rarely counted.
+//------------------------------------------------------------------------------------
+static int dsp_step_output( dsp_data_t* dsp_data, float* buffer, int sample_count, bool filters_enabled ) {
+
+  float             max_level;
+  float             scaling_factor;
+  int               clip_count;
+
+  scaling_factor = filters_enabled ? dsp_data->scaling_factor : 1.0f;
+
+  dsp_limiter_meter( dsp_data, dsp_limiter_process( &dsp_data->limiter, buffer, sample_count, scaling_factor, &max_level ) );
+
+  clip_count = 0;
+  if( max_level > DSP_MAX_LEVEL ) {
+    for( int i = 0; i < sample_count; ++ i ) {
+      clip_count += ( fabsf( buffer[i] ) > DSP_MAX_LEVEL );
+    }
+    dsp_data->out_clip_count += clip_count;
+    max_level = DSP_MAX_LEVEL;
+  }
+
+  dsp_data->out_max_level = (long int) max_level;
+
+  return( clip_count );
+}
+
+
+//------------------------------------------------------------------------------------
+// Check the graph of a channel: the mixer first, the biquads once, the other nodes
+// at most once (the meter once on each side of the biquads), the dither last, and a
+// node for the crossover and FIR if the channel has one
+//------------------------------------------------------------------------------------
+static esp_err_t dsp_graph_check( dsp_channel_t* channel ) {
+
+  dsp_plan_t*       plan;
+  int               counts[DSP_NUM_NODE_TYPES];
+  int               meters;
+
+  plan = &channel->data->plan;
+
+  if( plan->node_count == 0 ) {
+    return( ESP_OK );
+  }
+
+  memset( counts, 0, sizeof( counts ) );
+  meters = 0;
+
+  for( int i = 0; i < plan->node_count; ++ i ) {
+    ++ counts[ plan->nodes[i] ];
+
+    if( plan->nodes[i] == DSP_NODE_BIQUADS ) {
+      meters = 0;
+    } else if( plan->nodes[i] == DSP_NODE_METER && ++ meters > 1 ) {
+      dsp_printf( "E-DSP: ERROR: More than one meter on one side of the biquads of channel '%s'\r\n", channel->name );
+      return( ESP_FAIL );
+    }
+  }
+
+  if( plan->nodes[0] != DSP_NODE_MIX || counts[DSP_NODE_MIX] != 1 ) {
+    dsp_printf( "E-DSP: ERROR: The graph of channel '%s' has to start with the only mixer\r\n", channel->name );
+    return( ESP_FAIL );
+  }
+
+  for( int node_type = 0; node_type < DSP_NUM_NODE_TYPES; ++ node_type ) {
+    if( node_type != DSP_NODE_METER && counts[node_type] > 1 ) {
+      dsp_printf( "E-DSP: ERROR: More than one %s node for channel '%s'\r\n", node_name[node_type], channel->name );
+      return( ESP_FAIL );
+    }
+  }
+
+  // The dither quantizes the output samples, so nothing can follow it
+  if( counts[DSP_NODE_DITHER] > 0 && plan->nodes[ plan->node_count - 1 ] != DSP_NODE_DITHER ) {
+    dsp_printf( "E-DSP: ERROR: DITHER has to be the last node of channel '%s'\r\n", channel->name );
+    return( ESP_FAIL );
+  }
+
+  if( counts[DSP_NODE_BIQUADS] != 1 ) {
+    dsp_printf( "E-DSP: ERROR: No BIQUADS node for channel '%s'\r\n", channel->name );
+    return( ESP_FAIL );
+  }
+
+  if( ( channel->data->crossover != NULL && counts[DSP_NODE_CROSSOVER] == 0 ) || ( channel->data->fir != NULL && counts[DSP_NODE_FIR] == 0 ) ) {
+    dsp_printf( "E-DSP: ERROR: Crossover or FIR of channel '%s' is not in its graph\r\n", channel->name );
+    return( ESP_FAIL );
+  }
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Load the processing graphs of the channels
+//
+// The nodes of each channel are taken in the order they are listed. Channels without
+// nodes use the default graph. Called after the filters, crossovers and FIRs are set
+// up, as the graph has to include them.
+//------------------------------------------------------------------------------------
+esp_err_t dsp_graph_init( dsp_channel_t* channels, const node_def_t* node_defs, int node_def_count ) {
+
+  dsp_plan_t*       plan;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    plan = &channels[channel_id].data->plan;
+    plan->node_count = 0;
+
+    for( int node_id = 0; node_id < node_def_count; ++ node_id ) {
+
+      if( node_defs[node_id].channel != channel_id && node_defs[node_id].channel != DSP_ALL_CHANNELS ) {
+        continue;
+      }
+
+      if( node_defs[node_id].node_type < 0 || node_defs[node_id].node_type >= DSP_NUM_NODE_TYPES ) {
+        dsp_printf( "E-DSP: ERROR: Unknown node type '%d'\r\n", node_defs[node_id].node_type );
+        return( ESP_FAIL );
+      }
+
+      if( plan->node_count == DSP_MAX_NODES ) {
+        dsp_printf( "E-DSP: ERROR: Maximum nodes exceeded for channel '%s'\r\n", channels[channel_id].name );
+        return( ESP_FAIL );
+      }
+
+      plan->nodes[ plan->node_count ++ ] = node_defs[node_id].node_type;
+    }
+
+    if( dsp_graph_check( &channels[channel_id] ) != ESP_OK ) {
+      return( ESP_FAIL );
+    }
+  }
+
+  dsp_share_channels( channels );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the nodes of a channel, the default graph if none are configured
+//------------------------------------------------------------------------------------
+static const int* dsp_graph_nodes( dsp_data_t* dsp_data, int* node_count ) {
+
+  if( dsp_data->plan.node_count > 0 ) {
+    *node_count = dsp_data->plan.node_count;
+    return( dsp_data->plan.nodes );
+  }
+
+  *node_count = DEFAULT_NODES;
+  return( default_graph );
+}
+
+
+//------------------------------------------------------------------------------------
+// Add a step to the plan
+//------------------------------------------------------------------------------------
+static void dsp_plan_step( dsp_plan_t* plan, dsp_step_fn_t process, int node_type ) {
+
+  plan->steps[ plan->step_count ].process = process;
+  plan->steps[ plan->step_count ].node_type = node_type;
+  ++ plan->step_count;
+}
+
+
+//------------------------------------------------------------------------------------
+// Compile the graphs of the channels into their steps
+//
+// Nodes a channel does not use are left out: a crossover or FIR node of a channel
+// without one, and the gain at 0 dB. Gain, limit and output meter in a row become
+// one pass over the block if fuse_output is set (see dsp_graph_set_fused). The
+// dither is the last node and runs with the conversion to samples. The leading
+// crossover and FIR steps after the biquads
+// are the ones a channel copies from another channel with the same output.
+// Called by dsp_share_channels, so after any change to the channels.
+//------------------------------------------------------------------------------------
+void dsp_graph_plan( dsp_channel_t* channels ) {
+
+  dsp_data_t*       dsp_data;
+  dsp_plan_t*       plan;
+  const int*        nodes;
+  int               node_count;
+  int               node_type;
+  bool              filtered;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_data = channels[channel_id].data;
+    plan = &dsp_data->plan;
+
+    nodes = dsp_graph_nodes( dsp_data, &node_count );
+
+    plan->step_count = 0;
+    plan->filter_step = 0;
+    plan->shared_steps = 0;
+    plan->dither = false;
+    filtered = false;
+
+    // The mixer is always the first node and is run by dsp_filter
+    for( int i = 1; i < node_count; ++ i ) {
+      node_type = nodes[i];
+
+      switch( node_type ) {
+
+        case DSP_NODE_METER:
+          dsp_plan_step( plan, filtered ? dsp_step_meter_out : dsp_step_meter_in, node_type );
+          break;
+
+        case DSP_NODE_DELAY:
+          dsp_plan_step( plan, dsp_step_delay, node_type );
+          break;
+
+        case DSP_NODE_BIQUADS:
+          plan->filter_step = plan->step_count;
+          filtered = true;
+          break;
+
+        case DSP_NODE_CROSSOVER:
+          if( dsp_data->crossover != NULL ) {
+            dsp_plan_step( plan, dsp_step_crossover, node_type );
+          }
+          break;
+
+        case DSP_NODE_FIR:
+          if( dsp_data->fir != NULL ) {
+            dsp_plan_step( plan, dsp_step_fir, node_type );
+          }
+          break;
+
+        case DSP_NODE_GAIN:
+          if( fuse_output && filtered && i + 2 < node_count && nodes[i + 1] == DSP_NODE_LIMIT && nodes[i + 2] == DSP_NODE_METER ) {
+            dsp_plan_step( plan, dsp_step_output, node_type );
+            i += 2;
+          } else if( dsp_data->scaling_factor != 1.0f ) {
+            dsp_plan_step( plan, dsp_step_gain, node_type );
+          }
+          break;
+
+        case DSP_NODE_LIMIT:
+          dsp_plan_step( plan, dsp_step_limit, node_type );
+          break;
+
+        case DSP_NODE_DITHER:
+          plan->dither = true;
+          break;
+      }
+    }
+
+    while( plan->filter_step + plan->shared_steps < plan->step_count &&
+           ( plan->steps[ plan->filter_step + plan->shared_steps ].node_type == DSP_NODE_CROSSOVER ||
+             plan->steps[ plan->filter_step + plan->shared_steps ].node_type == DSP_NODE_FIR ) ) {
+      ++ plan->shared_steps;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Select whether gain, limit and output meter in a row run as one step and compile
+// the graphs again. The fused step was measured slower than the separate steps on
+// the host, so it is off by default (DSP_FUSE_OUTPUT_DEFAULT).
+//------------------------------------------------------------------------------------
+void dsp_graph_set_fused( dsp_channel_t* channels, bool fused ) {
+
+  fuse_output = fused;
+  dsp_share_channels( channels );
+}
+
+
+//------------------------------------------------------------------------------------
+// Show the compiled graph of a channel
+//------------------------------------------------------------------------------------
+void dsp_graph_info( dsp_data_t* dsp_data ) {
+
+  dsp_plan_t*       plan;
+  char              line[DSP_MAX_NODES*20];
+  int               length;
+
+  plan = &dsp_data->plan;
+
+  length = snprintf( line, sizeof( line ), "MIX" );
+  for( int i = 0; i <= plan->step_count; ++ i ) {
+    if( i == plan->filter_step ) {
+      length += snprintf( &line[length], sizeof( line ) - length, " > BIQUADS" );
+    }
+    if( i < plan->step_count ) {
+      length += snprintf( &line[length], sizeof( line ) - length, " > %s",
+        ( plan->steps[i].process == dsp_step_output ) ? "GAIN+LIMIT+METER" : node_name[ plan->steps[i].node_type ] );
+    }
+  }
+
+  dsp_printf( "I-DSP:   Graph = %s%s%s\r\n", line, plan->dither ? " > DITHER" : "", ( plan->node_count == 0 ) ? " (default)" : "" );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the graph of a channel has a node of the type
+//------------------------------------------------------------------------------------
+bool dsp_graph_has_node( dsp_data_t* dsp_data, int node_type ) {
+
+  const int*        nodes;
+  int               node_count;
+
+  nodes = dsp_graph_nodes( dsp_data, &node_count );
+
+  for( int i = 0; i < node_count; ++ i ) {
+    if( nodes[i] == node_type ) {
+      return( true );
+    }
+  }
+
+  return( false );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the processing latency of a channel in samples for the passed block size
+// (per channel), without its delay. The latency of each node type is stored in
+// node_latency if it is not NULL: the base sample of the delay line with the delay,
+// the decimation with the biquads.
+//------------------------------------------------------------------------------------
+int dsp_graph_latency( dsp_data_t* dsp_data, int sample_count, int* node_latency ) {
+
+  dsp_plan_t*       plan;
+  int               latency[DSP_NUM_NODE_TYPES];
+  int               total;
+
+  plan = &dsp_data->plan;
+
+  memset( latency, 0, sizeof( latency ) );
+  latency[DSP_NODE_BIQUADS] = dsp_multirate_latency( &dsp_data->multirate );
+
+  for( int i = 0; i < plan->step_count; ++ i ) {
+    if( plan->steps[i].node_type == DSP_NODE_DELAY ) {
+      latency[DSP_NODE_DELAY] = 1;
+    } else if( plan->steps[i].node_type == DSP_NODE_CROSSOVER ) {
+      latency[DSP_NODE_CROSSOVER] = dsp_crossover_latency( dsp_data->crossover );
+    } else if( plan->steps[i].node_type == DSP_NODE_FIR ) {
+      latency[DSP_NODE_FIR] = dsp_fir_latency( sample_count );
+    } else if( plan->steps[i].process == dsp_step_limit || plan->steps[i].process == dsp_step_output ) {
+      latency[DSP_NODE_LIMIT] = dsp_limiter_latency( &dsp_data->limiter );
+    }
+  }
+
+  total = 0;
+  for( int node_type = 0; node_type < DSP_NUM_NODE_TYPES; ++ node_type ) {
+    total += latency[node_type];
+  }
+
+  if( node_latency != NULL ) {
+    memcpy( node_latency, latency, sizeof( latency ) );
+  }
+
+  return( total );
+}
@@ -1,12 +1,35 @@
 #define   IMPORT_MINIDSP
 
-#include "dsp_process.h"
+#include "dsp_engine.h"
 
-static char dsp_filter_import[] = 
+// The imported text is only read, so it stays in flash
+static const char dsp_filter_import[] = 
 #include "dsp_import.h"
 ;
 
+static const char dsp_fir_import[] = 
+#include "dsp_import_fir.h"
+;
+
 static biquad_def_t   biquad_defs[DSP_MAX_FILTERS];
+static fir_def_t      fir_defs[DSP_NUM_CHANNELS + 1];
+static float*         fir_taps = NULL;
+
+
+//------------------------------------------------------------------------------------
+// Return the next token of the imported text and its length, or NULL at the end of
+// the text. Unlike strtok the text is not modified.
+//------------------------------------------------------------------------------------
+static const char* dsp_import_token( const char** text, const char* delimiters, int* token_length ) {
+
+  const char*   token;
+
+  token = *text + strspn( *text, delimiters );
+  *token_length = strcspn( token, delimiters );
+  *text = token + *token_length;
+
+  return( ( *token_length > 0 ) ? token : NULL );
+}
 
 
 //------------------------------------------------------------------------------------
@@ -14,94 +37,96 @@ static biquad_def_t   biquad_defs[DSP_MAX_FILTERS];
 //------------------------------------------------------------------------------------
 static biquad_def_t* dsp_import_REW( int* import_filter_count ) {
 
-  char*         token;
-  double        coeff;
-  char          delimiters[10];
+  const char*   text;
+  const char*   token;
+  int           token_length;
+  const char*   delimiters;
   int           num_filters;
   char*         str_end;  
   filter_def_t  filter;
 
   num_filters = 0;
+  text = dsp_filter_import;
 
-  strcpy( delimiters, "\r\n" );
+  delimiters = "\r\n";
   
   // Read in header (3 records)
-  token = strtok( dsp_filter_import, delimiters );
-  token = strtok( NULL, delimiters );
-  token = strtok( NULL, delimiters );
+  token = dsp_import_token( &text, delimiters, &token_length );
+  token = dsp_import_token( &text, delimiters, &token_length );
+  token = dsp_import_token( &text, delimiters, &token_length );
 
   // Read in filter records
-  strcpy( delimiters, " \r\n\t" );
-  token = strtok( NULL, delimiters );
+  delimiters = " \r\n\t";
+  token = dsp_import_token( &text, delimiters, &token_length );
     
   while( token != NULL ) {
        
     if( num_filters == DSP_MAX_FILTERS ) {
-      SERIAL.printf( "E-DSP: ERROR: Maximum filters exceeded in REW import\r\n" );      
+      dsp_printf( "E-DSP: ERROR: Maximum filters exceeded in REW import\r\n" );      
       return( NULL );
     }    
     
     // Discard next 3 tokens
     for( int i=1; i<=3; ++i ) {
       
-      token = strtok( NULL, delimiters );
+      token = dsp_import_token( &text, delimiters, &token_length );
       if( token == NULL ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid filter definition in REW file\r\n" );  
+        dsp_printf( "E-DSP: ERROR: Invalid filter definition in REW file\r\n" );  
         return( NULL );
       }   
     }
 
-    if( strcmp( token, "None" ) != 0 ) { 
+    if( token_length != 4 || strncmp( token, "None", 4 ) != 0 ) { 
 
       // Define the filter
       filter.filter_type = DSP_FILTER_PEAK_EQ;      
       filter.channel = DSP_ALL_CHANNELS;
 #ifdef DOUBLE_PRECISION
-      filter.precision = PRC_FLT;
+      filter.precision = PRC_AUTO;
 #endif
   
       // Frequency
-      token = strtok( NULL, delimiters );
+      token = dsp_import_token( &text, delimiters, &token_length );
       if( token == NULL ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid frequency value in REW import\r\n" );
+        dsp_printf( "E-DSP: ERROR: Invalid frequency value in REW import\r\n" );
         return( NULL );
       } 
         
       filter.frequency = strtof( token, &str_end );
       
       // Check if valid number format
-      if( *str_end != '\0' ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid frequency value in REW import\r\n" );
+      if( str_end != token + token_length ) {
+        dsp_printf( "E-DSP: ERROR: Invalid frequency value in REW import\r\n" );
         return( NULL );
       }      
   
       // Gain
-      token = strtok( NULL, delimiters );
+      token = dsp_import_token( &text, delimiters, &token_length );
       if( token == NULL ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid gain value in REW import\r\n" );
+        dsp_printf( "E-DSP: ERROR: Invalid gain value in REW import\r\n" );
         return( NULL );
       }
        
       filter.gain = strtof( token, &str_end ); 
 
       // Check if valid number format
-      if( *str_end != '\0' ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid gain value in REW import\r\n" );
+      if( str_end != token + token_length ) {
+        dsp_printf( "E-DSP: ERROR: Invalid gain value in REW import\r\n" );
         return( NULL );
       }
 
       // Q
-      token = strtok( NULL, delimiters );
+      token = dsp_import_token( &text, delimiters, &token_length );
       if( token == NULL ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid Q value in REW import\r\n" );
+        dsp_printf( "E-DSP: ERROR: Invalid Q value in REW import\r\n" );
         return( NULL );
       }
 
       filter.Q = strtof( token, &str_end );
 
       // Check if valid number format
-      if( *str_end != '\0' ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid Q value in REW import\r\n" );
+      if( str_end != token + token_length ) {
+        dsp_printf( "E-DSP: ERROR: Invalid Q value in REW import\r\n" );
         return( NULL );
       }      
 
@@ -109,16 +134,16 @@ static biquad_def_t* dsp_import_REW( int* import_filter_count ) {
       dsp_get_biquad( &filter, &biquad_defs[num_filters].coeffs[0] ); 
       
 #ifdef DOUBLE_PRECISION
-      biquad_defs[num_filters].precision = PRC_FLT;
+      biquad_defs[num_filters].precision = PRC_AUTO;
 #endif
       biquad_defs[num_filters].channel = DSP_ALL_CHANNELS;            
 
       // Skip next value
-      token = strtok( NULL, delimiters );              
+      token = dsp_import_token( &text, delimiters, &token_length );
 
       ++ num_filters;  
     }
-    token = strtok( NULL, delimiters );              
+    token = dsp_import_token( &text, delimiters, &token_length );
   }
   
   *import_filter_count = num_filters;
@@ -132,36 +157,38 @@ static biquad_def_t* dsp_import_REW( int* import_filter_count ) {
 //------------------------------------------------------------------------------------
 static biquad_def_t* dsp_import_HouseCurve( int* import_filter_count ) {
   
-  char*         token;
+  const char*   text;
+  const char*   token;
+  int           token_length;
   double        coeff;
   char*         str_end;
-  char          delimiters[] = ", \r\n\t";
+  const char*   delimiters = ", \r\n\t";
   int           num_filters;  
   const char*   prefix[5] = {"b0=", "b1=", "b2=", "a1=", "a2="}; 
-  dsp_filter_t  filter;
    
   num_filters = 0;
+  text = dsp_filter_import;
 
-  token = strtok( dsp_filter_import, delimiters );
+  token = dsp_import_token( &text, delimiters, &token_length );
   while( token != NULL ) {
     
     if( num_filters == DSP_MAX_FILTERS ) {
-      SERIAL.printf( "E-DSP: ERROR: Maximum filters exceeded in HouseCurve import\r\n" );      
+      dsp_printf( "E-DSP: ERROR: Maximum filters exceeded in HouseCurve import\r\n" );      
       return( NULL );
     }
     
     for( int i=0; i<5; ++i ) {
-      token = strtok( NULL, delimiters );
+      token = dsp_import_token( &text, delimiters, &token_length );
 
       // Check if all values entered
       if( token == NULL ) {
-        SERIAL.printf( "E-DSP: ERROR: Too few coefficients in HouseCurve import\r\n" );
+        dsp_printf( "E-DSP: ERROR: Too few coefficients in HouseCurve import\r\n" );
         return( NULL );
       }
 
       // Check if valid prefixes
-      if( strncmp( token, prefix[i], 3 )!= 0 ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid input in HouseCurve import\r\n" );
+      if( token_length < 3 || strncmp( token, prefix[i], 3 )!= 0 ) {
+        dsp_printf( "E-DSP: ERROR: Invalid input in HouseCurve import\r\n" );
         return( NULL );
       }
         
@@ -169,8 +196,8 @@ static biquad_def_t* dsp_import_HouseCurve( int* import_filter_count ) {
       coeff = strtod( token+3, &str_end );
 
       // Check if valid number format
-      if( *str_end != '\0' ) {
-        SERIAL.printf( "E-DSP: ERROR: Invalid coefficient value in HouseCurve import\r\n" );
+      if( str_end != token + token_length ) {
+        dsp_printf( "E-DSP: ERROR: Invalid coefficient value in HouseCurve import\r\n" );
         return( NULL );
       }
 
@@ -178,11 +205,11 @@ static biquad_def_t* dsp_import_HouseCurve( int* import_filter_count ) {
       biquad_defs[num_filters].coeffs[i] = coeff; 
     }
 #ifdef DOUBLE_PRECISION
-    biquad_defs[num_filters].precision = PRC_FLT;
+    biquad_defs[num_filters].precision = PRC_AUTO;
 #endif
     biquad_defs[num_filters].channel = DSP_ALL_CHANNELS;
     
-    token = strtok( NULL, delimiters ); 
+    token = dsp_import_token( &text, delimiters, &token_length );
     ++ num_filters;
   }
 
@@ -204,3 +231,121 @@ biquad_def_t* dsp_import_filters( int* import_filter_count ) {
 #endif
   return( NULL );
 }
+
+
+//------------------------------------------------------------------------------------
+// Start a new imported FIR response for the passed channel
+//------------------------------------------------------------------------------------
+static fir_def_t* dsp_import_fir_start( int channel, int num_defs, int tap_total ) {
+
+  if( num_defs == DSP_NUM_CHANNELS + 1 ) {
+    dsp_printf( "E-DSP: ERROR: Too many responses in FIR import\r\n" );
+    return( NULL );
+  }
+
+  // The tap storage is only allocated if there is something to import
+  if( fir_taps == NULL ) {
+    fir_taps = (float*) malloc( DSP_NUM_CHANNELS*DSP_FIR_MAX_TAPS*sizeof( float ) );
+    if( fir_taps == NULL ) {
+      dsp_printf( "E-DSP: ERROR: Unable to allocate FIR import\r\n" );
+      return( NULL );
+    }
+  }
+
+  fir_defs[num_defs].channel = channel;
+  fir_defs[num_defs].tap_count = 0;
+  fir_defs[num_defs].taps = &fir_taps[tap_total];
+
+  return( &fir_defs[num_defs] );
+}
+
+
+//------------------------------------------------------------------------------------
+// Import FIR impulse responses from include file
+//------------------------------------------------------------------------------------
+fir_def_t* dsp_import_fir( int* import_fir_count ) {
+
+  const char*   line;
+  const char*   line_end;
+  const char*   next_line;
+  const char*   token;
+  int           token_length;
+  char*         str_end;
+  const char*   delimiters = ", \t\r\n";
+  int           num_defs;
+  int           tap_total;
+  int           channel;
+  fir_def_t*    fir_def;
+
+  num_defs = 0;
+  tap_total = 0;
+  fir_def = NULL;
+
+  for( line = dsp_fir_import; *line != '\0'; line = next_line ) {
+
+    // Find the end of the line
+    line_end = line + strcspn( line, "\r\n" );
+    next_line = ( *line_end == '\0' ) ? line_end : line_end + 1;
+
+    while( *line == ' ' || *line == '\t' ) {
+      ++ line;
+    }
+
+    // Skip empty lines and comments
+    if( line == line_end || *line == '*' || *line == '#' ) {
+      continue;
+    }
+
+    // Channel of the following response
+    if( strncmp( line, "channel", 7 ) == 0 ) {
+      channel = strtol( line + 7, &str_end, 10 );
+
+      if( str_end == line + 7 || str_end > line_end || channel < 0 || channel >= DSP_NUM_CHANNELS ) {
+        dsp_printf( "E-DSP: ERROR: Invalid channel in FIR import\r\n" );
+        return( NULL );
+      }
+
+      fir_def = dsp_import_fir_start( channel, num_defs, tap_total );
+      if( fir_def == NULL ) {
+        return( NULL );
+      }
+      ++ num_defs;
+      continue;
+    }
+
+    // Taps up to the end of the line
+    token = dsp_import_token( &line, delimiters, &token_length );
+    while( token != NULL && token < line_end ) {
+
+      if( fir_def == NULL ) {
+        fir_def = dsp_import_fir_start( DSP_ALL_CHANNELS, num_defs, tap_total );
+        if( fir_def == NULL ) {
+          return( NULL );
+        }
+        ++ num_defs;
+      }
+
+      if( fir_def->tap_count == DSP_FIR_MAX_TAPS || tap_total == DSP_NUM_CHANNELS*DSP_FIR_MAX_TAPS ) {
+        dsp_printf( "E-DSP: ERROR: Maximum taps exceeded in FIR import\r\n" );
+        return( NULL );
+      }
+
+      fir_taps[tap_total] = strtof( token, &str_end );
+
+      // Check if valid number format
+      if( str_end != token + token_length ) {
+        dsp_printf( "E-DSP: ERROR: Invalid tap value in FIR import\r\n" );
+        return( NULL );
+      }
+
+      ++ tap_total;
+      ++ fir_def->tap_count;
+
+      token = dsp_import_token( &line, delimiters, &token_length );
+    }
+  }
+
+  *import_fir_count = num_defs;
+
+  return( &fir_defs[0] );
+}
@@ -0,0 +1,6 @@
+// Insert FIR impulse responses between the two following lines (e.g. a REW impulse
+// response exported as text at 44.1 kHz). Taps are separated by new lines, spaces or
+// commas, and lines starting with '*' or '#' are skipped. A "channel <n>" line starts
+// the response of a single channel, otherwise the response is used for all channels.
+R"(
+)"
@@ -0,0 +1,249 @@
+#include "dsp_engine.h"
+
+#define LIMIT_MARGIN          1e-4                // Gain margin below the ceiling for rounding of the averaged gain
+
+// Limiter of channels without a definition
+static const limiter_def_t default_limiter = { DSP_ALL_CHANNELS, DSP_LIMIT_CEILING_DB, DSP_LIMIT_ATTACK_MS, DSP_LIMIT_RELEASE_MS };
+
+
+//------------------------------------------------------------------------------------
+// Set the limiter of the channel and clear its state
+//
+// The look-ahead sets the window of the limiter: the gain is based on the highest
+// peak of the last window samples and averaged over the window, so it comes down
+// smoothly before a peak leaves the delay line and never lets it exceed the
+// ceiling. A NULL limiter_def selects the default limiter.
+//
+// The delay line, the reductions and the peak queue hold one window each and share
+// one allocation, which is only reallocated when the window changes.
+//------------------------------------------------------------------------------------
+esp_err_t dsp_limiter_set( dsp_channel_t* channel, const limiter_def_t* limiter_def ) {
+
+  dsp_limiter_t*    limiter;
+  double            release_samples;
+  int               window;
+
+  if( limiter_def == NULL ) {
+    limiter_def = &default_limiter;
+  }
+
+  if( limiter_def->ceiling_dB < DSP_LIMIT_MIN_CEILING_DB || limiter_def->ceiling_dB > 0 ||
+      limiter_def->attack_millis < 0 || limiter_def->attack_millis > DSP_LIMIT_MAX_ATTACK_MS ||
+      limiter_def->release_millis <= 0 || limiter_def->release_millis > DSP_LIMIT_MAX_RELEASE_MS ) {
+    dsp_printf( "E-DSP: ERROR: Invalid limiter setting for channel '%s'\r\n", channel->name );
+    return( ESP_FAIL );
+  }
+
+  limiter = &channel->data->limiter;
+  release_samples = (double) limiter_def->release_millis*DSP_SAMPLE_RATE/1000;
+  window = (int) lround( (double) limiter_def->attack_millis*DSP_SAMPLE_RATE/1000 ) + 1;
+
+  if( limiter->delay == NULL || limiter->window != window ) {
+    free( limiter->delay );
+    limiter->delay = (float*) malloc( window*( 3*sizeof( float ) + sizeof( uint32_t ) ) );
+    limiter->window = window;
+
+    if( limiter->delay == NULL ) {
+      dsp_printf( "E-DSP: Unable to allocate the limiter of channel '%s'\r\n", channel->name );
+      return( ESP_FAIL );
+    }
+
+    limiter->reduction = &limiter->delay[window];
+    limiter->peak_level = &limiter->delay[2*window];
+    limiter->peak_position = (uint32_t*) &limiter->delay[3*window];
+  }
+
+  limiter->limiter_def = limiter_def;
+  limiter->ceiling = DSP_MAX_LEVEL*exp10( limiter_def->ceiling_dB/20.0 )*( 1 - LIMIT_MARGIN );
+  limiter->release = exp( -1.0/release_samples );
+  limiter->scale = 1.0f/window;
+
+  dsp_limiter_reset( limiter );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Set the limiters of the configured channels, the others keep the default
+//------------------------------------------------------------------------------------
+esp_err_t dsp_limiter_init( dsp_channel_t* channels, const limiter_def_t* limiter_defs, int limiter_def_count ) {
+
+  for( int def_id = 0; def_id < limiter_def_count; ++ def_id ) {
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+
+      if( limiter_defs[def_id].channel != channel_id && limiter_defs[def_id].channel != DSP_ALL_CHANNELS ) {
+        continue;
+      }
+
+      if( dsp_limiter_set( &channels[channel_id], &limiter_defs[def_id] ) != ESP_OK ) {
+        return( ESP_FAIL );
+      }
+    }
+  }
+
+  dsp_share_channels( channels );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Clear the delay line and release the gain
+//------------------------------------------------------------------------------------
+void dsp_limiter_reset( dsp_limiter_t* limiter ) {
+
+  limiter->offset = 0;
+  limiter->position = 0;
+  limiter->head = 0;
+  limiter->count = 0;
+  limiter->gain = 1.0f;
+  limiter->reduction_sum = 0;
+
+  memset( limiter->delay, 0, limiter->window*sizeof( float ) );
+  memset( limiter->reduction, 0, limiter->window*sizeof( float ) );
+}
+
+
+//------------------------------------------------------------------------------------
+// Scale and limit the block (in place), delaying it by the look-ahead
+//
+// The peaks of the window are kept in a queue of decreasing levels, so the window
+// maximum is its oldest entry and every sample is queued and removed once. The gain
+// the maximum needs is released with a one pole filter and averaged over the window
+// as the sum of the reductions, which is exactly zero while nothing is limited so
+// the signal then passes unchanged. The sum is recalculated every time the window
+// wraps to remove rounding drift. Returns the lowest gain of the block and sets
+// max_level to the highest output level.
+//------------------------------------------------------------------------------------
+float dsp_limiter_process( dsp_limiter_t* limiter, float* buffer, int sample_count, float scaling_factor, float* max_level ) {
+
+  float*            delay;
+  float*            reduction;
+  float*            peak_level;
+  uint32_t*         peak_position;
+  float             ceiling;
+  float             release;
+  float             scale;
+  float             gain;
+  float             reduction_sum;
+  float             level;
+  float             target;
+  float             output_gain;
+  float             min_gain;
+  float             output_max;
+  uint32_t          position;
+  int               window;
+  int               offset;
+  int               head;
+  int               count;
+  int               tail;
+
+  delay = limiter->delay;
+  reduction = limiter->reduction;
+  peak_level = limiter->peak_level;
+  peak_position = limiter->peak_position;
+  ceiling = limiter->ceiling;
+  release = limiter->release;
+  scale = limiter->scale;
+  window = limiter->window;
+  offset = limiter->offset;
+  position = limiter->position;
+  head = limiter->head;
+  count = limiter->count;
+  gain = limiter->gain;
+  reduction_sum = limiter->reduction_sum;
+
+  min_gain = 1.0f;
+  output_max = 0;
+
+  for( int i = 0; i < sample_count; ++ i ) {
+    buffer[i] *= scaling_factor;
+    level = fabsf( buffer[i] );
+
+    // Expire the oldest peak, drop the queued peaks the new sample hides and queue it
+    if( count > 0 && position - peak_position[head] >= (uint32_t) window ) {
+      head = ( head + 1 < window ) ? head + 1 : 0;
+      -- count;
+    }
+
+    while( count > 0 ) {
+      tail = ( head + count - 1 < window ) ? head + count - 1 : head + count - 1 - window;
+      if( peak_level[tail] > level ) {
+        break;
+      }
+      -- count;
+    }
+
+    tail = ( head + count < window ) ? head + count : head + count - window;
+    peak_level[tail] = level;
+    peak_position[tail] = position;
+    ++ count;
+    ++ position;
+
+    // Gain for the window maximum, released towards it
+    target = ( peak_level[head] > ceiling ) ? ceiling/peak_level[head] : 1.0f;
+    gain = ( target < gain ) ? target : target - ( target - gain )*release;
+
+    // Average the reduction over the window and output the oldest sample
+    reduction_sum += ( 1.0f - gain ) - reduction[offset];
+    reduction[offset] = 1.0f - gain;
+    delay[offset] = buffer[i];
+
+    if( ++ offset == window ) {
+      offset = 0;
+      reduction_sum = 0;
+      for( int j = 0; j < window; ++ j ) {
+        reduction_sum += reduction[j];
+      }
+    }
+
+    output_gain = 1.0f - reduction_sum*scale;
+    buffer[i] = delay[offset]*output_gain;
+
+    min_gain = ( output_gain < min_gain ) ? output_gain : min_gain;
+    output_max = ( fabsf( buffer[i] ) > output_max ) ? fabsf( buffer[i] ) : output_max;
+  }
+
+  limiter->offset = offset;
+  limiter->position = position;
+  limiter->head = head;
+  limiter->count = count;
+  limiter->gain = gain;
+  limiter->reduction_sum = reduction_sum;
+
+  *max_level = output_max;
+
+  return( min_gain );
+}
+
+
+//------------------------------------------------------------------------------------
+// Show the lowest gain of the block in the gain reduction meters
+//------------------------------------------------------------------------------------
+void dsp_limiter_meter( dsp_data_t* dsp_data, float min_gain ) {
+
+  dsp_data->out_reduction_dB = ( min_gain < 1.0f ) ? -20*log10f( min_gain ) : 0;
+
+  if( dsp_data->out_reduction_dB > dsp_data->out_reduction_max_dB ) {
+    dsp_data->out_reduction_max_dB = dsp_data->out_reduction_dB;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the latency of the look-ahead in samples
+//------------------------------------------------------------------------------------
+int dsp_limiter_latency( dsp_limiter_t* limiter ) {
+
+  return( limiter->window - 1 );
+}
+
+
+//------------------------------------------------------------------------------------
+// Return true if the two limiters have the same settings
+//------------------------------------------------------------------------------------
+bool dsp_limiter_same( dsp_limiter_t* limiter_a, dsp_limiter_t* limiter_b ) {
+
+  return( limiter_a->ceiling == limiter_b->ceiling && limiter_a->release == limiter_b->release && limiter_a->window == limiter_b->window );
+}
@@ -0,0 +1,261 @@
+#include "dsp_engine.h"
+
+#define _PI                   3.14159265358979323846
+
+// Decimation/interpolation FIR filters for each supported factor. Interpolation
+// uses the same filter split into its polyphase components and scaled by the
+// factor, so each output sample only needs DSP_MULTIRATE_TAPS_PHASE taps.
+static const int      multirate_factors[] = { 4, 8, 16 };
+static float          Multirate_FIR[ 3 ][ DSP_MULTIRATE_TAPS_MAX ];
+static float          Multirate_Poly[ 3 ][ DSP_MULTIRATE_TAPS_MAX ];
+static bool           multirate_designed[ 3 ] = { false, false, false };
+
+
+//------------------------------------------------------------------------------------
+// Design the Blackman windowed sinc low pass for the passed factor
+//
+// The cutoff is the Nyquist frequency of the reduced rate. With 12 taps per phase
+// the response is flat to about a quarter of the reduced rate and everything that
+// would alias into that band is suppressed by about 70 dB.
+//------------------------------------------------------------------------------------
+static void dsp_multirate_design( int index ) {
+
+  int         factor;
+  int         taps;
+  double      centre;
+  double      x;
+  double      sum;
+  double      fir[ DSP_MULTIRATE_TAPS_MAX ];
+
+  factor = multirate_factors[index];
+  taps = factor*DSP_MULTIRATE_TAPS_PHASE;
+  centre = ( taps - 1 )/2.0;
+
+  sum = 0;
+  for( int i = 0; i < taps; ++ i ) {
+    x = ( i - centre )/factor;
+    fir[i] = ( x == 0 ) ? 1.0 : sin( _PI*x )/( _PI*x );
+    fir[i] *= 0.42 - 0.5*cos( 2*_PI*i/( taps - 1 ) ) + 0.08*cos( 4*_PI*i/( taps - 1 ) );
+    sum += fir[i];
+  }
+
+  for( int i = 0; i < taps; ++ i ) {
+    Multirate_FIR[index][i] = fir[i]/sum;
+  }
+
+  // Polyphase components: phase p uses taps p, p + factor, p + 2*factor, ...
+  for( int phase = 0; phase < factor; ++ phase ) {
+    for( int j = 0; j < DSP_MULTIRATE_TAPS_PHASE; ++ j ) {
+      Multirate_Poly[index][phase*DSP_MULTIRATE_TAPS_PHASE + j] = fir[phase + j*factor]/sum*factor;
+    }
+  }
+
+  multirate_designed[index] = true;
+}
+
+
+//------------------------------------------------------------------------------------
+// Set the decimation factor of the channel (1 = full rate) and clear its state.
+// Filters have to be reloaded afterwards, so they are designed for the new rate.
+//
+// The histories are only allocated for decimated channels. Both share one
+// allocation, which is only reallocated when the number of taps changes.
+//------------------------------------------------------------------------------------
+esp_err_t dsp_set_decimation( dsp_channel_t* channel, int factor ) {
+
+  dsp_multirate_t*  multirate;
+  int               index;
+  int               taps;
+
+  multirate = &channel->data->multirate;
+
+  if( factor <= 1 ) {
+    free( multirate->dec_hist );
+    multirate->dec_hist = NULL;
+    multirate->int_hist = NULL;
+    multirate->factor = 1;
+    multirate->taps = 0;
+    return( ESP_OK );
+  }
+
+  index = -1;
+  for( int i = 0; i < 3; ++ i ) {
+    if( multirate_factors[i] == factor ) {
+      index = i;
+    }
+  }
+
+  if( index < 0 ) {
+    dsp_printf( "E-DSP: ERROR: Invalid decimation %d for channel '%s' (4, 8 or 16)\r\n", factor, channel->name );
+    return( ESP_FAIL );
+  }
+
+  if( !multirate_designed[index] ) {
+    dsp_multirate_design( index );
+  }
+
+  taps = factor*DSP_MULTIRATE_TAPS_PHASE;
+
+  if( multirate->dec_hist == NULL || multirate->taps != taps ) {
+    free( multirate->dec_hist );
+    multirate->dec_hist = (float*) malloc( ( 2*taps + 2*DSP_MULTIRATE_TAPS_PHASE )*sizeof( float ) );
+    multirate->int_hist = NULL;
+    multirate->factor = 1;
+    multirate->taps = 0;
+
+    if( multirate->dec_hist == NULL ) {
+      dsp_printf( "E-DSP: Unable to allocate the decimation of channel '%s'\r\n", channel->name );
+      return( ESP_FAIL );
+    }
+
+    multirate->int_hist = &multirate->dec_hist[2*taps];
+  }
+
+  multirate->factor = factor;
+  multirate->taps = taps;
+  multirate->fir = Multirate_FIR[index];
+  multirate->poly = Multirate_Poly[index];
+  dsp_multirate_reset( multirate );
+
+  return( ESP_OK );
+}
+
+
+//------------------------------------------------------------------------------------
+// Clear the decimation and interpolation history, keeping the factor
+//------------------------------------------------------------------------------------
+void dsp_multirate_reset( dsp_multirate_t* multirate ) {
+
+  multirate->phase = 0;
+  multirate->dec_offset = 0;
+  multirate->int_offset = 0;
+
+  if( multirate->dec_hist != NULL ) {
+    memset( multirate->dec_hist, 0, ( 2*multirate->taps + 2*DSP_MULTIRATE_TAPS_PHASE )*sizeof( float ) );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Copy the phase and histories of a channel with the same decimation factor
+//------------------------------------------------------------------------------------
+void dsp_multirate_copy_state( dsp_multirate_t* multirate, dsp_multirate_t* source ) {
+
+  multirate->phase = source->phase;
+  multirate->dec_offset = source->dec_offset;
+  multirate->int_offset = source->int_offset;
+
+  if( multirate->dec_hist != NULL ) {
+    memcpy( multirate->dec_hist, source->dec_hist, ( 2*multirate->taps + 2*DSP_MULTIRATE_TAPS_PHASE )*sizeof( float ) );
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Decimate a block. Only every factor-th output of the FIR filter is calculated.
+// Returns the number of reduced rate samples, which depends on the phase.
+//------------------------------------------------------------------------------------
+int dsp_decimate( dsp_multirate_t* multirate, float* input, int sample_count, float* output ) {
+
+  int           factor;
+  int           taps;
+  int           phase;
+  int           offset;
+  int           output_count;
+  float*        hist;
+  const float*  fir;
+  float         sum0, sum1, sum2, sum3;
+
+  factor = multirate->factor;
+  taps = multirate->taps;
+  phase = multirate->phase;
+  offset = multirate->dec_offset;
+  hist = multirate->dec_hist;
+  fir = multirate->fir;
+
+  output_count = 0;
+
+  for( int i = 0; i < sample_count; ++ i ) {
+    // Store each sample twice, so the newest taps are always contiguous
+    offset = ( offset == 0 ) ? taps - 1 : offset - 1;
+    hist[offset] = input[i];
+    hist[offset + taps] = input[i];
+
+    if( ++ phase == factor ) {
+      phase = 0;
+
+      // Four partial sums, so the additions do not wait for each other
+      sum0 = sum1 = sum2 = sum3 = 0;
+      for( int k = 0; k < taps; k += 4 ) {
+        sum0 += fir[k]*hist[offset + k];
+        sum1 += fir[k + 1]*hist[offset + k + 1];
+        sum2 += fir[k + 2]*hist[offset + k + 2];
+        sum3 += fir[k + 3]*hist[offset + k + 3];
+      }
+      output[output_count ++] = ( sum0 + sum1 ) + ( sum2 + sum3 );
+    }
+  }
+
+  multirate->dec_offset = offset;
+
+  return( output_count );
+}
+
+
+//------------------------------------------------------------------------------------
+// Interpolate the reduced rate samples of the block back to the full rate. The
+// phase is shared with dsp_decimate(), so every sample decimated in the block is
+// consumed in the same block.
+//------------------------------------------------------------------------------------
+void dsp_interpolate( dsp_multirate_t* multirate, float* input, float* output, int sample_count ) {
+
+  int           factor;
+  int           phase;
+  int           offset;
+  float*        hist;
+  const float*  poly;
+  float         sum0, sum1, sum2, sum3;
+
+  factor = multirate->factor;
+  phase = multirate->phase;
+  offset = multirate->int_offset;
+  hist = multirate->int_hist;
+
+  for( int i = 0; i < sample_count; ++ i ) {
+    if( ++ phase == factor ) {
+      phase = 0;
+
+      offset = ( offset == 0 ) ? DSP_MULTIRATE_TAPS_PHASE - 1 : offset - 1;
+      hist[offset] = *input;
+      hist[offset + DSP_MULTIRATE_TAPS_PHASE] = *input;
+      ++ input;
+    }
+
+    poly = &multirate->poly[phase*DSP_MULTIRATE_TAPS_PHASE];
+
+    sum0 = sum1 = sum2 = sum3 = 0;
+    for( int j = 0; j < DSP_MULTIRATE_TAPS_PHASE; j += 4 ) {
+      sum0 += poly[j]*hist[offset + j];
+      sum1 += poly[j + 1]*hist[offset + j + 1];
+      sum2 += poly[j + 2]*hist[offset + j + 2];
+      sum3 += poly[j + 3]*hist[offset + j + 3];
+    }
+    output[i] = ( sum0 + sum1 ) + ( sum2 + sum3 );
+  }
+
+  multirate->phase = phase;
+  multirate->int_offset = offset;
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the latency of the decimation and interpolation filters in samples
+//------------------------------------------------------------------------------------
+int dsp_multirate_latency( dsp_multirate_t* multirate ) {
+
+  if( multirate->factor <= 1 ) {
+    return( 0 );
+  }
+
+  return( multirate->taps - 1 );
+}
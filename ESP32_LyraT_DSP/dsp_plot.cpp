@@ -27,12 +27,21 @@ static      int                 line_plot[ COL_CHART_MAX ];
 //------------------------------------------------------------------------------------
 static void dsp_xfer_func( dsp_channel_t* channel, float freq_range_low, float freq_range_high, int freq_range_bands, int sample_rate, float* frequency, float* gain ) {
 
-  dsp_data_t* dsp_data;
+  dsp_bank_t* bank;
+  dsp_fir_t*  fir;
+  dsp_crossover_t* crossover;
+  double      fir_re;
+  double      fir_im;
+  double      rot_re;
+  double      rot_im;
+  double      ph_re;
+  double      ph_im;
+  double      temp;
   float       freq_interval;
   float       freq;
   float       w;
   float       phi[ freq_range_bands ];
-  float       coeffs[ 5 ];
+  double      coeffs[ 5 ];
   int         band;
   int         filter;
 
@@ -53,20 +62,59 @@ static void dsp_xfer_func( dsp_channel_t* channel, float freq_range_low, float f
   }
 
   // Calculate the dB value for each band by calculating for each filter
-  dsp_data = channel->data;
+  bank = dsp_get_bank( channel->data );
   for( band = 0; band < freq_range_bands; ++ band ) {
     gain[ band ] = 0.0;
 
-    for( filter=0; filter < dsp_data->num_filters; ++ filter ) {
+    for( filter=0; filter < bank->num_filters; ++ filter ) {
 
       for( int i = 0; i < 5; ++ i ) {
-        coeffs[ i ] = dsp_data->filter[ filter ].coeffs_f[ i ];
+        coeffs[ i ] = bank->filter[ filter ].coeffs_d[ i ];
       }
 
       gain[ band ] +=
         10*log10(pow(coeffs[0]+coeffs[1]+coeffs[2],2)+(coeffs[0]*coeffs[2]*phi[band]-(coeffs[1]*(coeffs[0]+coeffs[2])+4*coeffs[0]*coeffs[2]))*phi[band]) -
         10*log10(pow(1-coeffs[3]-coeffs[4],2)+(-coeffs[4]*phi[band]-(-coeffs[3]*(1-coeffs[4])-4*coeffs[4]))*phi[band]);        
     }
+
+    // FIR response, which runs at the full sample rate
+    fir = channel->data->fir;
+    if( fir != NULL ) {
+      rot_re = cos( 2*PI*frequency[ band ]/DSP_SAMPLE_RATE );
+      rot_im = -sin( 2*PI*frequency[ band ]/DSP_SAMPLE_RATE );
+      ph_re = 1.0;
+      ph_im = 0.0;
+      fir_re = 0.0;
+      fir_im = 0.0;
+
+      for( int i = 0; i < fir->tap_count; ++ i ) {
+        fir_re += fir->taps[ i ]*ph_re;
+        fir_im += fir->taps[ i ]*ph_im;
+
+        // Advance the phasor by one sample
+        temp = ph_re*rot_re - ph_im*rot_im;
+        ph_im = ph_re*rot_im + ph_im*rot_re;
+        ph_re = temp;
+      }
+
+      gain[ band ] += 10*log10( fir_re*fir_re + fir_im*fir_im + 1e-20 );
+    }
+
+    // Linear-phase crossover, only the magnitude of the symmetric response matters
+    crossover = channel->data->crossover;
+    if( crossover != NULL ) {
+      fir_re = crossover->coeffs[ crossover->taps/2 ];
+      for( int i = 0; i < crossover->taps/2; ++ i ) {
+        fir_re += 2*crossover->coeffs[ i ]*cos( 2*PI*frequency[ band ]*( crossover->taps/2 - i )/DSP_SAMPLE_RATE );
+      }
+
+      gain[ band ] += 10*log10( fir_re*fir_re + 1e-20 );
+    }
+
+    // Decimated channels are cut off at the Nyquist frequency of the reduced rate
+    if( frequency[ band ] >= sample_rate/2 ) {
+      gain[ band ] = CHART_DB_LOW - CHART_DB_HIGH;
+    }
   }
 }
 
@@ -103,7 +151,7 @@ void dsp_plot( dsp_channel_t* channels ) {
 
   for( int chan_id = 0; chan_id < DSP_NUM_CHANNELS; ++ chan_id ) {
 
-    dsp_xfer_func( &channels[ chan_id ], FREQ_RANGE_LOW, FREQ_RANGE_HIGH, chart_columns, DSP_SAMPLE_RATE, ch_freq, ch_gain );
+    dsp_xfer_func( &channels[ chan_id ], FREQ_RANGE_LOW, FREQ_RANGE_HIGH, chart_columns, DSP_SAMPLE_RATE/channels[ chan_id ].data->multirate.factor, ch_freq, ch_gain );
 
     for( col = 0; col < chart_columns; ++ col ) {
 
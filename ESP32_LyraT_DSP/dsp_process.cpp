@@ -1,11 +1,37 @@
 #include "dsp_process.h"
 #include "dsp_config.h"
+#include "dsp_design.h"
+
+// The configuration is checked and the frequency specified filters are designed when compiling
+static_assert( dsp_design_check_filters( FREQ_Filters, DSP_COUNT( FREQ_Filters ) ), "Invalid channel, type, frequency or Q in FREQ_Filters" );
+static_assert( dsp_design_check_biquads( BIQUAD_Filters, DSP_COUNT( BIQUAD_Filters ) ), "Invalid channel in BIQUAD_Filters" );
+static_assert( dsp_design_check_counts( FREQ_Filters, DSP_COUNT( FREQ_Filters ), BIQUAD_Filters, DSP_COUNT( BIQUAD_Filters ) ), "More than DSP_MAX_FILTERS filters for a channel" );
+static_assert( dsp_design_check_crossovers( XO_Filters, DSP_COUNT( XO_Filters ) ), "Invalid channel, section, frequency or slope in XO_Filters" );
+static_assert( dsp_design_check_crossover_counts( XO_Filters, DSP_COUNT( XO_Filters ) ), "More than one crossover section for a channel" );
+static_assert( dsp_design_check_limiters( DSP_Limiters, DSP_COUNT( DSP_Limiters ) ), "Invalid channel, ceiling, attack or release in DSP_Limiters" );
+static_assert( dsp_design_check_nodes( DSP_Graph, DSP_COUNT( DSP_Graph ) ), "Invalid channel or node type in DSP_Graph" );
+
+static constexpr dsp_design_table<DSP_COUNT( FREQ_Filters )> FREQ_Biquads = dsp_design_filters( FREQ_Filters, dsp_design_make_index<DSP_COUNT( FREQ_Filters )>() );
 
 #define I2S_NUM         I2S_NUM_0
 
-#define I2S_READLEN     DSP_MAX_SAMPLES*sizeof( sample_t )
-static  sample_t        i2s_input_buffer[DSP_MAX_SAMPLES];
-static  sample_t        i2s_output_buffer[DSP_MAX_SAMPLES];
+#define I2S_READLEN     (i2s_block_samples*sizeof( sample_t ))
+static  sample_t        i2s_buffer[DSP_MAX_SAMPLES];   // Block read from I2S, processed in place and written back
+static  int             i2s_block_samples     = DSP_BLOCK_SAMPLES;   // Block size the I2S driver is installed with
+
+// DMA buffer count for each block size. Small blocks get an extra buffer to absorb
+// scheduling jitter of the DSP task.
+static const int        i2s_dma_block[]       = { 16, 32, 64, 96 };
+static const int        i2s_dma_count[]       = {  4,  3,  3,  3 };
+
+#define LATENCY_IMPULSE (DSP_MAX_LEVEL/4)     // Level of the loopback impulse (-12 dBFS), below the limiter ceiling
+#define LATENCY_LEVEL   (DSP_MAX_LEVEL/64)    // Input level detecting the loopback impulse (-36 dBFS)
+#define LATENCY_TIMEOUT DSP_SAMPLE_RATE       // Give up after a second of samples
+static  int             latency_measure       = 0;    // Loopback latency measurement requested
+
+#define I2S_EVENT_QUEUE 8                     // I2S driver event queue length
+#define I2S_FAULT_RESTART 8                   // Consecutive faulty blocks before the driver is reinstalled
+static  QueueHandle_t   i2s_event_queue       = NULL;
 
 #define I2C_NUM         I2C_NUM_0
 #define ES8388_ADDR     0x20
@@ -14,6 +40,54 @@ static  bool            dsp_filters_enabled   = true;
 static  bool            dsp_output_enabled    = true; 
 static  bool            dsp_ok_flag           = true;       
 
+#define DSP_PRINTF_MAX  256
+
+
+//------------------------------------------------------------------------------------ 
+// Formatted output from the DSP engine to the serial/telnet interface
+//------------------------------------------------------------------------------------
+void dsp_printf( const char* format, ... ) {
+
+  char      buffer[DSP_PRINTF_MAX];
+  va_list   args;
+
+  va_start( args, format );
+  vsnprintf( buffer, sizeof( buffer ), format, args );
+  va_end( args );
+
+  SERIAL.print( buffer );
+}
+
+
+//------------------------------------------------------------------------------------ 
+// CPU cycle counter for the DSP engine profiling
+//------------------------------------------------------------------------------------
+uint32_t dsp_get_cycles() {
+
+  return( ESP.getCycleCount() );
+}
+
+
+//------------------------------------------------------------------------------------ 
+// Allocate a large buffer for the DSP engine, from PSRAM if the board has it, so
+// internal RAM is left for the filters
+//------------------------------------------------------------------------------------
+void* dsp_malloc_large( size_t size ) {
+
+  void*     buffer;
+
+  buffer = NULL;
+  if( DSP_DELAY_PSRAM && psramFound() ) {
+    buffer = heap_caps_malloc( size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT );
+  }
+
+  if( buffer == NULL ) {
+    buffer = malloc( size );
+  }
+
+  return( buffer );
+}
+
 
 //------------------------------------------------------------------------------------ 
 // ES8388 write register
@@ -132,6 +206,8 @@ static void esp_led_flash( bool flash, unsigned long duration ) {
 //------------------------------------------------------------------------------------
 void dsp_command( char command ) {
 
+  esp_err_t res;
+
   if( !dsp_ok_flag ) {
     SERIAL.printf( "E-DSP: DSP initialization error. Reload.\r\n" );
     return;
@@ -180,35 +256,141 @@ void dsp_command( char command ) {
              {1, DSP_FILTER_PEAK_EQ, 140, 5.0, 2.0}             
              };
              
-      dsp_update_filters( FREQ_Filters, 10 );
-      SERIAL.printf("I-DSP: DSP filters updated\r\n");       
+      res = dsp_update_filters( FREQ_Filters, 10 );
+      if( res == ESP_OK ) {
+        SERIAL.printf("I-DSP: DSP filters updated\r\n");
+      } else if( res == ESP_ERR_INVALID_STATE ) {
+        SERIAL.printf("W-DSP: Filter transition in progress. Retry.\r\n");
+      } else {
+        SERIAL.printf("E-DSP: DSP filter update failed\r\n");
+      }
       break;
   }
 }
 
 
 //------------------------------------------------------------------------------------ 
-// DSP initialization
+// Statistics command: [reset]
 //------------------------------------------------------------------------------------
-esp_err_t dsp_init( TaskHandle_t* taskDSP ) {
-  
-  esp_err_t res = ESP_OK;
-  
-  SERIAL.printf("I-DSP: Initializing audio codec via I2C...\r\n");
+void dsp_stats_command( const char* arguments ) {
 
-  res |= es8388_init();
-  
-  if (res != ESP_OK) {
-    SERIAL.printf("E-DSP: Audio codec initialization failed!\r\n");
-    dsp_ok_flag = false;
-    return( res );
+  while( *arguments == ' ' ) {
+    ++ arguments;
+  }
+
+  if( strcmp( arguments, "reset" ) == 0 ) {
+    dsp_stats_reset();
+    SERIAL.printf( "I-DSP: Statistics reset\r\n" );
   } else {
-    SERIAL.printf("I-DSP: Audio codec initialization OK\r\n");
+    dsp_stats_info();
   }
+}
 
-  /*******************/
 
-  SERIAL.printf("I-DSP: Initializing input I2S...\r\n");
+//------------------------------------------------------------------------------------ 
+// Filter edit command: <channel> <filter> <freq|q|gain|type> <value>
+//
+// The channel is given as shown by 'i' (A, B, ...) and filters are numbered from 1.
+// Filter types are lp, hp, bp, notch, apf, peak, ls and hs.
+//------------------------------------------------------------------------------------
+void dsp_edit_command( const char* arguments ) {
+
+  static const char*  type_name[] = { "lp", "hp", "bp", "notch", "apf", "peak", "ls", "hs" };
+  char                channel_name;
+  int                 filter_id;
+  char                parameter[8];
+  char                value[16];
+  int                 channel_id;
+  dsp_bank_t*         bank;
+  filter_def_t        filter_def;
+  esp_err_t           res;
+
+  if( !dsp_ok_flag ) {
+    SERIAL.printf( "E-DSP: DSP initialization error. Reload.\r\n" );
+    return;
+  }
+
+  if( sscanf( arguments, " %c %d %7s %15s", &channel_name, &filter_id, parameter, value ) != 4 ) {
+    SERIAL.printf( "E-DSP: Usage: f <channel> <filter> <freq|q|gain|type> <value>\r\n" );
+    return;
+  }
+
+  channel_id = toupper( channel_name ) - 'A';
+  filter_id -= 1;
+
+  if( channel_id < 0 || channel_id >= DSP_NUM_CHANNELS ) {
+    SERIAL.printf( "E-DSP: Invalid channel '%c'\r\n", channel_name );
+    return;
+  }
+
+  bank = dsp_get_bank( DSP_Channels[channel_id].data );
+
+  if( filter_id < 0 || filter_id >= bank->num_filters ) {
+    SERIAL.printf( "E-DSP: Invalid filter '%d'\r\n", filter_id + 1 );
+    return;
+  }
+
+  // Only frequency defined filters have parameters to change
+  if( bank->filter[filter_id].filter_def == NULL ) {
+    SERIAL.printf( "E-DSP: Filter %d is defined by biquad coefficients\r\n", filter_id + 1 );
+    return;
+  }
+
+  filter_def = *bank->filter[filter_id].filter_def;
+  filter_def.channel = channel_id;
+
+  if( strcmp( parameter, "freq" ) == 0 ) {
+    filter_def.frequency = atof( value );
+  } else if( strcmp( parameter, "q" ) == 0 ) {
+    filter_def.Q = atof( value );
+  } else if( strcmp( parameter, "gain" ) == 0 ) {
+    filter_def.gain = atof( value );
+  } else if( strcmp( parameter, "type" ) == 0 ) {
+    filter_def.filter_type = -1;
+    for( int i = 0; i < sizeof( type_name )/sizeof( type_name[0] ); ++ i ) {
+      if( strcmp( value, type_name[i] ) == 0 ) {
+        filter_def.filter_type = i;
+      }
+    }
+    if( filter_def.filter_type < 0 ) {
+      SERIAL.printf( "E-DSP: Unknown filter type '%s'\r\n", value );
+      return;
+    }
+  } else {
+    SERIAL.printf( "E-DSP: Unknown filter parameter '%s'\r\n", parameter );
+    return;
+  }
+
+  if( filter_def.frequency <= 0 || filter_def.frequency >= DSP_SAMPLE_RATE/2 || filter_def.Q <= 0 ) {
+    SERIAL.printf( "E-DSP: Invalid filter frequency or Q\r\n" );
+    return;
+  }
+
+  res = dsp_edit_filter( channel_id, filter_id, &filter_def );
+  if( res == ESP_OK ) {
+    SERIAL.printf( "I-DSP: Channel %c filter %d updated\r\n", channel_id + 'A', filter_id + 1 );
+  } else if( res == ESP_ERR_INVALID_STATE ) {
+    SERIAL.printf( "W-DSP: Filter change in progress. Retry.\r\n" );
+  } else {
+    SERIAL.printf( "E-DSP: Filter edit failed\r\n" );
+  }
+}
+
+
+//------------------------------------------------------------------------------------ 
+// I2S driver installation for the passed block size
+//------------------------------------------------------------------------------------
+static esp_err_t dsp_i2s_init( int block_samples ) {
+
+  esp_err_t res = ESP_OK;
+  int       dma_buf_count;
+
+  dma_buf_count = 3;
+  for( int i = 0; i < sizeof( i2s_dma_block )/sizeof( i2s_dma_block[0] ); ++ i ) {
+    if( i2s_dma_block[i] == block_samples ) {
+      dma_buf_count = i2s_dma_count[i];
+    }
+  }
 
   i2s_config_t i2s_read_config;
   i2s_read_config.mode = (i2s_mode_t) (I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_RX);
@@ -217,8 +399,8 @@ esp_err_t dsp_init( TaskHandle_t* taskDSP ) {
   i2s_read_config.communication_format = I2S_COMM_FORMAT_I2S;
   i2s_read_config.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT;
   i2s_read_config.intr_alloc_flags = ESP_INTR_FLAG_LEVEL2;
-  i2s_read_config.dma_buf_count = 3;
-  i2s_read_config.dma_buf_len = I2S_READLEN;
+  i2s_read_config.dma_buf_count = dma_buf_count;
+  i2s_read_config.dma_buf_len = block_samples/DSP_NUM_CHANNELS;   // One block of sample frames
   i2s_read_config.use_apll = 1;
   i2s_read_config.tx_desc_auto_clear = 1;
   i2s_read_config.fixed_mclk = 0;
@@ -233,8 +415,250 @@ esp_err_t dsp_init( TaskHandle_t* taskDSP ) {
   i2s_read_pin_config.data_in_num = GPIO_NUM_35;
   i2s_read_pin_config.mck_io_num = GPIO_NUM_0;   
 
-  i2s_driver_install(I2S_NUM, &i2s_read_config, 0, NULL);
-  i2s_set_pin(I2S_NUM, &i2s_read_pin_config);
+  res |= i2s_driver_install(I2S_NUM, &i2s_read_config, I2S_EVENT_QUEUE, &i2s_event_queue);
+  res |= i2s_set_pin(I2S_NUM, &i2s_read_pin_config);
+
+  i2s_block_samples = block_samples;
+
+  return( res );
+}
+
+
+//------------------------------------------------------------------------------------ 
+// Latency command: [16|32|64|96|measure]
+//
+// Without arguments the block size, the buffering latency and the processing
+// latency of each channel are shown. A block size from the presets is only accepted
+// if the current filters fit in it. The measurement needs an output connected to an
+// input of the same channel.
+//------------------------------------------------------------------------------------
+void dsp_latency_command( const char* arguments ) {
+
+  dsp_data_t*   dsp_data;
+  int           block_samples;
+  int           dma_buf_count;
+  int           latency;
+  int           node_latency[DSP_NUM_NODE_TYPES];
+
+  if( !dsp_ok_flag ) {
+    SERIAL.printf( "E-DSP: DSP initialization error. Reload.\r\n" );
+    return;
+  }
+
+  while( *arguments == ' ' ) {
+    ++ arguments;
+  }
+
+  if( strcmp( arguments, "measure" ) == 0 ) {
+    if( !dsp_output_enabled ) {
+      SERIAL.printf( "E-DSP: DSP is STOPPED\r\n" );
+      return;
+    }
+    SERIAL.printf( "I-DSP: Measuring loopback latency...\r\n" );
+    __atomic_store_n( &latency_measure, 1, __ATOMIC_RELEASE );
+    return;
+  }
+
+  if( *arguments != '\0' ) {
+    block_samples = atoi( arguments );
+    if( dsp_set_block_size( DSP_Channels, block_samples ) != ESP_OK ) {
+      return;
+    }
+  }
+
+  // Samples queued in the DMA buffers on the way in and out plus the block processed
+  block_samples = dsp_get_block_size();
+  dma_buf_count = 3;
+  for( int i = 0; i < sizeof( i2s_dma_block )/sizeof( i2s_dma_block[0] ); ++ i ) {
+    if( i2s_dma_block[i] == block_samples ) {
+      dma_buf_count = i2s_dma_count[i];
+    }
+  }
+
+  SERIAL.printf( "I-DSP: Block size = %d samples, DMA buffers = %d\r\n", block_samples, dma_buf_count );
+  SERIAL.printf( "I-DSP: Buffering latency = %.2f ms (max)\r\n",
+    (float) ( 2*dma_buf_count + 1 )*block_samples/DSP_NUM_CHANNELS*1000/DSP_SAMPLE_RATE );
+  SERIAL.printf( "I-DSP: Buffer RAM = %d bytes DMA (in and out), %d bytes block\r\n",
+    2*dma_buf_count*block_samples*(int) sizeof( sample_t ), (int) sizeof( i2s_buffer ) );
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    dsp_data = DSP_Channels[channel_id].data;
+    latency = dsp_graph_latency( dsp_data, block_samples/DSP_NUM_CHANNELS, node_latency );
+
+    SERIAL.printf( "I-DSP: Channel %c processing latency = %d samples (%.2f ms: delay line %d, decimation %d, crossover %d, FIR %d, limiter %d), delay = %.2f ms\r\n",
+      channel_id + 'A', latency, (float) latency*1000/DSP_SAMPLE_RATE, node_latency[DSP_NODE_DELAY], node_latency[DSP_NODE_BIQUADS],
+      node_latency[DSP_NODE_CROSSOVER], node_latency[DSP_NODE_FIR], node_latency[DSP_NODE_LIMIT], DSP_Channels[channel_id].delay_millis );
+  }
+}
+
+
+//------------------------------------------------------------------------------------ 
+// Loopback latency measurement in the DSP task
+//
+// Replaces the input with a single impulse at -12 dBFS on every channel, which then
+// runs through the normal processing, so the limiter is not triggered and the
+// measurement includes the processing latency. The input is silenced while the
+// sample frames are counted until the impulse comes back on each channel.
+//------------------------------------------------------------------------------------
+static void dsp_latency_measure( size_t i2s_bytes_read ) {
+
+  static  int   frame_count = -1;
+  static  int   found[DSP_NUM_CHANNELS];
+  dsp_data_t*   dsp_data;
+  int           frames;
+  int           found_count;
+  int           latency;
+
+  if( frame_count < 0 ) {
+    if( !__atomic_load_n( &latency_measure, __ATOMIC_ACQUIRE ) ) {
+      return;
+    }
+
+    // Start the measurement with the impulse
+    memset( i2s_buffer, 0, sizeof( i2s_buffer ) );
+    for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+      i2s_buffer[channel_id] = LATENCY_IMPULSE << SAMPLE_NULL_BITS;
+      found[channel_id] = -1;
+    }
+    frame_count = 0;
+    return;
+  }
+
+  // Look for the impulse before the input is replaced by silence
+  frames = i2s_bytes_read/sizeof( sample_t )/DSP_NUM_CHANNELS;
+  found_count = 0;
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+    for( int i = 0; i < frames && found[channel_id] < 0; ++ i ) {
+      if( abs( i2s_buffer[i*DSP_NUM_CHANNELS + channel_id] >> SAMPLE_NULL_BITS ) > LATENCY_LEVEL ) {
+        found[channel_id] = frame_count + i;
+      }
+    }
+    found_count += ( found[channel_id] >= 0 );
+  }
+
+  memset( i2s_buffer, 0, sizeof( i2s_buffer ) );
+  frame_count += frames;
+
+  if( found_count < DSP_NUM_CHANNELS && frame_count <= LATENCY_TIMEOUT ) {
+    return;
+  }
+
+  if( found_count == 0 ) {
+    SERIAL.printf( "E-DSP: No loopback impulse received. Connect an output to an input.\r\n" );
+  }
+
+  for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS && found_count > 0; ++ channel_id ) {
+    dsp_data = DSP_Channels[channel_id].data;
+    latency = dsp_graph_latency( dsp_data, dsp_get_block_size()/DSP_NUM_CHANNELS, NULL );
+
+    if( found[channel_id] >= 0 ) {
+      SERIAL.printf( "I-DSP: Channel %c loopback latency = %d samples (%.2f ms, processing %d samples, delay %.2f ms)\r\n", channel_id + 'A',
+        found[channel_id], (float) found[channel_id]*1000/DSP_SAMPLE_RATE, latency, DSP_Channels[channel_id].delay_millis );
+    } else {
+      SERIAL.printf( "I-DSP: Channel %c loopback impulse not received\r\n", channel_id + 'A' );
+    }
+  }
+
+  frame_count = -1;
+  __atomic_store_n( &latency_measure, 0, __ATOMIC_RELEASE );
+}
+
+
+//------------------------------------------------------------------------------------ 
+// Count the I2S driver fault events. Returns true if any fault was reported.
+//------------------------------------------------------------------------------------
+static bool dsp_i2s_events() {
+
+  i2s_event_t   event;
+  bool          fault;
+
+  fault = false;
+
+  while( xQueueReceive( i2s_event_queue, &event, 0 ) == pdTRUE ) {
+    switch( event.type ) {
+      case I2S_EVENT_RX_Q_OVF :
+        dsp_stats_stream( DSP_STREAM_RX_OVERFLOW );
+        fault = true;
+        break;
+
+      case I2S_EVENT_TX_Q_OVF :
+        dsp_stats_stream( DSP_STREAM_TX_UNDERFLOW );
+        fault = true;
+        break;
+
+      case I2S_EVENT_DMA_ERROR :
+        dsp_stats_stream( DSP_STREAM_DMA_ERROR );
+        fault = true;
+        break;
+
+      default :
+        break;
+    }
+  }
+
+  return( fault );
+}
+
+
+//------------------------------------------------------------------------------------ 
+// Read a block from I2S. Returns true if the stream is faulty.
+//
+// A short read is completed to a whole sample frame, so the channels never swap,
+// and only the whole frames are passed on in i2s_bytes_read.
+//------------------------------------------------------------------------------------
+static bool dsp_i2s_read( size_t* i2s_bytes_read ) {
+
+  esp_err_t     res;
+  size_t        frame_bytes;
+  size_t        frame_rest;
+  size_t        bytes_read;
+
+  frame_bytes = DSP_NUM_CHANNELS*sizeof( sample_t );
+
+  res = i2s_read( I2S_NUM, i2s_buffer, I2S_READLEN, i2s_bytes_read, 100 );
+
+  if( res == ESP_OK && *i2s_bytes_read == I2S_READLEN ) {
+    return( false );
+  }
+
+  dsp_stats_stream( DSP_STREAM_READ_TIMEOUT );
+
+  frame_rest = *i2s_bytes_read % frame_bytes;
+  if( frame_rest != 0 ) {
+    i2s_read( I2S_NUM, ((uint8_t*) i2s_buffer) + *i2s_bytes_read, frame_bytes - frame_rest, &bytes_read, 100 );
+    *i2s_bytes_read += bytes_read;
+    *i2s_bytes_read -= *i2s_bytes_read % frame_bytes;
+  }
+
+  return( true );
+}
+
+
+//------------------------------------------------------------------------------------ 
+// DSP initialization
+//------------------------------------------------------------------------------------
+esp_err_t dsp_init( TaskHandle_t* taskDSP ) {
+  
+  esp_err_t res = ESP_OK;
+  
+  SERIAL.printf("I-DSP: Initializing audio codec via I2C...\r\n");
+
+  res |= es8388_init();
+  
+  if (res != ESP_OK) {
+    SERIAL.printf("E-DSP: Audio codec initialization failed!\r\n");
+    dsp_ok_flag = false;
+    return( res );
+  } else {
+    SERIAL.printf("I-DSP: Audio codec initialization OK\r\n");
+  }
+
+  /*******************/
+
+  SERIAL.printf("I-DSP: Initializing input I2S...\r\n");
+
+  dsp_i2s_init( i2s_block_samples );
 
   // set clipping LED to output
   gpio_set_direction(GPIO_NUM_22, GPIO_MODE_OUTPUT);
@@ -263,13 +687,33 @@ esp_err_t dsp_init( TaskHandle_t* taskDSP ) {
 //------------------------------------------------------------------------------------ 
 // DSP processing initialization
 //------------------------------------------------------------------------------------
-static esp_err_t dsp_processing_init( dsp_channel_t* channels, biquad_def_t* biquad_defs, int biquad_def_count, filter_def_t* filter_defs, int filter_def_count) {
+static esp_err_t dsp_processing_init( dsp_channel_t* channels, const biquad_def_t* biquad_defs, int biquad_def_count, const filter_def_t* filter_defs, int filter_def_count,
+  const biquad_def_t* filter_biquads, const crossover_def_t* crossover_defs, int crossover_def_count, const limiter_def_t* limiter_defs, int limiter_def_count,
+  const node_def_t* node_defs, int node_def_count ) {
   
   esp_err_t res = ESP_OK;
 
   SERIAL.printf("I-DSP: Setting up channels...\r\n");
 
-  res = dsp_filter_init( channels, biquad_defs, biquad_def_count, filter_defs, filter_def_count );
+  res = dsp_filter_init( channels, biquad_defs, biquad_def_count, filter_defs, filter_def_count, filter_biquads );
+  if( res != ESP_OK ) {
+    dsp_ok_flag = false;
+    return( res );
+  }
+
+  res = dsp_crossover_init( channels, crossover_defs, crossover_def_count );
+  if( res != ESP_OK ) {
+    dsp_ok_flag = false;
+    return( res );
+  }
+
+  res = dsp_limiter_init( channels, limiter_defs, limiter_def_count );
+  if( res != ESP_OK ) {
+    dsp_ok_flag = false;
+    return( res );
+  }
+
+  res = dsp_graph_init( channels, node_defs, node_def_count );
   if( res != ESP_OK ) {
     dsp_ok_flag = false;
     return( res );
@@ -290,32 +734,89 @@ void dsp_task( void * pvParameters ) {
   size_t        i2s_bytes_written;
   bool          clip_flag;
   esp_err_t     res;  
+  uint32_t      stage_start;
+  uint32_t      read_end;
+  uint32_t      read_last;
+  bool          stream_fault;
+  int           fault_blocks;
 
   // Setup the DSP channels
-  res = dsp_processing_init( DSP_Channels, BIQUAD_Filters, sizeof( BIQUAD_Filters )/sizeof( biquad_def_t ), FREQ_Filters, sizeof( FREQ_Filters )/sizeof( filter_def_t ) );
+  res = dsp_processing_init( DSP_Channels, BIQUAD_Filters, DSP_COUNT( BIQUAD_Filters ), FREQ_Filters, DSP_COUNT( FREQ_Filters ), FREQ_Biquads.biquad,
+    XO_Filters, DSP_COUNT( XO_Filters ), DSP_Limiters, DSP_COUNT( DSP_Limiters ), DSP_Graph, DSP_COUNT( DSP_Graph ) );
   
   if( res == ESP_OK ) {
     // Run DSP processing
     i2s_bytes_read  = I2S_READLEN;
+    fault_blocks = 0;
+    read_last = 0;
     
     while( true ) {
+     // Reinstall the I2S driver when the block size was changed or the stream does not recover
+     if( dsp_get_block_size() != i2s_block_samples || fault_blocks >= I2S_FAULT_RESTART ) {
+        if( fault_blocks >= I2S_FAULT_RESTART ) {
+          dsp_stats_stream( DSP_STREAM_RESTART );
+        }
+        i2s_driver_uninstall( I2S_NUM );
+        dsp_i2s_init( dsp_get_block_size() );
+        i2s_bytes_read = I2S_READLEN;
+        fault_blocks = 0;
+        read_last = 0;
+     }
+
      if( dsp_output_enabled ) {   
         // Read buffer
-        i2s_read( I2S_NUM, i2s_input_buffer, I2S_READLEN, &i2s_bytes_read, 100 );
+        stage_start = dsp_get_cycles();
+        stream_fault = dsp_i2s_read( &i2s_bytes_read );
+        read_end = dsp_get_cycles();
+
+        if( STATS_ON ) {
+          dsp_stats_add( DSP_STAGE_READ, read_end - stage_start );
+        }
+        if( read_last != 0 ) {
+          dsp_stats_period( read_end - read_last, i2s_bytes_read/sizeof( sample_t )/DSP_NUM_CHANNELS );
+        }
+        read_last = read_end;
+
+        // Realign the delay lines and filters after a dropout
+        stream_fault |= dsp_i2s_events();
+        if( stream_fault ) {
+          dsp_resync( DSP_Channels );
+        }
   
-        // Apply filters to buffer
+        // Apply filters to the buffer in place
         clip_flag = false;           
-        dsp_filter( DSP_Channels, i2s_input_buffer, i2s_output_buffer, i2s_bytes_read, dsp_filters_enabled, &clip_flag );
+        dsp_latency_measure( i2s_bytes_read );
+        dsp_filter( DSP_Channels, i2s_buffer, i2s_buffer, i2s_bytes_read, dsp_filters_enabled, &clip_flag );
+
+#ifdef DISPLAY_ON
+        // Send input and output levels for display
+        for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {
+          dsp_data_t* dsp_data = DSP_Channels[channel_id].data;
+          dsp_display_input( channel_id, dsp_data->in_max_level, dsp_data->in_clip_count );
+          dsp_display_output( channel_id, dsp_data->out_max_level, dsp_data->out_clip_count, dsp_data->out_reduction_dB );
+        }
+#endif
     
         // Write out buffer     
-        i2s_write( I2S_NUM, i2s_output_buffer, i2s_bytes_read, &i2s_bytes_written, 100 );
-        //i2s_write( I2S_NUM, i2s_input_buffer, i2s_bytes_read, &i2s_bytes_written, 100 );
+        stage_start = STATS_ON ? dsp_get_cycles() : 0;
+        res = i2s_write( I2S_NUM, i2s_buffer, i2s_bytes_read, &i2s_bytes_written, 100 );
+        if( STATS_ON ) {
+          dsp_stats_add( DSP_STAGE_WRITE, dsp_get_cycles() - stage_start );
+        }
+
+        if( res != ESP_OK || i2s_bytes_written != i2s_bytes_read ) {
+          dsp_stats_stream( DSP_STREAM_WRITE_TIMEOUT );
+          stream_fault = true;
+        }
+
+        // Count the faulty blocks in a row
+        fault_blocks = stream_fault ? fault_blocks + 1 : 0;
       } else {
 #ifdef DISPLAY_ON
         // Reset the display bars
         for( int channel_id = 0; channel_id < DSP_NUM_CHANNELS; ++ channel_id ) {       
           dsp_display_input( channel_id, 0.0, 0 );
-          dsp_display_output( channel_id, 0.0, 0 );        
+          dsp_display_output( channel_id, 0.0, 0, 0.0 );        
         }
         vTaskDelay( TASK_DELAY );        
 #endif
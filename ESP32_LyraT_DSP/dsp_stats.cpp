@@ -0,0 +1,236 @@
+#include "dsp_engine.h"
+
+#define STATS_BINS            11                  // Utilization histogram bins of 10%, the last one is over budget
+
+typedef struct dsp_stage_stats_t {
+  uint32_t      min;                              // Minimum cycles per block
+  uint32_t      max;                              // Maximum cycles per block
+  uint64_t      total;                            // Total cycles of all blocks
+  uint32_t      count;                            // Number of blocks measured
+} dsp_stage_stats_t;
+
+static const char*        stage_name[] = { "i2s_read", "input", "filters", "output", "i2s_write" };
+static dsp_stage_stats_t  stage_stats[ DSP_NUM_STAGES ];
+static uint32_t           block_cycles[ DSP_NUM_STAGES ];         // Cycles of each stage in the current block
+static uint32_t           util_histogram[ STATS_BINS ];
+static uint32_t           util_max;                               // Highest utilization in 0.1%
+static uint32_t           period_max;                             // Longest block period in cycles
+static int                stats_reset = 1;                        // Reset requested by the reporting task
+
+static const char*        stream_name[] = { "Read timeouts", "Write timeouts", "Input overflows", "Output underflows", "DMA errors", "Resyncs", "Driver restarts" };
+static uint32_t           stream_count[ DSP_NUM_STREAM_EVENTS ];
+static uint32_t           jitter_count;                           // Number of block periods measured
+static uint64_t           jitter_total;                           // Total deviation from the nominal block period in cycles
+static uint32_t           jitter_max;                             // Largest deviation from the nominal block period in cycles
+
+
+//------------------------------------------------------------------------------------
+// Clear all statistics (only called by the DSP task)
+//------------------------------------------------------------------------------------
+static void dsp_stats_clear() {
+
+  for( int stage = 0; stage < DSP_NUM_STAGES; ++ stage ) {
+    stage_stats[stage].min = UINT32_MAX;
+    stage_stats[stage].max = 0;
+    stage_stats[stage].total = 0;
+    stage_stats[stage].count = 0;
+    block_cycles[stage] = 0;
+  }
+
+  memset( util_histogram, 0, sizeof( util_histogram ) );
+  util_max = 0;
+  period_max = 0;
+
+  memset( stream_count, 0, sizeof( stream_count ) );
+  jitter_count = 0;
+  jitter_total = 0;
+  jitter_max = 0;
+}
+
+
+//------------------------------------------------------------------------------------
+// Clear the statistics if the reporting task asked for it
+//------------------------------------------------------------------------------------
+static void dsp_stats_check_reset() {
+
+  if( __atomic_exchange_n( &stats_reset, 0, __ATOMIC_ACQ_REL ) ) {
+    dsp_stats_clear();
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Add the cycles of a processing stage for the current block
+//------------------------------------------------------------------------------------
+void dsp_stats_add( int stage, uint32_t cycles ) {
+
+  dsp_stage_stats_t*  stats;
+
+  dsp_stats_check_reset();
+
+  stats = &stage_stats[stage];
+
+  if( cycles < stats->min ) {
+    stats->min = cycles;
+  }
+  if( cycles > stats->max ) {
+    stats->max = cycles;
+  }
+  stats->total += cycles;
+  ++ stats->count;
+
+  block_cycles[stage] = cycles;
+}
+
+
+//------------------------------------------------------------------------------------
+// Finish the statistics of a processed block
+//
+// The utilization is the time spent in the DSP engine (input, filters and output)
+// as a share of the block period.
+//------------------------------------------------------------------------------------
+void dsp_stats_block( int sample_count ) {
+
+  uint32_t    period;
+  uint32_t    util;
+  int         bin;
+
+  period = (uint32_t) ( (uint64_t) sample_count*DSP_CPU_MHZ*1000000/DSP_SAMPLE_RATE );
+  if( period == 0 ) {
+    return;
+  }
+
+  util = (uint32_t) ( (uint64_t) ( block_cycles[DSP_STAGE_INPUT] + block_cycles[DSP_STAGE_FILTERS] + block_cycles[DSP_STAGE_OUTPUT] )*1000/period );
+
+  bin = util/100;
+  if( bin >= STATS_BINS ) {
+    bin = STATS_BINS - 1;
+  }
+  ++ util_histogram[bin];
+
+  if( util > util_max ) {
+    util_max = util;
+  }
+  if( period > period_max ) {
+    period_max = period;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Count an I2S stream fault or recovery action
+//------------------------------------------------------------------------------------
+void dsp_stats_stream( int event ) {
+
+  dsp_stats_check_reset();
+
+  ++ stream_count[event];
+}
+
+
+//------------------------------------------------------------------------------------
+// Add the time between two consecutive blocks to the jitter statistics
+//------------------------------------------------------------------------------------
+void dsp_stats_period( uint32_t cycles, int sample_count ) {
+
+  uint32_t    period;
+  uint32_t    deviation;
+
+  dsp_stats_check_reset();
+
+  period = (uint32_t) ( (uint64_t) sample_count*DSP_CPU_MHZ*1000000/DSP_SAMPLE_RATE );
+  deviation = ( cycles > period ) ? cycles - period : period - cycles;
+
+  jitter_total += deviation;
+  ++ jitter_count;
+
+  if( deviation > jitter_max ) {
+    jitter_max = deviation;
+  }
+}
+
+
+//------------------------------------------------------------------------------------
+// Return the number of stream faults (recovery actions are not counted)
+//------------------------------------------------------------------------------------
+uint32_t dsp_stats_faults() {
+
+  uint32_t    faults;
+
+  faults = 0;
+  for( int event = 0; event < DSP_STREAM_RESYNC; ++ event ) {
+    faults += stream_count[event];
+  }
+
+  return( faults );
+}
+
+
+//------------------------------------------------------------------------------------
+// Request the statistics to be cleared by the DSP task
+//------------------------------------------------------------------------------------
+void dsp_stats_reset() {
+
+  __atomic_store_n( &stats_reset, 1, __ATOMIC_RELEASE );
+}
+
+
+//------------------------------------------------------------------------------------
+// Send the profiling statistics to serial output
+//------------------------------------------------------------------------------------
+void dsp_stats_info() {
+
+  dsp_stage_stats_t*  stats;
+  uint32_t            blocks;
+
+  if( __atomic_load_n( &stats_reset, __ATOMIC_ACQUIRE ) ) {
+    dsp_printf( "I-DSP: No statistics collected\r\n" );
+    return;
+  }
+
+  dsp_printf( "I-DSP: Stage statistics (cycles per block at %d MHz)\r\n", DSP_CPU_MHZ );
+  dsp_printf( "I-DSP:   %-10s %10s %10s %10s %10s\r\n", "stage", "blocks", "min", "avg", "max" );
+
+  for( int stage = 0; stage < DSP_NUM_STAGES; ++ stage ) {
+    stats = &stage_stats[stage];
+
+    if( stats->count == 0 ) {
+      dsp_printf( "I-DSP:   %-10s %10s\r\n", stage_name[stage], "n/a" );
+    } else {
+      dsp_printf( "I-DSP:   %-10s %10u %10u %10u %10u\r\n", stage_name[stage], stats->count, stats->min,
+        (uint32_t) ( stats->total/stats->count ), stats->max );
+    }
+  }
+
+  dsp_printf( "I-DSP: Stream\r\n" );
+  for( int event = 0; event < DSP_NUM_STREAM_EVENTS; ++ event ) {
+    dsp_printf( "I-DSP:   %-18s %10u\r\n", stream_name[event], stream_count[event] );
+  }
+
+  if( jitter_count > 0 ) {
+    dsp_printf( "I-DSP:   Block period jitter = %.1f us avg, %.1f us max\r\n",
+      (double) jitter_total/jitter_count/DSP_CPU_MHZ, (double) jitter_max/DSP_CPU_MHZ );
+  }
+
+  blocks = 0;
+  for( int bin = 0; bin < STATS_BINS; ++ bin ) {
+    blocks += util_histogram[bin];
+  }
+
+  if( blocks == 0 ) {
+    dsp_printf( "\r\n" );
+    return;
+  }
+
+  dsp_printf( "I-DSP: DSP budget utilization (input + filters + output, %% of %u cycle block period)\r\n", period_max );
+  dsp_printf( "I-DSP:   Max = %.1f%%, headroom = %.1f%%\r\n", util_max/10.0, 100.0 - util_max/10.0 );
+
+  for( int bin = 0; bin < STATS_BINS; ++ bin ) {
+    if( bin == STATS_BINS - 1 ) {
+      dsp_printf( "I-DSP:   >=%3d%%     %10u (%5.1f%%)\r\n", bin*10, util_histogram[bin], 100.0*util_histogram[bin]/blocks );
+    } else {
+      dsp_printf( "I-DSP:   %3d-%3d%%   %10u (%5.1f%%)\r\n", bin*10, bin*10 + 10, util_histogram[bin], 100.0*util_histogram[bin]/blocks );
+    }
+  }
+  dsp_printf( "\r\n" );
+}
@@ -0,0 +1,55 @@
+//------------------------------------------------------------------------------------
+// Biquad filter, direct form I in float with first-order error feedback
+//
+// The feedback coefficients are split as a1 = 2 + da1 and a2 = -1 + da2 so the large
+// terms 2*y1 and -y2 are exact. The rounding errors of the additions of the large
+// terms are recovered exactly (TwoSum) and fed back into the next output, putting
+// a zero at DC into the noise transfer function where the poles of low frequency
+// filters amplify the rounding noise the most.
+//
+// State: s[0] = x1, s[1] = x2, s[2] = y1, s[3] = y2, s[4] = error
+//------------------------------------------------------------------------------------
+int dsps_biquad_f32_ef(const float *input, float *output, int len, double *coef, float *s)
+{
+  float b0 = coef[0];
+  float b1 = coef[1];
+  float b2 = coef[2];
+  float da1 = coef[3] - 2.0;
+  float da2 = coef[4] + 1.0;
+  float x1 = s[0];
+  float x2 = s[1];
+  float y1 = s[2];
+  float y2 = s[3];
+  float e = s[4];
+
+  for (int i = 0 ; i < len ; i++) {
+    float x0 = input[i];
+
+    // Large terms: p = 2*y1 - y2 with its exact rounding error e1
+    float t = 2.0f * y1;
+    float p = t - y2;
+    float tp = p - t;
+    float e1 = (t - (p - tp)) + (-y2 - tp);
+
+    // Small terms plus the error fed back from the previous sample
+    float r = b0 * x0 + b1 * x1 + b2 * x2 + da1 * y1 + da2 * y2 + e;
+
+    // Output with its exact rounding error e2
+    float y0 = p + r;
+    float ty = y0 - p;
+    float e2 = (p - (y0 - ty)) + (r - ty);
+
+    e = e1 + e2;
+    x2 = x1;
+    x1 = x0;
+    y2 = y1;
+    y1 = y0;
+    output[i] = y0;
+  }
+  s[0] = x1;
+  s[1] = x2;
+  s[2] = y1;
+  s[3] = y2;
+  s[4] = e;
+  return 0;
+}
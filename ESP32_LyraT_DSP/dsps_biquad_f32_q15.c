@@ -0,0 +1,101 @@
+#include <stdint.h>
+
+//------------------------------------------------------------------------------------
+// Round a Q31 coefficient to Q15
+//------------------------------------------------------------------------------------
+static inline int32_t dsps_q15_coef(int32_t c)
+{
+  return (c >= 0x7FFF8000) ? 0x7FFF : ((c + 0x8000) >> 16);
+}
+
+
+//------------------------------------------------------------------------------------
+// Biquad filter, direct form I with Q15 coefficients and a 32-bit accumulator
+//
+// Fast path for 16-bit samples. The Q31 coefficients (scaled by 2^-coef[5]) are
+// rounded to Q15 and the samples are converted to integers with 'shift' fraction
+// bits. While the input and state values are below the bound where the five
+// products can not overflow, the sum is done in 32 bits. Louder samples are summed
+// in 64 bits and the output is saturated to the 32-bit range before it is stored
+// in the state. The truncated bits are fed back into the next sum as in the Q31
+// kernel.
+//
+// State: s[0] = x1, s[1] = x2, s[2] = y1, s[3] = y2, s[4] = error
+//------------------------------------------------------------------------------------
+int dsps_biquad_f32_q15(const float *input, float *output, int len, const int32_t *coef, int shift, int32_t *s)
+{
+  int32_t b0 = dsps_q15_coef(coef[0]);
+  int32_t b1 = dsps_q15_coef(coef[1]);
+  int32_t b2 = dsps_q15_coef(coef[2]);
+  int32_t a1 = dsps_q15_coef(coef[3]);
+  int32_t a2 = dsps_q15_coef(coef[4]);
+  int out_shift = 15 - coef[5];
+  int32_t mask = ((int32_t) 1 << out_shift) - 1;
+  float scale = (float) (1L << shift);
+  float unscale = 1.0f / scale;
+  int32_t x1 = s[0];
+  int32_t x2 = s[1];
+  int32_t y1 = s[2];
+  int32_t y2 = s[3];
+  int32_t e = s[4];
+  int64_t sum;
+  int bound_bits;
+
+  // Largest power of two bound of the values that keeps the 32-bit sum in range
+  sum = (int64_t) (b0 < 0 ? -b0 : b0) + (b1 < 0 ? -b1 : b1) + (b2 < 0 ? -b2 : b2) + (a1 < 0 ? -a1 : a1) + (a2 < 0 ? -a2 : a2);
+  bound_bits = 0;
+  while (bound_bits < 31 && (sum << (bound_bits + 1)) + mask <= INT32_MAX) {
+    bound_bits++;
+  }
+
+  for (int i = 0 ; i < len ; i++) {
+    float xf = input[i] * scale;
+    int32_t x0;
+    int32_t y0;
+
+    // Round the input and saturate it to the 32-bit range
+    if (xf >= 2147483648.0f) {
+      x0 = INT32_MAX;
+    } else if (xf <= -2147483648.0f) {
+      x0 = INT32_MIN;
+    } else {
+      x0 = (int32_t) (xf + (xf >= 0 ? 0.5f : -0.5f));
+    }
+
+    // The OR of the magnitudes is below 2^bound_bits only if each of them is
+    uint32_t level = (uint32_t) (x0 < 0 ? -(int64_t) x0 : x0) | (uint32_t) (x1 < 0 ? -(int64_t) x1 : x1) |
+                     (uint32_t) (x2 < 0 ? -(int64_t) x2 : x2) | (uint32_t) (y1 < 0 ? -(int64_t) y1 : y1) |
+                     (uint32_t) (y2 < 0 ? -(int64_t) y2 : y2);
+
+    if ((level >> bound_bits) == 0) {
+      int32_t acc = b0 * x0 + b1 * x1 + b2 * x2 + a1 * y1 + a2 * y2 + e;
+
+      // Truncate to the output and keep the truncated bits for the next sample
+      y0 = acc >> out_shift;
+      e = acc & mask;
+    } else {
+      int64_t acc = (int64_t) b0 * x0 + (int64_t) b1 * x1 + (int64_t) b2 * x2 + (int64_t) a1 * y1 + (int64_t) a2 * y2 + e;
+      int64_t y = acc >> out_shift;
+      e = (int32_t) (acc & mask);
+
+      if (y > INT32_MAX) {
+        y = INT32_MAX;
+      } else if (y < INT32_MIN) {
+        y = INT32_MIN;
+      }
+      y0 = (int32_t) y;
+    }
+
+    x2 = x1;
+    x1 = x0;
+    y2 = y1;
+    y1 = y0;
+    output[i] = (float) y0 * unscale;
+  }
+  s[0] = x1;
+  s[1] = x2;
+  s[2] = y1;
+  s[3] = y2;
+  s[4] = e;
+  return 0;
+}
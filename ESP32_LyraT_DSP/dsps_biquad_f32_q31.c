@@ -0,0 +1,68 @@
+#include <stdint.h>
+
+//------------------------------------------------------------------------------------
+// Biquad filter, direct form I in Q31 fixed point with a 64-bit accumulator
+//
+// The coefficients are Q31 values scaled by 2^-coef[5] (post shift). The samples are
+// converted to 32-bit integers with 'shift' fraction bits, which leaves the bits
+// above the sample width as headroom. The five products are summed in 64 bits and
+// the bits truncated from the output are fed back into the next sum, putting a zero
+// at DC into the noise transfer function like the float error feedback kernel.
+//
+// State: s[0] = x1, s[1] = x2, s[2] = y1, s[3] = y2, s[4] = error
+//------------------------------------------------------------------------------------
+int dsps_biquad_f32_q31(const float *input, float *output, int len, const int32_t *coef, int shift, int32_t *s)
+{
+  int64_t b0 = coef[0];
+  int64_t b1 = coef[1];
+  int64_t b2 = coef[2];
+  int64_t a1 = coef[3];
+  int64_t a2 = coef[4];
+  int out_shift = 31 - coef[5];
+  int64_t mask = ((int64_t) 1 << out_shift) - 1;
+  float scale = (float) (1L << shift);
+  float unscale = 1.0f / scale;
+  int32_t x1 = s[0];
+  int32_t x2 = s[1];
+  int32_t y1 = s[2];
+  int32_t y2 = s[3];
+  int64_t e = s[4];
+
+  for (int i = 0 ; i < len ; i++) {
+    float xf = input[i] * scale;
+    int32_t x0;
+
+    // Round the input and saturate it to the 32-bit range
+    if (xf >= 2147483648.0f) {
+      x0 = INT32_MAX;
+    } else if (xf <= -2147483648.0f) {
+      x0 = INT32_MIN;
+    } else {
+      x0 = (int32_t) (xf + (xf >= 0 ? 0.5f : -0.5f));
+    }
+
+    int64_t acc = b0 * x0 + b1 * x1 + b2 * x2 + a1 * y1 + a2 * y2 + e;
+
+    // Truncate to the output and keep the truncated bits for the next sample
+    int64_t y = acc >> out_shift;
+    e = acc & mask;
+
+    if (y > INT32_MAX) {
+      y = INT32_MAX;
+    } else if (y < INT32_MIN) {
+      y = INT32_MIN;
+    }
+
+    x2 = x1;
+    x1 = x0;
+    y2 = y1;
+    y1 = (int32_t) y;
+    output[i] = (float) y1 * unscale;
+  }
+  s[0] = x1;
+  s[1] = x2;
+  s[2] = y1;
+  s[3] = y2;
+  s[4] = (int32_t) e;
+  return 0;
+}
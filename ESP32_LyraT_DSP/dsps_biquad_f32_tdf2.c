@@ -0,0 +1,22 @@
+//------------------------------------------------------------------------------------
+// Biquad filter, transposed direct form II with double precision state
+//
+// The two state values are kept in double between blocks, unlike dsps_biquad_f32_dbl
+// which rounds its W values to float on every sample.
+//------------------------------------------------------------------------------------
+int dsps_biquad_f32_tdf2(const float *input, float *output, int len, double *coef, double *s)
+{
+  double s0 = s[0];
+  double s1 = s[1];
+
+  for (int i = 0 ; i < len ; i++) {
+    double x = input[i];
+    double y = coef[0] * x + s0;
+    s0 = coef[1] * x + coef[3] * y + s1;
+    s1 = coef[2] * x + coef[4] * y;
+    output[i] = y;
+  }
+  s[0] = s0;
+  s[1] = s1;
+  return 0;
+}
@@ -4,20 +4,22 @@
 dsp_channel_t DSP_Channels[DSP_NUM_CHANNELS] = {
   {
     "Subwoofer 1",      // Channel name
-    {1,1},              // Input channel(s) - Left/Right
+    {1,1},              // Input channel(s) - Left/Right (linear gains, negative inverts, {1,1} averages)
     0,                  // Gain in dB
-    0                   // Delay in milliseconds
+    0,                  // Delay in milliseconds (fractions allowed, e.g. 0.125)
+    16                  // Decimation (4, 8 or 16 for band-limited channels)
   },
   {
     "Subwoofer 2",
     {1,1},
     0,
-    0
+    0,
+    16
   }
 };
 
 // Frequency specified filters
-filter_def_t FREQ_Filters[] = {  // Channel, Filter type, Center frequency, Q value, Gain
+constexpr filter_def_t FREQ_Filters[] = {  // Channel, Filter type, Center frequency, Q value, Gain
   {0, DSP_FILTER_LOW_PASS, 120, 0.7, 0.0 },
   {0, DSP_FILTER_LOW_PASS, 120, 0.7, 0.0 },
   {0, DSP_FILTER_PEAK_EQ, 35, 2.0, 4.0 },
@@ -30,5 +32,21 @@ filter_def_t FREQ_Filters[] = {  // Channel, Filter type, Center frequency, Q va
  };
 
 // BiQuad specified filters
-biquad_def_t BIQUAD_Filters[] = { // Channel, Biquad filter coefficients (b0, b1, b2, a1, a2)
+constexpr biquad_def_t BIQUAD_Filters[] = { // Channel, Biquad filter coefficients (b0, b1, b2, a1, a2)
+};
+
+// Linear-phase crossover sections (one per channel)
+constexpr crossover_def_t XO_Filters[] = { // Channel, Section, Frequency, Upper frequency (band pass), Slope in dB/octave
+};
+
+// Look-ahead output limiters. Channels without one limit at -0.1 dBFS without look-ahead
+// (instant attack, no added latency) and with 50 ms release. An attack delays the
+// channel by the look-ahead.
+constexpr limiter_def_t DSP_Limiters[] = { // Channel, Ceiling in dBFS, Attack (look-ahead) in ms, Release in ms
+};
+
+// Processing graph nodes in signal order (mixer first, biquads once, dither last).
+// Channels without nodes use the default graph: MIX, METER, DELAY, BIQUADS, CROSSOVER,
+// FIR, GAIN, LIMIT, METER and DITHER if enabled.
+constexpr node_def_t DSP_Graph[] = { // Channel, Node type
 };